@@ -0,0 +1,146 @@
+/* ------------------------ m_pd.h (bench stub) ------------------------------- */
+/*                                                                              */
+/* The part of Pd's m_pd.h that nstream~ and nsreceive~ use, so "make bench"    */
+/* can build and time their perform routines without Pd. See pdstub.c.          */
+/*                                                                              */
+/* This program is free software; you can redistribute it and/or                */
+/* modify it under the terms of the GNU General Public License                  */
+/* as published by the Free Software Foundation; either version 2               */
+/* of the License, or (at your option) any later version.                       */
+/*                                                                              */
+/* See file LICENSE for further informations on licensing terms.                */
+/*                                                                              */
+/* This program is distributed in the hope that it will be useful,              */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of               */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                */
+/* GNU General Public License for more details.                                 */
+/*                                                                              */
+/* ---------------------------------------------------------------------------- */
+
+
+#ifndef __m_pd_h_
+#define __m_pd_h_
+
+#include <stddef.h>
+
+#define EXTERN extern
+#define MAXPDARG 5                      /* max. typed arguments of a method, as in Pd */
+
+typedef long t_int;
+typedef float t_float;
+typedef float t_floatarg;
+typedef float t_sample;
+
+typedef struct _symbol
+{
+	const char *s_name;
+	void *s_thing;
+	struct _symbol *s_next;
+} t_symbol;
+
+typedef struct _class t_class;
+typedef struct _outlet t_outlet;
+typedef struct _inlet t_inlet;
+typedef struct _clock t_clock;
+typedef t_class *t_pd;
+
+typedef struct _gobj
+{
+	t_pd g_pd;
+	struct _gobj *g_next;
+} t_gobj;
+
+typedef struct _text
+{
+	t_gobj te_g;
+	void *te_binbuf;
+	t_outlet *te_outlet;
+	t_inlet *te_inlet;
+	short te_xpix;
+	short te_ypix;
+	short te_width;
+	unsigned int te_type:2;
+} t_object;
+
+#define ob_pd te_g.g_pd
+
+typedef enum
+{
+	A_NULL, A_FLOAT, A_SYMBOL, A_POINTER, A_SEMI, A_COMMA, A_DEFFLOAT,
+	A_DEFSYM, A_DOLLAR, A_DOLLSYM, A_GIMME, A_CANT
+} t_atomtype;
+
+typedef union word
+{
+	t_float w_float;
+	t_symbol *w_symbol;
+	int w_index;
+} t_word;
+
+typedef struct _atom
+{
+	t_atomtype a_type;
+	union word a_w;
+} t_atom;
+
+#define SETFLOAT(atom, f) ((atom)->a_type = A_FLOAT, (atom)->a_w.w_float = (f))
+#define SETSYMBOL(atom, s) ((atom)->a_type = A_SYMBOL, (atom)->a_w.w_symbol = (s))
+
+typedef void (*t_method)(void);
+typedef void *(*t_newmethod)(void);
+typedef t_int *(*t_perfroutine)(t_int *args);
+
+typedef struct _signal
+{
+	int s_n;
+	t_sample *s_vec;
+	t_float s_sr;
+} t_signal;
+
+#define CLASS_DEFAULT 0
+
+EXTERN t_symbol s_signal, s_float, s_list, s_anything, s_bang, s_symbol;
+EXTERN t_symbol *gensym(const char *s);
+
+EXTERN void post(const char *fmt, ...);
+EXTERN void error(const char *fmt, ...);
+EXTERN void pd_error(void *object, const char *fmt, ...);
+
+EXTERN t_class *class_new(t_symbol *name, t_newmethod newmethod, t_method freemethod,
+			  size_t size, int flags, t_atomtype arg1, ...);
+EXTERN void class_addmethod(t_class *c, t_method fn, t_symbol *sel, t_atomtype arg1, ...);
+EXTERN void class_addbang(t_class *c, t_method fn);
+EXTERN void class_addfloat(t_class *c, t_method fn);
+EXTERN void class_sethelpsymbol(t_class *c, t_symbol *s);
+#define class_addbang(x, y) class_addbang((x), (t_method)(y))
+#define class_addfloat(x, y) class_addfloat((x), (t_method)(y))
+EXTERN void nullfn(void);
+
+EXTERN t_pd *pd_new(t_class *cls);
+EXTERN t_outlet *outlet_new(t_object *owner, t_symbol *s);
+EXTERN t_inlet *inlet_new(t_object *owner, t_pd *dest, t_symbol *s1, t_symbol *s2);
+EXTERN void outlet_float(t_outlet *x, t_float f);
+EXTERN void outlet_anything(t_outlet *x, t_symbol *s, int argc, t_atom *argv);
+EXTERN void outlet_list(t_outlet *x, t_symbol *s, int argc, t_atom *argv);
+
+EXTERN t_clock *clock_new(void *owner, t_method fn);
+EXTERN void clock_delay(t_clock *x, double delaytime);
+EXTERN void clock_unset(t_clock *x);
+EXTERN void clock_free(t_clock *x);
+EXTERN double clock_getlogicaltime(void);
+
+EXTERN void *getbytes(size_t nbytes);
+EXTERN void *t_getbytes(size_t nbytes);
+EXTERN void *resizebytes(void *x, size_t oldsize, size_t newsize);
+EXTERN void freebytes(void *x, size_t nbytes);
+EXTERN void t_freebytes(void *x, size_t nbytes);
+
+EXTERN void dsp_add(t_perfroutine f, int n, ...);
+EXTERN void dsp_addv(t_perfroutine f, int n, t_int *vec);
+
+EXTERN t_float atom_getfloat(const t_atom *a);
+EXTERN t_symbol *atom_getsymbol(const t_atom *a);
+EXTERN t_float atom_getfloatarg(int which, int argc, const t_atom *argv);
+EXTERN t_symbol *atom_getsymbolarg(int which, int argc, const t_atom *argv);
+
+#endif /* __m_pd_h_ */
@@ -0,0 +1,202 @@
+/* ------------------------ nsbench ------------------------------------------- */
+/*                                                                              */
+/* Times the perform routines of nstream~ and nsreceive~ for every format,      */
+/* channel count and vector size over loopback UDP and writes JSON.             */
+/*                                                                              */
+/* This program is free software; you can redistribute it and/or                */
+/* modify it under the terms of the GNU General Public License                  */
+/* as published by the Free Software Foundation; either version 2               */
+/* of the License, or (at your option) any later version.                       */
+/*                                                                              */
+/* See file LICENSE for further informations on licensing terms.                */
+/*                                                                              */
+/* This program is distributed in the hope that it will be useful,              */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of               */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                */
+/* GNU General Public License for more details.                                 */
+/*                                                                              */
+/* ---------------------------------------------------------------------------- */
+
+
+#include "m_pd.h"
+#include "pdstub.h"
+#include "nstream~.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_PORT 9931                 /* loopback port the pairs stream over */
+#define BENCH_SAMPLERATE 44100
+#define BENCH_MAXCHANNELS 128
+#define BENCH_FRAMES (1 << 20)          /* sample frames timed per configuration */
+#define BENCH_WARMUP 64                 /* packets before timing starts */
+
+void nstream_tilde_setup(void);
+void nsreceive_tilde_setup(void);
+
+static const char *bench_formats[] = { "float", "16bit", "8bit" };
+static const int bench_vecsizes[] = { 64, 128, 256, 512, 1024 };
+
+typedef struct _benchresult
+{
+	double r_sendns;                    /* in nstream~'s perform */
+	double r_recvns;                    /* in nsreceive~'s perform */
+	int r_frames;                       /* sample frames timed */
+} t_benchresult;
+
+
+static double bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1e9 + ts.tv_nsec);
+}
+
+
+/* one sender and one receiver streaming to each other in lock step: the
+   sender's perform (encode and send) and the receiver's perform (decode
+   and playout) are timed separately, reading the socket in between is not */
+static int bench_run(const char *format, int channels, int vecsize, t_benchresult *r)
+{
+	t_sample *in[BENCH_MAXCHANNELS], *out[BENCH_MAXCHANNELS + 1];
+	t_pdstub_chain send, recv;
+	char args[64];
+	void *snd, *rcv;
+	int blocks = BENCH_FRAMES / vecsize;
+	int warmup = BENCH_WARMUP * (DEFAULT_AUDIO_BUFFER_SIZE / vecsize);
+	int i, k, ok = 0;
+	double t;
+
+	snprintf(args, sizeof(args), "%d %d", BENCH_PORT, channels);
+	if (!(rcv = pdstub_new("nsreceive~", args)))
+		return (0);
+	snprintf(args, sizeof(args), "%d", channels);
+	snd = pdstub_new("nstream~", args);
+	snprintf(args, sizeof(args), "connect localhost %d", BENCH_PORT);
+	pdstub_send(snd, args);
+	for (i = 0; i < 1000 && pdstub_lastfloat(snd) != 1; i++)
+		pdstub_poll(1);
+	snprintf(args, sizeof(args), "format %s", format);
+	pdstub_send(snd, args);
+
+	for (k = 0; k < channels; k++)
+	{
+		in[k] = (t_sample *)getbytes(vecsize * sizeof(t_sample));
+		for (i = 0; i < vecsize; i++)
+			in[k][i] = (t_sample)(0.5 * ((i * 7 + k * 13) % 64) / 64. - 0.25);
+	}
+	for (k = 0; k <= channels; k++)
+		out[k] = (t_sample *)getbytes(vecsize * sizeof(t_sample));
+	send = pdstub_dsp(snd, channels, in, vecsize, BENCH_SAMPLERATE);
+	recv = pdstub_dsp(rcv, channels + 1, out, vecsize, BENCH_SAMPLERATE);
+
+	if (pdstub_lastfloat(snd) == 1)
+	{
+		r->r_sendns = r->r_recvns = 0;
+		for (i = -warmup; i < blocks; i++)
+		{
+			t = bench_now();
+			pdstub_run(&send);
+			if (i >= 0)
+				r->r_sendns += bench_now() - t;
+			pdstub_poll(0);
+			t = bench_now();
+			pdstub_run(&recv);
+			if (i >= 0)
+				r->r_recvns += bench_now() - t;
+		}
+		r->r_frames = blocks * vecsize;
+		ok = 1;
+		/* a receiver that only underflowed did not decode anything */
+		for (i = 0; i < vecsize && out[1][i] == 0; i++)
+			;
+		if (i == vecsize)
+			error("nsbench: nsreceive~ played silence (%s, %d channels, vecsize %d)",
+			      format, channels, vecsize);
+	}
+	else
+		error("nsbench: nstream~ did not connect");
+
+	pdstub_free(snd);
+	pdstub_free(rcv);
+	for (k = 0; k < channels; k++)
+		freebytes(in[k], vecsize * sizeof(t_sample));
+	for (k = 0; k <= channels; k++)
+		freebytes(out[k], vecsize * sizeof(t_sample));
+	return (ok);
+}
+
+
+static void bench_print(FILE *f, int *first, const char *object, const char *format,
+			int channels, int vecsize, double ns, int frames)
+{
+	double samples = (double)frames * channels;
+
+	fprintf(f, "%s\n    {\"object\": \"%s\", \"format\": \"%s\", \"channels\": %d, "
+		"\"vecsize\": %d, \"ns_per_sample\": %.4f, \"gb_per_s\": %.4f}",
+		*first ? "" : ",", object, format, channels, vecsize,
+		ns / samples, samples * sizeof(t_sample) / ns);
+	*first = 0;
+}
+
+
+static void bench_usage(void)
+{
+	fprintf(stderr, "usage: nsbench [-o file.json] [-v]\n");
+	exit(1);
+}
+
+
+int main(int argc, char **argv)
+{
+	const char *file = NULL;
+	FILE *f = stdout;
+	t_benchresult r;
+	int first = 1, fi, vi, channels, opt;
+
+	while ((opt = getopt(argc, argv, "o:v")) != -1)
+	{
+		if (opt == 'o')
+			file = optarg;
+		else if (opt == 'v')
+			pdstub_verbose = 1;
+		else
+			bench_usage();
+	}
+	if (file && !(f = fopen(file, "w")))
+	{
+		perror(file);
+		return (1);
+	}
+
+	nstream_tilde_setup();
+	nsreceive_tilde_setup();
+
+	fprintf(f, "{\n  \"compiler\": \"%s\",\n  \"samplerate\": %d,\n  \"blocksize\": %d,\n"
+		"  \"frames\": %d,\n  \"results\": [", __VERSION__, BENCH_SAMPLERATE,
+		DEFAULT_AUDIO_BUFFER_SIZE, BENCH_FRAMES);
+	for (fi = 0; fi < (int)(sizeof(bench_formats) / sizeof(bench_formats[0])); fi++)
+		/* as many channels as the objects are built for */
+		for (channels = 1; channels <= DEFAULT_AUDIO_CHANNELS && channels <= BENCH_MAXCHANNELS; channels *= 2)
+			for (vi = 0; vi < (int)(sizeof(bench_vecsizes) / sizeof(bench_vecsizes[0])); vi++)
+			{
+				if (!bench_run(bench_formats[fi], channels, bench_vecsizes[vi], &r))
+					continue;
+				bench_print(f, &first, "nstream~", bench_formats[fi], channels,
+					    bench_vecsizes[vi], r.r_sendns, r.r_frames);
+				bench_print(f, &first, "nsreceive~", bench_formats[fi], channels,
+					    bench_vecsizes[vi], r.r_recvns, r.r_frames);
+				fprintf(stderr, "%-6s %3d ch %4d: nstream~ %.3f, nsreceive~ %.3f ns/sample\n",
+					bench_formats[fi], channels, bench_vecsizes[vi],
+					r.r_sendns / ((double)r.r_frames * channels),
+					r.r_recvns / ((double)r.r_frames * channels));
+			}
+	fprintf(f, "\n  ]\n}\n");
+	if (file)
+		fclose(f);
+	return (0);
+}
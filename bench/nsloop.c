@@ -0,0 +1,602 @@
+/* ------------------------ nsloop -------------------------------------------- */
+/*                                                                              */
+/* End-to-end test of an nstream~ / nsreceive~ pair over localhost through an   */
+/* in-process network emulator: loss, bursts, reordering, delay, rate limits.   */
+/*                                                                              */
+/* This program is free software; you can redistribute it and/or                */
+/* modify it under the terms of the GNU General Public License                  */
+/* as published by the Free Software Foundation; either version 2               */
+/* of the License, or (at your option) any later version.                       */
+/*                                                                              */
+/* See file LICENSE for further informations on licensing terms.                */
+/*                                                                              */
+/* This program is distributed in the hope that it will be useful,              */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of               */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                */
+/* GNU General Public License for more details.                                 */
+/*                                                                              */
+/* ---------------------------------------------------------------------------- */
+
+/* nstream~ sends to a relay socket of the harness instead of nsreceive~.
+   every DSP tick the relay reads what arrived, decides per datagram whether
+   it is lost, duplicated, delayed or held back by the rate limit, and
+   forwards what is due to nsreceive~. time is the DSP clock, not the wall
+   clock, so a run with the same seed gives the same result on any box.
+   channel 0 carries seeded noise; matching the output against it gives the
+   latency from the sender's inlet to the receiver's outlet and the SNR */
+
+#include "m_pd.h"
+#include "pdstub.h"
+#include "nstream~.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define LOOP_RECVPORT 9941              /* nsreceive~ listens here */
+#define LOOP_RELAYPORT 9942             /* nstream~ sends here */
+#define LOOP_SAMPLERATE 44100
+#define LOOP_HISTORY (1 << 18)          /* input samples kept for matching (6 s) */
+#define LOOP_WINDOW 256                 /* output samples matched at a time */
+#define LOOP_MEASURE 1024               /* output samples between two matches */
+#define LOOP_MAXPACKETS 65536           /* datagrams inside the emulator */
+#define LOOP_MAXLAGS 65536              /* latency measurements kept */
+
+#define LOOP_UNIFORM 0
+#define LOOP_NORMAL 1
+#define LOOP_EXPONENTIAL 2
+
+void nstream_tilde_setup(void);
+void nsreceive_tilde_setup(void);
+
+typedef struct _loopconfig
+{
+	double c_seconds;                   /* length of the run */
+	int c_channels;
+	const char *c_format;
+	int c_vecsize;
+	int c_recvvecsize;                  /* nsreceive~'s, 0 = c_vecsize */
+	int c_packet;                       /* nstream~ buffersize, 0 = default */
+	double c_buffer;                    /* nsreceive~ reset <buffer>, 0 = default */
+	double c_latency;                   /* nsreceive~ latency <ms>, 0 = default */
+	double c_loss;                      /* fraction of datagrams lost */
+	double c_burst;                     /* mean length of a loss burst, 1 = independent */
+	double c_reorder;                   /* fraction held back by c_gap */
+	double c_gap;                       /* ms */
+	double c_duplicate;                 /* fraction sent twice */
+	double c_delay;                     /* ms, fixed part */
+	double c_jitter;                    /* ms, spread of the random part */
+	int c_dist;
+	double c_rate;                      /* kbit/s, 0 = unlimited */
+	double c_queue;                     /* ms the rate limited queue holds */
+	unsigned int c_seed;
+} t_loopconfig;
+
+typedef struct _looppacket
+{
+	double p_time;                      /* due, seconds of DSP time */
+	int p_len;
+	char *p_data;
+} t_looppacket;
+
+typedef struct _loopstats
+{
+	int s_datagrams;                    /* from nstream~ */
+	int s_lost;
+	int s_queuedrops;                   /* rate limit queue full */
+	int s_duplicated;
+	int s_reordered;
+	int s_forwarded;
+	double s_underflow;                 /* as nsreceive~ reports them */
+	double s_overflow;
+	long s_outsamples;                  /* since the first sound */
+	long s_concealed;                   /* of those, silence filled in */
+	double s_signal;                    /* energy of the matched output */
+	double s_noise;                     /* energy of its difference to the input */
+	int s_lags[LOOP_MAXLAGS];           /* latency measurements, samples */
+	int s_nlags;
+	int s_unmatched;                    /* windows that matched nowhere */
+} t_loopstats;
+
+static t_loopconfig loop_config =
+{
+	10, 2, "float", 64, 0, 0, 0, 0,
+	0, 1, 0, 10, 0,
+	0, 0, LOOP_UNIFORM, 0, 100,
+	1
+};
+static t_loopstats loop_stats;
+static t_looppacket loop_packets[LOOP_MAXPACKETS];   /* sorted by p_time */
+static int loop_npackets;
+static unsigned long long loop_random = 1;
+static void *loop_receiver;
+
+
+/* ------------------------ the emulator -------------------------------------- */
+
+/* xorshift64*, seeded, so runs repeat */
+static double loop_uniform(void)
+{
+	loop_random ^= loop_random >> 12;
+	loop_random ^= loop_random << 25;
+	loop_random ^= loop_random >> 27;
+	return ((loop_random * 2685821657736338717ULL >> 11) * (1.0 / 9007199254740992.0));
+}
+
+
+static double loop_delay(void)
+{
+	double j = loop_config.c_jitter, u, v;
+
+	if (j <= 0)
+		return (loop_config.c_delay);
+	switch (loop_config.c_dist)
+	{
+	case LOOP_NORMAL:
+		u = loop_uniform();
+		v = loop_uniform();
+		j *= sqrt(-2 * log(u > 0 ? u : 1e-300)) * cos(2 * M_PI * v);
+		break;
+	case LOOP_EXPONENTIAL:
+		u = loop_uniform();
+		j *= -log(u > 0 ? u : 1e-300);
+		break;
+	default:
+		j *= loop_uniform();
+		break;
+	}
+	return (loop_config.c_delay + j > 0 ? loop_config.c_delay + j : 0);
+}
+
+
+static void loop_schedule(double time, const char *data, int len)
+{
+	int i;
+
+	if (loop_npackets == LOOP_MAXPACKETS)
+	{
+		loop_stats.s_queuedrops++;
+		return;
+	}
+	for (i = loop_npackets; i > 0 && loop_packets[i - 1].p_time > time; i--)
+		;
+	memmove(loop_packets + i + 1, loop_packets + i, (loop_npackets - i) * sizeof(t_looppacket));
+	loop_packets[i].p_time = time;
+	loop_packets[i].p_len = len;
+	loop_packets[i].p_data = (char *)malloc(len);
+	memcpy(loop_packets[i].p_data, data, len);
+	loop_npackets++;
+}
+
+/* what happens to one datagram on its way, now in seconds */
+static void loop_impair(double now, const char *data, int len)
+{
+	static int bad;                     /* Gilbert-Elliott: inside a loss burst */
+	static double busy;                 /* the rate limited link is busy until */
+	static double last;                 /* due time of the datagram before */
+	double loss = loop_config.c_loss, burst = loop_config.c_burst, time = now;
+
+	loop_stats.s_datagrams++;
+	if (burst > 1 && loss > 0 && loss < 1)
+	{
+		/* bursts of mean length burst at an overall rate of loss */
+		if (bad)
+			bad = loop_uniform() >= 1 / burst;
+		else
+			bad = loop_uniform() < loss / (burst * (1 - loss));
+		if (bad)
+		{
+			loop_stats.s_lost++;
+			return;
+		}
+	}
+	else if (loop_uniform() < loss)
+	{
+		loop_stats.s_lost++;
+		return;
+	}
+	if (loop_config.c_rate > 0)
+	{
+		double start = busy > now ? busy : now;
+		if ((start - now) * 1000 > loop_config.c_queue)
+		{
+			loop_stats.s_queuedrops++;
+			return;
+		}
+		busy = start + len * 8 / (loop_config.c_rate * 1000);
+		time = busy;
+	}
+	/* jitter keeps the order as on one path, only c_reorder overtakes */
+	time += loop_delay() / 1000;
+	if (time < last)
+		time = last;
+	last = time;
+	if (loop_uniform() < loop_config.c_reorder)
+	{
+		time += loop_config.c_gap / 1000;
+		loop_stats.s_reordered++;
+	}
+	loop_schedule(time, data, len);
+	if (loop_uniform() < loop_config.c_duplicate)
+	{
+		loop_schedule(time, data, len);
+		loop_stats.s_duplicated++;
+	}
+}
+
+
+static void loop_forward(int fd, double now, struct sockaddr_in *to)
+{
+	int i, n;
+
+	for (n = 0; n < loop_npackets && loop_packets[n].p_time <= now; n++)
+	{
+		if (sendto(fd, loop_packets[n].p_data, loop_packets[n].p_len, 0,
+			   (struct sockaddr *)to, sizeof(*to)) >= 0)
+			loop_stats.s_forwarded++;
+		free(loop_packets[n].p_data);
+	}
+	loop_npackets -= n;
+	for (i = 0; i < loop_npackets; i++)
+		loop_packets[i] = loop_packets[i + n];
+}
+
+
+static int loop_relay(void)
+{
+	struct sockaddr_in addr;
+	int fd = socket(AF_INET, SOCK_DGRAM, 0), size = 4 * 1024 * 1024;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(LOOP_RELAYPORT);
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+	if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+	{
+		perror("nsloop: relay socket");
+		exit(1);
+	}
+	fcntl(fd, F_SETFL, O_NONBLOCK);
+	return (fd);
+}
+
+
+/* ------------------------ measuring ----------------------------------------- */
+
+static float loop_history[LOOP_HISTORY];    /* channel 0 as sent, by sample index */
+
+/* squared difference of the last LOOP_WINDOW output samples to the input
+   lag samples earlier, giving up above limit. concealed samples are left out */
+static double loop_match(const float *out, long end, long lag, double limit)
+{
+	double e = 0, d;
+	long i;
+
+	for (i = 0; i < LOOP_WINDOW && e < limit; i++)
+		if (out[i] != 0)
+		{
+			d = out[i] - loop_history[(end - LOOP_WINDOW + i - lag) & (LOOP_HISTORY - 1)];
+			e += d * d;
+		}
+	return (e);
+}
+
+/* the lag at which the output window equals the input, -1 if nowhere.
+   tries the last one first, latency rarely changes */
+static long loop_findlag(const float *out, long end, long last)
+{
+	double energy = 0, limit, e, best;
+	long lag, bestlag = -1, maxlag = end - LOOP_WINDOW;
+	int i, n = 0;
+
+	for (i = 0; i < LOOP_WINDOW; i++)
+		if (out[i] != 0)
+		{
+			energy += out[i] * out[i];
+			n++;
+		}
+	/* too little sound to tell one place from another */
+	if (n < LOOP_WINDOW / 4)
+		return (-1);
+	limit = energy * 1e-2;
+	if (maxlag > LOOP_HISTORY - LOOP_WINDOW)
+		maxlag = LOOP_HISTORY - LOOP_WINDOW;
+	if (last >= 0 && last <= maxlag && loop_match(out, end, last, limit) < limit)
+		return (last);
+	best = limit;
+	for (lag = 0; lag <= maxlag; lag++)
+		if ((e = loop_match(out, end, lag, best)) < best)
+		{
+			best = e;
+			bestlag = lag;
+		}
+	return (bestlag);
+}
+
+
+static void loop_outlet(void *obj, t_symbol *s, int argc, t_atom *argv)
+{
+	if (obj != loop_receiver || argc < 1 || argv[0].a_type != A_FLOAT)
+		return;
+	if (s == gensym("underflow"))
+		loop_stats.s_underflow = argv[0].a_w.w_float;
+	else if (s == gensym("overflow"))
+		loop_stats.s_overflow = argv[0].a_w.w_float;
+}
+
+
+static int loop_cmp(const void *a, const void *b)
+{
+	return (*(const int *)a - *(const int *)b);
+}
+
+
+/* ------------------------ the run ------------------------------------------- */
+
+static void loop_run(void)
+{
+	t_loopconfig *c = &loop_config;
+	t_sample *in[DEFAULT_AUDIO_CHANNELS], *out[DEFAULT_AUDIO_CHANNELS + 1];
+	t_pdstub_chain sendchain, recvchain;
+	struct sockaddr_in to;
+	float window[LOOP_WINDOW];
+	char args[64], *buf = (char *)malloc(65536);
+	void *snd;
+	long samples = (long)(c->c_seconds * LOOP_SAMPLERATE), ts = 0, t = 0, lag = -1;
+	long started = -1, nextmatch = 0;
+	int relay = loop_relay(), i, k, n;
+
+	memset(&to, 0, sizeof(to));
+	to.sin_family = AF_INET;
+	to.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	to.sin_port = htons(LOOP_RECVPORT);
+
+	snprintf(args, sizeof(args), "%d %d", LOOP_RECVPORT, c->c_channels);
+	loop_receiver = pdstub_new("nsreceive~", args);
+	snprintf(args, sizeof(args), "%d", c->c_channels);
+	snd = pdstub_new("nstream~", args);
+	if (!loop_receiver || !snd)
+		exit(1);
+	if (c->c_buffer > 0)
+	{
+		snprintf(args, sizeof(args), "reset %g", c->c_buffer);
+		pdstub_send(loop_receiver, args);
+	}
+	if (c->c_latency > 0)
+	{
+		snprintf(args, sizeof(args), "latency %g", c->c_latency);
+		pdstub_send(loop_receiver, args);
+	}
+	snprintf(args, sizeof(args), "connect localhost %d", LOOP_RELAYPORT);
+	pdstub_send(snd, args);
+	for (i = 0; i < 1000 && pdstub_lastfloat(snd) != 1; i++)
+		pdstub_poll(1);
+	if (pdstub_lastfloat(snd) != 1)
+	{
+		error("nsloop: nstream~ did not connect");
+		exit(1);
+	}
+	snprintf(args, sizeof(args), "format %s", c->c_format);
+	pdstub_send(snd, args);
+	if (c->c_packet > 0)
+	{
+		snprintf(args, sizeof(args), "buffersize %d", c->c_packet);
+		pdstub_send(snd, args);
+	}
+
+	for (k = 0; k < c->c_channels; k++)
+		in[k] = (t_sample *)getbytes(c->c_vecsize * sizeof(t_sample));
+	for (k = 0; k <= c->c_channels; k++)
+		out[k] = (t_sample *)getbytes(c->c_recvvecsize * sizeof(t_sample));
+	sendchain = pdstub_dsp(snd, c->c_channels, in, c->c_vecsize, LOOP_SAMPLERATE);
+	recvchain = pdstub_dsp(loop_receiver, c->c_channels + 1, out, c->c_recvvecsize, LOOP_SAMPLERATE);
+
+	/* the two objects tick at their own vector sizes on one sample clock,
+	   whichever is behind runs next */
+	while (t < samples)
+	{
+		if (ts <= t)
+		{
+			/* noise between 0.1 and 0.6: never 0, so silence stands out */
+			for (i = 0; i < c->c_vecsize; i++)
+			{
+				float v = (float)(0.35 + 0.25 * (2 * loop_uniform() - 1));
+				loop_history[(ts + i) & (LOOP_HISTORY - 1)] = v;
+				for (k = 0; k < c->c_channels; k++)
+					in[k][i] = k ? -v : v;
+			}
+			pdstub_run(&sendchain);
+			while ((n = recv(relay, buf, 65536, 0)) > 0)
+				loop_impair((double)ts / LOOP_SAMPLERATE, buf, n);
+			ts += c->c_vecsize;
+			continue;
+		}
+		loop_forward(relay, (double)t / LOOP_SAMPLERATE, &to);
+		pdstub_poll(0);
+		pdstub_run(&recvchain);
+
+		/* out[1] is the receiver's first outlet */
+		for (i = 0; i < c->c_recvvecsize; i++, t++)
+		{
+			float v = out[1][i];
+			if (started < 0 && v == 0)
+				continue;
+			if (started < 0)
+				started = nextmatch = t;
+			loop_stats.s_outsamples++;
+			if (v == 0)
+				loop_stats.s_concealed++;
+			window[(t - started) % LOOP_WINDOW] = v;
+			if (lag >= 0 && v != 0)
+			{
+				float d = v - loop_history[(t - lag) & (LOOP_HISTORY - 1)];
+				loop_stats.s_signal += v * v;
+				loop_stats.s_noise += d * d;
+			}
+			if (t + 1 - started >= LOOP_WINDOW && t + 1 >= nextmatch + LOOP_WINDOW)
+			{
+				float w[LOOP_WINDOW];
+				int j;
+				for (j = 0; j < LOOP_WINDOW; j++)
+					w[j] = window[(t + 1 - started + j) % LOOP_WINDOW];
+				if ((lag = loop_findlag(w, t + 1, lag)) >= 0)
+				{
+					if (loop_stats.s_nlags < LOOP_MAXLAGS)
+						loop_stats.s_lags[loop_stats.s_nlags++] = (int)lag;
+				}
+				else
+					loop_stats.s_unmatched++;
+				nextmatch = t + 1 + LOOP_MEASURE - LOOP_WINDOW;
+			}
+		}
+	}
+	pdstub_outlet = loop_outlet;
+	pdstub_send(loop_receiver, "bang");
+	pdstub_outlet = NULL;
+	/* what went wrong on the way, counted by the objects */
+	if (pdstub_verbose)
+	{
+		pdstub_send(snd, "log");
+		pdstub_send(loop_receiver, "log");
+	}
+	pdstub_free(snd);
+	pdstub_free(loop_receiver);
+	close(relay);
+	free(buf);
+}
+
+
+static double loop_ms(int samples)
+{
+	return (samples * 1000. / LOOP_SAMPLERATE);
+}
+
+
+static void loop_report(FILE *f)
+{
+	t_loopconfig *c = &loop_config;
+	t_loopstats *s = &loop_stats;
+	double mean = 0, snr;
+	int i, n = s->s_nlags;
+
+	qsort(s->s_lags, n, sizeof(int), loop_cmp);
+	for (i = 0; i < n; i++)
+		mean += s->s_lags[i];
+	mean = n ? mean / n : 0;
+	snr = s->s_noise > 0 ? 10 * log10(s->s_signal / s->s_noise) : 999;
+
+	fprintf(f, "{\n  \"config\": {\"seconds\": %g, \"channels\": %d, \"format\": \"%s\", "
+		"\"vecsize\": %d, \"recv_vecsize\": %d, \"packet\": %d, \"buffer\": %g, "
+		"\"latency_ms\": %g, \"loss\": %g, \"burst\": %g, \"reorder\": %g, "
+		"\"gap_ms\": %g, \"duplicate\": %g, \"delay_ms\": %g, \"jitter_ms\": %g, "
+		"\"distribution\": \"%s\", \"rate_kbps\": %g, \"queue_ms\": %g, \"seed\": %u},\n",
+		c->c_seconds, c->c_channels, c->c_format, c->c_vecsize, c->c_recvvecsize, c->c_packet,
+		c->c_buffer, c->c_latency, c->c_loss,
+		c->c_burst, c->c_reorder, c->c_gap, c->c_duplicate, c->c_delay, c->c_jitter,
+		c->c_dist == LOOP_NORMAL ? "normal" : c->c_dist == LOOP_EXPONENTIAL ? "exponential" : "uniform",
+		c->c_rate, c->c_queue, c->c_seed);
+	fprintf(f, "  \"network\": {\"datagrams\": %d, \"lost\": %d, \"queue_drops\": %d, "
+		"\"duplicated\": %d, \"reordered\": %d, \"forwarded\": %d},\n",
+		s->s_datagrams, s->s_lost, s->s_queuedrops, s->s_duplicated, s->s_reordered, s->s_forwarded);
+	fprintf(f, "  \"latency_ms\": {\"min\": %.3f, \"p50\": %.3f, \"mean\": %.3f, \"p99\": %.3f, "
+		"\"max\": %.3f, \"measurements\": %d, \"unmatched\": %d},\n",
+		n ? loop_ms(s->s_lags[0]) : 0, n ? loop_ms(s->s_lags[n / 2]) : 0, mean * 1000. / LOOP_SAMPLERATE,
+		n ? loop_ms(s->s_lags[(int)(n * 0.99)]) : 0, n ? loop_ms(s->s_lags[n - 1]) : 0, n, s->s_unmatched);
+	fprintf(f, "  \"underflows\": %g,\n  \"overflows\": %g,\n  \"output_samples\": %ld,\n"
+		"  \"concealed_samples\": %ld,\n  \"snr_db\": %.2f\n}\n",
+		s->s_underflow, s->s_overflow, s->s_outsamples, s->s_concealed, snr);
+}
+
+
+static void loop_usage(void)
+{
+	fprintf(stderr,
+		"usage: nsloop [options]\n"
+		"  -t <s>       length of the run (10)\n"
+		"  -c <n>       channels (2)\n"
+		"  -f <format>  float, 16bit or 8bit (float)\n"
+		"  -n <n>       vector size (64), -m <n> nsreceive~'s if different\n"
+		"  -p <n>       samples per packet, nstream~ buffersize (default)\n"
+		"  -q <0..1>    nsreceive~ buffer as for reset (default)\n"
+		"  -L <ms>      nsreceive~ latency instead of -q\n"
+		"  -l <0..1>    loss rate\n"
+		"  -b <n>       mean loss burst length (1, independent losses)\n"
+		"  -r <0..1>    fraction of datagrams held back, -g <ms> by how much (10)\n"
+		"  -u <0..1>    fraction of datagrams duplicated\n"
+		"  -d <ms>      fixed delay\n"
+		"  -j <ms>      random delay on top: -J uniform|normal|exponential\n"
+		"  -R <kbit/s>  rate limit, -Q <ms> of queue in front of it (100)\n"
+		"  -s <n>       seed (1)\n"
+		"  -o <file>    write the JSON there instead of stdout\n"
+		"  -V           show the objects' posts\n");
+	exit(1);
+}
+
+
+int main(int argc, char **argv)
+{
+	t_loopconfig *c = &loop_config;
+	const char *file = NULL;
+	FILE *f = stdout;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "t:c:f:n:m:p:q:L:l:b:r:g:u:d:j:J:R:Q:s:o:V")) != -1)
+	{
+		switch (opt)
+		{
+		case 't': c->c_seconds = atof(optarg); break;
+		case 'c': c->c_channels = atoi(optarg); break;
+		case 'f': c->c_format = optarg; break;
+		case 'n': c->c_vecsize = atoi(optarg); break;
+		case 'm': c->c_recvvecsize = atoi(optarg); break;
+		case 'p': c->c_packet = atoi(optarg); break;
+		case 'q': c->c_buffer = atof(optarg); break;
+		case 'L': c->c_latency = atof(optarg); break;
+		case 'l': c->c_loss = atof(optarg); break;
+		case 'b': c->c_burst = atof(optarg); break;
+		case 'r': c->c_reorder = atof(optarg); break;
+		case 'g': c->c_gap = atof(optarg); break;
+		case 'u': c->c_duplicate = atof(optarg); break;
+		case 'd': c->c_delay = atof(optarg); break;
+		case 'j': c->c_jitter = atof(optarg); break;
+		case 'J':
+			c->c_dist = !strcmp(optarg, "normal") ? LOOP_NORMAL :
+				!strcmp(optarg, "exponential") ? LOOP_EXPONENTIAL : LOOP_UNIFORM;
+			break;
+		case 'R': c->c_rate = atof(optarg); break;
+		case 'Q': c->c_queue = atof(optarg); break;
+		case 's': c->c_seed = (unsigned int)atoi(optarg); break;
+		case 'o': file = optarg; break;
+		case 'V': pdstub_verbose = 1; break;
+		default: loop_usage();
+		}
+	}
+	if (!c->c_recvvecsize)
+		c->c_recvvecsize = c->c_vecsize;
+	if (c->c_channels < 1 || c->c_channels > DEFAULT_AUDIO_CHANNELS || c->c_vecsize < 1 ||
+	    c->c_recvvecsize < 1 || c->c_packet < 0 || c->c_seconds <= 0)
+		loop_usage();
+	loop_random = 0x9e3779b97f4a7c15ULL * (c->c_seed + 1);
+
+	nstream_tilde_setup();
+	nsreceive_tilde_setup();
+	loop_run();
+
+	if (file && !(f = fopen(file, "w")))
+	{
+		perror(file);
+		return (1);
+	}
+	loop_report(f);
+	if (file)
+		fclose(f);
+	return (0);
+}
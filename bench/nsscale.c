@@ -0,0 +1,568 @@
+/* ------------------------ nsscale ------------------------------------------- */
+/*                                                                              */
+/* Runs many nstream~ and nsreceive~ in one process over loopback in real time  */
+/* and reports CPU, packet rates, late DSP ticks and the loss of each stream.   */
+/*                                                                              */
+/* This program is free software; you can redistribute it and/or                */
+/* modify it under the terms of the GNU General Public License                  */
+/* as published by the Free Software Foundation; either version 2               */
+/* of the License, or (at your option) any later version.                       */
+/*                                                                              */
+/* See file LICENSE for further informations on licensing terms.                */
+/*                                                                              */
+/* This program is distributed in the hope that it will be useful,              */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of               */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                */
+/* GNU General Public License for more details.                                 */
+/*                                                                              */
+/* ---------------------------------------------------------------------------- */
+
+/* every configuration creates N senders and M receivers, sender i streams
+   to receiver i % M, and runs them for a while on a DSP tick paced by the
+   wall clock as Pd's scheduler would: performs first, then the poll
+   functions until the next tick is due. a tick that ends after that is
+   late. the counters come from the objects themselves, through a metrics
+   snapshot (see nsmetrics.h) at the start and the end of the measurement */
+
+#include "m_pd.h"
+#include "pdstub.h"
+#include "nstream~.h"
+#include "nsmetrics.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define SCALE_PORT 9951                 /* receiver j listens on SCALE_PORT + j */
+#define SCALE_SAMPLERATE 44100
+#define SCALE_MAXSTREAMS 512            /* senders or receivers of one configuration */
+#define SCALE_MAXSOURCES 16             /* senders per receiver, DEFAULT_MAX_SOURCES in nsreceive~.c */
+#define SCALE_MAXLIST 16                /* values of one option */
+#define SCALE_WARMUP 0.25               /* s between connecting and measuring */
+
+void nstream_tilde_setup(void);
+void nsreceive_tilde_setup(void);
+
+/* the counters of one sender or one source slot of a receiver */
+typedef struct _scalecount
+{
+	int c_source;                       /* 0 nstream~, 1 slot of nsreceive~ */
+	int c_instance;
+	int c_slot;
+	int c_active;                       /* the slot has a sender */
+	double c_packets;
+	double c_lost;                      /* sequence gaps, at the receiver */
+	double c_drops;                     /* not sent, at the sender */
+	double c_underflows;
+} t_scalecount;
+
+typedef struct _scalesnap
+{
+	t_scalecount s_counts[SCALE_MAXSTREAMS * 2];
+	int s_n;
+} t_scalesnap;
+
+typedef struct _scaleresult
+{
+	double r_seconds;
+	double r_cpu;                       /* user and system, all threads */
+	long r_ticks;
+	long r_late;
+	double r_dspns;                     /* in the performs, summed */
+	double r_dspmax;                    /* slowest tick */
+	double r_rcvbuferrors;              /* host wide, -1 unknown */
+	t_scalesnap r_begin;
+	t_scalesnap r_end;
+} t_scaleresult;
+
+static int scale_pairs[SCALE_MAXLIST][2] = { {1, 1}, {16, 16}, {64, 64}, {256, 256}, {16, 1}, {64, 4}, {256, 16} };
+static int scale_npairs = 7;
+static int scale_channels[SCALE_MAXLIST] = { 2, 8 };
+static int scale_nchannels = 2;
+static int scale_vecsizes[SCALE_MAXLIST] = { 64, 256 };
+static int scale_nvecsizes = 2;
+static const char *scale_reactors[SCALE_MAXLIST] = { "0" };
+static int scale_nreactors = 1;
+static const char *scale_format = "16bit";
+static double scale_seconds = 1;
+static char scale_socket[64];
+static t_scaleresult scale_result;
+
+
+static double scale_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec + ts.tv_nsec * 1e-9);
+}
+
+
+static double scale_cpu(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return (ru.ru_utime.tv_sec + ru.ru_utime.tv_usec * 1e-6 +
+		ru.ru_stime.tv_sec + ru.ru_stime.tv_usec * 1e-6);
+}
+
+
+/* ------------------------ counters ------------------------------------------ */
+
+/* datagrams the kernel dropped for full receive buffers, all of the host
+   (Linux), -1 where it can't tell */
+static double scale_rcvbuferrors(void)
+{
+	char names[512], values[512], *n, *v, *sn, *sv;
+	double errors = -1;
+	FILE *f = fopen("/proc/net/snmp", "r");
+
+	if (!f)
+		return (-1);
+	while (fgets(names, sizeof(names), f) && fgets(values, sizeof(values), f))
+	{
+		if (strncmp(names, "Udp: ", 5))
+			continue;
+		for (n = strtok_r(names, " \n", &sn), v = strtok_r(values, " \n", &sv); n && v;
+		     n = strtok_r(NULL, " \n", &sn), v = strtok_r(NULL, " \n", &sv))
+			if (!strcmp(n, "RcvbufErrors"))
+				errors = atof(v);
+		break;
+	}
+	fclose(f);
+	return (errors);
+}
+
+
+/* a value of a JSON line of the metrics, labels are strings */
+static double scale_value(const char *line, const char *key, int *found)
+{
+	char pattern[64];
+	const char *p;
+
+	snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+	if (!(p = strstr(line, pattern)))
+	{
+		if (found)
+			*found = 0;
+		return (0);
+	}
+	if (found)
+		*found = 1;
+	p += strlen(pattern);
+	return (strtod(*p == '"' ? p + 1 : p, NULL));
+}
+
+
+/* the counters of all objects, from the metrics socket */
+static void scale_snapshot(t_scalesnap *s)
+{
+	struct sockaddr_un addr;
+	char *text = NULL, *line, *next;
+	size_t len = 0, size = 0;
+	ssize_t n;
+	int fd, slot;
+
+	s->s_n = 0;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", scale_socket);
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+	    connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+	{
+		perror("nsscale: metrics");
+		exit(1);
+	}
+	do
+	{
+		if (size - len < 65536)
+			text = (char *)realloc(text, size += 262144);
+		if ((n = read(fd, text + len, size - len - 1)) > 0)
+			len += n;
+	} while (n > 0);
+	close(fd);
+	text[len] = 0;
+
+	for (line = text; *line && s->s_n < SCALE_MAXSTREAMS * 2; line = next)
+	{
+		t_scalecount *c = &s->s_counts[s->s_n];
+		if ((next = strchr(line, '\n')))
+			*next++ = 0;
+		else
+			next = line + strlen(line);
+		c->c_instance = (int)scale_value(line, "instance", NULL);
+		c->c_slot = (int)scale_value(line, "slot", &slot);
+		c->c_active = (int)scale_value(line, "active", NULL);
+		c->c_packets = scale_value(line, "packets_total", NULL);
+		c->c_lost = scale_value(line, "lost_total", NULL);
+		c->c_drops = scale_value(line, "drops_total", NULL);
+		c->c_underflows = scale_value(line, "underflows_total", NULL);
+		if (strstr(line, "\"object\":\"nstream\""))
+			c->c_source = 0;
+		else if (slot)
+			c->c_source = 1;
+		else
+			continue;
+		s->s_n++;
+	}
+	free(text);
+}
+
+
+/* what a counter did between the two snapshots */
+static t_scalecount scale_delta(const t_scalesnap *begin, const t_scalecount *c)
+{
+	t_scalecount d = *c;
+	int i;
+
+	for (i = 0; i < begin->s_n; i++)
+	{
+		const t_scalecount *b = &begin->s_counts[i];
+		if (b->c_source == c->c_source && b->c_instance == c->c_instance && b->c_slot == c->c_slot)
+		{
+			d.c_packets -= b->c_packets;
+			d.c_lost -= b->c_lost;
+			d.c_drops -= b->c_drops;
+			d.c_underflows -= b->c_underflows;
+			break;
+		}
+	}
+	return (d);
+}
+
+
+/* ------------------------ the run ------------------------------------------- */
+
+static int scale_run(int senders, int receivers, int channels, int vecsize,
+		     const char *reactor, t_scaleresult *r)
+{
+	static void *snd[SCALE_MAXSTREAMS], *rcv[SCALE_MAXSTREAMS];
+	static t_pdstub_chain sendchain[SCALE_MAXSTREAMS], recvchain[SCALE_MAXSTREAMS];
+	static t_sample *out[SCALE_MAXSTREAMS][DEFAULT_AUDIO_CHANNELS + 1];
+	t_sample *in[DEFAULT_AUDIO_CHANNELS];
+	char args[64];
+	double budget = (double)vecsize / SCALE_SAMPLERATE, due, start, t, cpu;
+	long warmup = (long)(SCALE_WARMUP / budget), ticks = (long)(scale_seconds / budget), b;
+	int i, j, k, connected, ok = 1;
+
+	/* all senders of a receiver summed into one set of outlets */
+	for (j = 0; j < receivers; j++)
+	{
+		snprintf(args, sizeof(args), "%d %d %d 1", SCALE_PORT + j, channels,
+			 (senders + receivers - 1) / receivers);
+		if (!(rcv[j] = pdstub_new("nsreceive~", args)))
+		{
+			while (j--)
+				pdstub_free(rcv[j]);
+			return (0);
+		}
+	}
+	/* the I/O model is one for the process, set it before anybody connects */
+	snprintf(args, sizeof(args), "reactor %s", reactor);
+	if (reactor[strlen(reactor) - 1] == 'u')
+		snprintf(args + strlen(args) - 1, sizeof(args) - strlen(args) + 1, " uring");
+	pdstub_send(rcv[0], args);
+	for (i = 0; i < senders; i++)
+	{
+		snprintf(args, sizeof(args), "%d", channels);
+		snd[i] = pdstub_new("nstream~", args);
+		snprintf(args, sizeof(args), "connect localhost %d", SCALE_PORT + i % receivers);
+		pdstub_send(snd[i], args);
+	}
+	for (k = 0; k < 1000; k++)
+	{
+		for (i = connected = 0; i < senders; i++)
+			connected += pdstub_lastfloat(snd[i]) == 1;
+		if (connected == senders)
+			break;
+		pdstub_poll(1);
+	}
+	if (connected < senders)
+	{
+		error("nsscale: %d of %d nstream~ connected", connected, senders);
+		ok = 0;
+	}
+	snprintf(args, sizeof(args), "format %s", scale_format);
+	for (i = 0; i < senders; i++)
+		pdstub_send(snd[i], args);
+
+	for (k = 0; k < channels; k++)
+	{
+		in[k] = (t_sample *)getbytes(vecsize * sizeof(t_sample));
+		for (i = 0; i < vecsize; i++)
+			in[k][i] = (t_sample)(0.5 * ((i * 7 + k * 13) % 64) / 64. - 0.25);
+	}
+	for (i = 0; i < senders; i++)
+		sendchain[i] = pdstub_dsp(snd[i], channels, in, vecsize, SCALE_SAMPLERATE);
+	for (j = 0; j < receivers; j++)
+	{
+		for (k = 0; k <= channels; k++)
+			out[j][k] = (t_sample *)getbytes(vecsize * sizeof(t_sample));
+		recvchain[j] = pdstub_dsp(rcv[j], channels + 1, out[j], vecsize, SCALE_SAMPLERATE);
+	}
+
+	memset(r, 0, sizeof(*r));
+	cpu = 0;
+	start = due = scale_now();
+	for (b = -warmup; ok && b < ticks; b++)
+	{
+		if (!b)
+		{
+			scale_snapshot(&r->r_begin);
+			r->r_rcvbuferrors = scale_rcvbuferrors();
+			cpu = scale_cpu();
+			start = scale_now();
+		}
+		t = scale_now();
+		for (i = 0; i < senders; i++)
+			pdstub_run(&sendchain[i]);
+		for (j = 0; j < receivers; j++)
+			pdstub_run(&recvchain[j]);
+		t = scale_now() - t;
+		if (b >= 0)
+		{
+			r->r_dspns += t * 1e9;
+			if (t * 1e9 > r->r_dspmax)
+				r->r_dspmax = t * 1e9;
+		}
+		/* the scheduler's idle time goes to the sockets */
+		due += budget;
+		pdstub_poll(0);
+		while ((t = scale_now()) < due)
+			pdstub_poll((due - t) * 1000);
+		/* done with the tick after the next one should have started */
+		if (t > due + budget)
+		{
+			if (b >= 0)
+				r->r_late++;
+			due = t;
+		}
+	}
+	if (ok)
+	{
+		r->r_ticks = ticks;
+		r->r_seconds = scale_now() - start;
+		r->r_cpu = scale_cpu() - cpu;
+		if (r->r_rcvbuferrors >= 0)
+			r->r_rcvbuferrors = scale_rcvbuferrors() - r->r_rcvbuferrors;
+		scale_snapshot(&r->r_end);
+	}
+
+	for (i = 0; i < senders; i++)
+		pdstub_free(snd[i]);
+	for (j = 0; j < receivers; j++)
+	{
+		if (pdstub_verbose)
+			pdstub_send(rcv[j], "print");
+		pdstub_free(rcv[j]);
+		for (k = 0; k <= channels; k++)
+			freebytes(out[j][k], vecsize * sizeof(t_sample));
+	}
+	for (k = 0; k < channels; k++)
+		freebytes(in[k], vecsize * sizeof(t_sample));
+	return (ok);
+}
+
+
+static void scale_print(FILE *f, int *first, int senders, int receivers, int channels,
+			int vecsize, const char *reactor, t_scaleresult *r)
+{
+	double sent = 0, received = 0, drops = 0, underflows = 0, loss, sumloss = 0, maxloss = 0;
+	int i, n = 0, lossy = 0;
+
+	fprintf(f, "%s\n    {\"senders\": %d, \"receivers\": %d, \"channels\": %d, \"vecsize\": %d, "
+		"\"reactor\": \"%s\",\n     \"stream_loss_percent\": [", *first ? "" : ",",
+		senders, receivers, channels, vecsize, reactor);
+	for (i = 0; i < r->r_end.s_n; i++)
+	{
+		t_scalecount d = scale_delta(&r->r_begin, &r->r_end.s_counts[i]);
+		if (!d.c_source)
+		{
+			sent += d.c_packets;
+			drops += d.c_drops;
+			continue;
+		}
+		if (!d.c_active)
+			continue;
+		received += d.c_packets;
+		underflows += d.c_underflows;
+		loss = d.c_packets + d.c_lost > 0 ? 100 * d.c_lost / (d.c_packets + d.c_lost) : 0;
+		sumloss += loss;
+		if (loss > maxloss)
+			maxloss = loss;
+		lossy += loss > 0;
+		fprintf(f, "%s%.3f", n++ ? ", " : "", loss);
+	}
+	/* senders the receivers never heard of lost everything */
+	for (i = n; i < senders; i++)
+	{
+		fprintf(f, "%s%.3f", n++ ? ", " : "", 100.);
+		sumloss += 100;
+		maxloss = 100;
+		lossy++;
+	}
+	fprintf(f, "],\n     \"seconds\": %.3f, \"cpu_percent\": %.1f, \"ticks\": %ld, \"late_ticks\": %ld, "
+		"\"dsp_us_mean\": %.2f, \"dsp_us_max\": %.2f,\n     \"packets_per_s_sent\": %.1f, "
+		"\"packets_per_s_received\": %.1f, \"send_drops\": %.0f, \"underflows\": %.0f, "
+		"\"kernel_drops\": %.0f, \"streams_with_loss\": %d, \"loss_percent_mean\": %.3f, "
+		"\"loss_percent_max\": %.3f}",
+		r->r_seconds, 100 * r->r_cpu / r->r_seconds, r->r_ticks, r->r_late,
+		r->r_dspns / r->r_ticks / 1000, r->r_dspmax / 1000, sent / r->r_seconds,
+		received / r->r_seconds, drops, underflows, r->r_rcvbuferrors, lossy, n ? sumloss / n : 0, maxloss);
+	*first = 0;
+	fprintf(stderr, "%3d -> %3d  %d ch %4d  reactor %-3s  cpu %6.1f%%  late %4ld/%ld  "
+		"%8.0f pkt/s  loss %.2f%% (max %.2f%%, %d of %d streams)\n",
+		senders, receivers, channels, vecsize, reactor, 100 * r->r_cpu / r->r_seconds,
+		r->r_late, r->r_ticks, received / r->r_seconds, n ? sumloss / n : 0, maxloss, lossy, senders);
+}
+
+
+/* ------------------------ options ------------------------------------------- */
+
+/* "1,8,64" */
+static int scale_ints(const char *arg, int *list)
+{
+	int n = 0;
+
+	while (*arg && n < SCALE_MAXLIST)
+	{
+		list[n++] = (int)strtol(arg, (char **)&arg, 10);
+		if (*arg == ',')
+			arg++;
+		else if (*arg)
+			return (0);
+	}
+	return (n);
+}
+
+
+/* "16:16,64:4" */
+static int scale_parsepairs(const char *arg)
+{
+	int n = 0;
+
+	while (*arg && n < SCALE_MAXLIST)
+	{
+		scale_pairs[n][0] = (int)strtol(arg, (char **)&arg, 10);
+		if (*arg++ != ':')
+			return (0);
+		scale_pairs[n][1] = (int)strtol(arg, (char **)&arg, 10);
+		n++;
+		if (*arg == ',')
+			arg++;
+		else if (*arg)
+			return (0);
+	}
+	return (n);
+}
+
+
+static void scale_usage(void)
+{
+	fprintf(stderr,
+		"usage: nsscale [options]\n"
+		"  -p <n:m,...>  senders:receivers (1:1,16:16,64:64,256:256,16:1,64:4,256:16)\n"
+		"  -c <n,...>    channels (2,8)\n"
+		"  -n <n,...>    vector sizes (64,256)\n"
+		"  -r <n,...>    I/O threads as for \"reactor\", 0 = Pd's poll loop,\n"
+		"                a trailing u for io_uring, as in 2u (0)\n"
+		"  -f <format>   float, 16bit or 8bit (16bit)\n"
+		"  -t <s>        measured per configuration (1)\n"
+		"  -o <file>     write the JSON there instead of stdout\n"
+		"  -V            show the objects' posts\n");
+	exit(1);
+}
+
+
+int main(int argc, char **argv)
+{
+	const char *file = NULL;
+	char target[sizeof(scale_socket) + 8];
+	FILE *f = stdout;
+	int first = 1, pi, ci, vi, ri, opt, err;
+
+	while ((opt = getopt(argc, argv, "p:c:n:r:f:t:o:V")) != -1)
+	{
+		switch (opt)
+		{
+		case 'p':
+			if (!(scale_npairs = scale_parsepairs(optarg)))
+				scale_usage();
+			break;
+		case 'c':
+			if (!(scale_nchannels = scale_ints(optarg, scale_channels)))
+				scale_usage();
+			break;
+		case 'n':
+			if (!(scale_nvecsizes = scale_ints(optarg, scale_vecsizes)))
+				scale_usage();
+			break;
+		case 'r':
+			for (scale_nreactors = 0; optarg && scale_nreactors < SCALE_MAXLIST; )
+			{
+				scale_reactors[scale_nreactors++] = optarg;
+				if ((optarg = strchr(optarg, ',')))
+					*optarg++ = 0;
+			}
+			break;
+		case 'f': scale_format = optarg; break;
+		case 't': scale_seconds = atof(optarg); break;
+		case 'o': file = optarg; break;
+		case 'V': pdstub_verbose = 1; break;
+		default: scale_usage();
+		}
+	}
+	if (scale_seconds <= 0)
+		scale_usage();
+	if (file && !(f = fopen(file, "w")))
+	{
+		perror(file);
+		return (1);
+	}
+
+	nstream_tilde_setup();
+	nsreceive_tilde_setup();
+	snprintf(scale_socket, sizeof(scale_socket), "/tmp/nsscale-%d.sock", (int)getpid());
+	snprintf(target, sizeof(target), "%s%s", NSMETRICS_UNIX, scale_socket);
+	if ((err = nsmetrics_start(target, NSMETRICS_JSON, 0)))
+	{
+		fprintf(stderr, "nsscale: metrics socket %s: %s\n", scale_socket, strerror(err));
+		return (1);
+	}
+
+	fprintf(f, "{\n  \"compiler\": \"%s\",\n  \"samplerate\": %d,\n  \"format\": \"%s\",\n"
+		"  \"results\": [", __VERSION__, SCALE_SAMPLERATE, scale_format);
+	for (ri = 0; ri < scale_nreactors; ri++)
+		for (pi = 0; pi < scale_npairs; pi++)
+			for (ci = 0; ci < scale_nchannels; ci++)
+				for (vi = 0; vi < scale_nvecsizes; vi++)
+				{
+					int n = scale_pairs[pi][0], m = scale_pairs[pi][1];
+					int c = scale_channels[ci], v = scale_vecsizes[vi];
+					if (n < 1 || m < 1 || n > SCALE_MAXSTREAMS || m > SCALE_MAXSTREAMS ||
+					    (n + m - 1) / m > SCALE_MAXSOURCES)
+					{
+						fprintf(stderr, "nsscale: skipping %d:%d, at most %d senders per receiver\n",
+							n, m, SCALE_MAXSOURCES);
+						continue;
+					}
+					if (c < 1 || c > DEFAULT_AUDIO_CHANNELS || v < 1 || DEFAULT_AUDIO_BUFFER_SIZE % v)
+					{
+						fprintf(stderr, "nsscale: skipping %d channels, vecsize %d\n", c, v);
+						continue;
+					}
+					if (scale_run(n, m, c, v, scale_reactors[ri], &scale_result))
+						scale_print(f, &first, n, m, c, v, scale_reactors[ri], &scale_result);
+				}
+	fprintf(f, "\n  ]\n}\n");
+	nsmetrics_start(NULL, 0, 0);
+	if (file)
+		fclose(f);
+	return (0);
+}
@@ -0,0 +1,596 @@
+/* ------------------------ pdstub -------------------------------------------- */
+/*                                                                              */
+/* Just enough of a Pd runtime to create nstream~ and nsreceive~, send them     */
+/* messages, and run their DSP and network polling by hand, for "make bench".   */
+/*                                                                              */
+/* This program is free software; you can redistribute it and/or                */
+/* modify it under the terms of the GNU General Public License                  */
+/* as published by the Free Software Foundation; either version 2               */
+/* of the License, or (at your option) any later version.                       */
+/*                                                                              */
+/* See file LICENSE for further informations on licensing terms.                */
+/*                                                                              */
+/* This program is distributed in the hope that it will be useful,              */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of               */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                */
+/* GNU General Public License for more details.                                 */
+/*                                                                              */
+/* ---------------------------------------------------------------------------- */
+
+
+
+#include "m_pd.h"
+#include "pdstub.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <sys/select.h>
+#include <sys/time.h>
+
+#define PDSTUB_CLASSES 8
+#define PDSTUB_METHODS 128
+#define PDSTUB_OBJECTS 1024            /* alive at a time, for pdstub_lastfloat */
+#define PDSTUB_CLOCKS 4096
+#define PDSTUB_POLLS 1024
+
+t_symbol s_signal = { "signal" }, s_float = { "float" }, s_list = { "list" },
+	s_anything = { "anything" }, s_bang = { "bang" }, s_symbol = { "symbol" };
+int pdstub_verbose;
+void (*pdstub_outlet)(void *obj, t_symbol *s, int argc, t_atom *argv);
+
+typedef struct _pdstub_method
+{
+	t_symbol *m_sel;
+	t_method m_fn;
+	t_atomtype m_args[MAXPDARG + 1];
+} t_pdstub_method;
+
+struct _class
+{
+	t_symbol *c_name;
+	t_newmethod c_new;
+	t_method c_free;
+	size_t c_size;
+	t_atomtype c_args[MAXPDARG + 1];
+	t_pdstub_method c_methods[PDSTUB_METHODS];
+	int c_nmethods;
+	t_method c_bang;
+	t_method c_float;
+};
+
+struct _outlet
+{
+	t_object *o_owner;
+};
+
+struct _clock
+{
+	void *c_owner;
+	t_method c_fn;
+	double c_when;
+	int c_set;
+};
+
+typedef struct _pdstub_poll
+{
+	int p_fd;
+	void (*p_fn)(void *ptr, int fd);
+	void *p_ptr;
+} t_pdstub_poll;
+
+/* the last float out of any outlet of an object */
+typedef struct _pdstub_float
+{
+	void *f_owner;
+	float f_value;
+} t_pdstub_float;
+
+static t_class *pdstub_classes[PDSTUB_CLASSES];
+static int pdstub_nclasses;
+static t_clock *pdstub_clocks[PDSTUB_CLOCKS];
+static int pdstub_nclocks;
+static t_pdstub_poll pdstub_polls[PDSTUB_POLLS];
+static int pdstub_npolls;
+static t_pdstub_float pdstub_floats[PDSTUB_OBJECTS];
+static t_perfroutine pdstub_perf;
+static t_int pdstub_vec[PDSTUB_MAXSIGNALS + 8];
+
+
+/* ------------------------ symbols and printing ------------------------------ */
+
+t_symbol *gensym(const char *s)
+{
+	static t_symbol *list;
+	t_symbol *sym;
+
+	for (sym = list; sym; sym = sym->s_next)
+		if (!strcmp(sym->s_name, s))
+			return (sym);
+	if (!strcmp(s, "signal"))
+		return (&s_signal);
+	sym = (t_symbol *)calloc(1, sizeof(t_symbol));
+	sym->s_name = strdup(s);
+	sym->s_next = list;
+	list = sym;
+	return (sym);
+}
+
+void post(const char *fmt, ...)
+{
+	va_list ap;
+
+	if (!pdstub_verbose)
+		return;
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	fputc('\n', stderr);
+}
+
+void error(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	fprintf(stderr, "error: ");
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	fputc('\n', stderr);
+}
+
+void pd_error(void *object, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	fprintf(stderr, "error: ");
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	fputc('\n', stderr);
+}
+
+
+/* ------------------------ classes and objects ------------------------------- */
+
+static void pdstub_argtypes(t_atomtype *args, t_atomtype first, va_list ap)
+{
+	t_atomtype a = first;
+	int i = 0;
+
+	while (a != A_NULL && i < MAXPDARG)
+	{
+		args[i++] = a;
+		a = (t_atomtype)va_arg(ap, int);
+	}
+	args[i] = A_NULL;
+}
+
+t_class *class_new(t_symbol *name, t_newmethod newmethod, t_method freemethod,
+		   size_t size, int flags, t_atomtype arg1, ...)
+{
+	t_class *c = (t_class *)calloc(1, sizeof(t_class));
+	va_list ap;
+
+	c->c_name = name;
+	c->c_new = newmethod;
+	c->c_free = freemethod;
+	c->c_size = size;
+	va_start(ap, arg1);
+	pdstub_argtypes(c->c_args, arg1, ap);
+	va_end(ap);
+	if (pdstub_nclasses < PDSTUB_CLASSES)
+		pdstub_classes[pdstub_nclasses++] = c;
+	return (c);
+}
+
+void class_addmethod(t_class *c, t_method fn, t_symbol *sel, t_atomtype arg1, ...)
+{
+	t_pdstub_method *m;
+	va_list ap;
+
+	if (c->c_nmethods == PDSTUB_METHODS)
+		return;
+	m = &c->c_methods[c->c_nmethods++];
+	m->m_sel = sel;
+	m->m_fn = fn;
+	va_start(ap, arg1);
+	pdstub_argtypes(m->m_args, arg1, ap);
+	va_end(ap);
+}
+
+#undef class_addbang
+#undef class_addfloat
+
+void class_addbang(t_class *c, t_method fn)
+{
+	c->c_bang = fn;
+}
+
+void class_addfloat(t_class *c, t_method fn)
+{
+	c->c_float = fn;
+}
+
+void class_sethelpsymbol(t_class *c, t_symbol *s)
+{
+}
+
+void nullfn(void)
+{
+}
+
+t_pd *pd_new(t_class *cls)
+{
+	t_object *x = (t_object *)calloc(1, cls->c_size);
+
+	x->ob_pd = cls;
+	return (&x->ob_pd);
+}
+
+t_outlet *outlet_new(t_object *owner, t_symbol *s)
+{
+	t_outlet *o = (t_outlet *)calloc(1, sizeof(t_outlet));
+
+	o->o_owner = owner;
+	return (o);
+}
+
+t_inlet *inlet_new(t_object *owner, t_pd *dest, t_symbol *s1, t_symbol *s2)
+{
+	return ((t_inlet *)calloc(1, sizeof(void *)));
+}
+
+void outlet_float(t_outlet *x, t_float f)
+{
+	t_atom a;
+	int i;
+
+	if (pdstub_outlet)
+	{
+		SETFLOAT(&a, f);
+		pdstub_outlet(x->o_owner, &s_float, 1, &a);
+	}
+	for (i = 0; i < PDSTUB_OBJECTS && pdstub_floats[i].f_owner != x->o_owner; i++)
+		;
+	if (i == PDSTUB_OBJECTS)
+		for (i = 0; i < PDSTUB_OBJECTS && pdstub_floats[i].f_owner; i++)
+			;
+	if (i < PDSTUB_OBJECTS)
+	{
+		pdstub_floats[i].f_owner = x->o_owner;
+		pdstub_floats[i].f_value = f;
+	}
+}
+
+void outlet_anything(t_outlet *x, t_symbol *s, int argc, t_atom *argv)
+{
+	if (pdstub_outlet)
+		pdstub_outlet(x->o_owner, s, argc, argv);
+}
+
+void outlet_list(t_outlet *x, t_symbol *s, int argc, t_atom *argv)
+{
+	if (pdstub_outlet)
+		pdstub_outlet(x->o_owner, &s_list, argc, argv);
+}
+
+float pdstub_lastfloat(void *obj)
+{
+	int i;
+
+	for (i = 0; i < PDSTUB_OBJECTS; i++)
+		if (pdstub_floats[i].f_owner == obj)
+			return (pdstub_floats[i].f_value);
+	return (0);
+}
+
+
+/* ------------------------ clocks, memory, dsp ------------------------------- */
+
+static double pdstub_now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (tv.tv_sec * 1000. + tv.tv_usec / 1000.);
+}
+
+t_clock *clock_new(void *owner, t_method fn)
+{
+	t_clock *c = (t_clock *)calloc(1, sizeof(t_clock));
+
+	c->c_owner = owner;
+	c->c_fn = fn;
+	if (pdstub_nclocks < PDSTUB_CLOCKS)
+		pdstub_clocks[pdstub_nclocks++] = c;
+	return (c);
+}
+
+void clock_delay(t_clock *x, double delaytime)
+{
+	x->c_when = pdstub_now() + delaytime;
+	x->c_set = 1;
+}
+
+void clock_unset(t_clock *x)
+{
+	x->c_set = 0;
+}
+
+void clock_free(t_clock *x)
+{
+	int i;
+
+	for (i = 0; i < pdstub_nclocks; i++)
+		if (pdstub_clocks[i] == x)
+		{
+			pdstub_clocks[i] = pdstub_clocks[--pdstub_nclocks];
+			break;
+		}
+	free(x);
+}
+
+double clock_getlogicaltime(void)
+{
+	return (pdstub_now());
+}
+
+void *getbytes(size_t nbytes)
+{
+	return (calloc(1, nbytes ? nbytes : 1));
+}
+
+void *t_getbytes(size_t nbytes)
+{
+	return (getbytes(nbytes));
+}
+
+void *resizebytes(void *x, size_t oldsize, size_t newsize)
+{
+	char *p = (char *)realloc(x, newsize ? newsize : 1);
+
+	if (p && newsize > oldsize)
+		memset(p + oldsize, 0, newsize - oldsize);
+	return (p);
+}
+
+void freebytes(void *x, size_t nbytes)
+{
+	free(x);
+}
+
+void t_freebytes(void *x, size_t nbytes)
+{
+	free(x);
+}
+
+void dsp_addv(t_perfroutine f, int n, t_int *vec)
+{
+	pdstub_perf = f;
+	memcpy(pdstub_vec + 1, vec, n * sizeof(t_int));
+}
+
+void dsp_add(t_perfroutine f, int n, ...)
+{
+	va_list ap;
+	int i;
+
+	va_start(ap, n);
+	for (i = 0; i < n; i++)
+		pdstub_vec[i + 1] = va_arg(ap, t_int);
+	va_end(ap);
+	pdstub_perf = f;
+}
+
+t_float atom_getfloat(const t_atom *a)
+{
+	return (a->a_type == A_FLOAT ? a->a_w.w_float : 0);
+}
+
+t_symbol *atom_getsymbol(const t_atom *a)
+{
+	return (a->a_type == A_SYMBOL ? a->a_w.w_symbol : gensym(""));
+}
+
+t_float atom_getfloatarg(int which, int argc, const t_atom *argv)
+{
+	return (which < argc ? atom_getfloat(argv + which) : 0);
+}
+
+t_symbol *atom_getsymbolarg(int which, int argc, const t_atom *argv)
+{
+	return (which < argc ? atom_getsymbol(argv + which) : gensym(""));
+}
+
+/* s_stuff.h in Pd, declared by nsreceive~.c itself */
+void sys_addpollfn(int fd, void *fn, void *ptr)
+{
+	if (pdstub_npolls == PDSTUB_POLLS)
+		return;
+	pdstub_polls[pdstub_npolls].p_fd = fd;
+	pdstub_polls[pdstub_npolls].p_fn = (void (*)(void *, int))fn;
+	pdstub_polls[pdstub_npolls].p_ptr = ptr;
+	pdstub_npolls++;
+}
+
+void sys_rmpollfn(int fd)
+{
+	int i;
+
+	for (i = 0; i < pdstub_npolls; i++)
+		if (pdstub_polls[i].p_fd == fd)
+		{
+			pdstub_polls[i] = pdstub_polls[--pdstub_npolls];
+			return;
+		}
+}
+
+
+/* ------------------------ driving objects ----------------------------------- */
+
+/* methods are called the way Pd's pd_typedmess does: pointer arguments
+   first, then the floats, all of them passed whether used or not */
+typedef void *(*t_pdstub_fn)(t_int p1, t_int p2, t_int p3, t_int p4, t_int p5, t_int p6,
+			     t_floatarg f1, t_floatarg f2, t_floatarg f3, t_floatarg f4, t_floatarg f5);
+
+static void *pdstub_call(t_method fn, void *obj, t_atomtype *types, int argc, t_atom *argv)
+{
+	t_int p[6] = { 0, 0, 0, 0, 0, 0 };
+	t_floatarg f[MAXPDARG] = { 0, 0, 0, 0, 0 };
+	int np = 0, nf = 0, i;
+
+	if (obj)
+		p[np++] = (t_int)obj;
+	if (types[0] == A_GIMME)
+	{
+		p[np++] = (t_int)&s_list;
+		p[np++] = argc;
+		p[np++] = (t_int)argv;
+	}
+	else for (i = 0; types[i] != A_NULL; i++)
+	{
+		if (types[i] == A_FLOAT || types[i] == A_DEFFLOAT)
+			f[nf++] = i < argc ? atom_getfloat(argv + i) : 0;
+		else if (types[i] == A_SYMBOL || types[i] == A_DEFSYM)
+			p[np++] = (t_int)(i < argc ? atom_getsymbol(argv + i) : gensym(""));
+	}
+	return (((t_pdstub_fn)fn)(p[0], p[1], p[2], p[3], p[4], p[5], f[0], f[1], f[2], f[3], f[4]));
+}
+
+static int pdstub_parse(const char *s, t_atom *av, int max)
+{
+	char buf[1024], *tok, *end;
+	int n = 0;
+
+	snprintf(buf, sizeof(buf), "%s", s ? s : "");
+	for (tok = strtok(buf, " "); tok && n < max; tok = strtok(NULL, " "), n++)
+	{
+		double v = strtod(tok, &end);
+		if (end != tok && !*end)
+			SETFLOAT(av + n, v);
+		else
+			SETSYMBOL(av + n, gensym(tok));
+	}
+	return (n);
+}
+
+void *pdstub_new(const char *name, const char *args)
+{
+	t_atom av[16];
+	int ac = pdstub_parse(args, av, 16), i;
+
+	for (i = 0; i < pdstub_nclasses; i++)
+		if (!strcmp(pdstub_classes[i]->c_name->s_name, name))
+			return (pdstub_call((t_method)pdstub_classes[i]->c_new, NULL,
+					    pdstub_classes[i]->c_args, ac, av));
+	error("pdstub: no class %s", name);
+	return (NULL);
+}
+
+void pdstub_free(void *obj)
+{
+	t_class *c = *(t_class **)obj;
+	int i;
+
+	if (c->c_free)
+		((void (*)(void *))c->c_free)(obj);
+	for (i = 0; i < PDSTUB_OBJECTS; i++)
+		if (pdstub_floats[i].f_owner == obj)
+			pdstub_floats[i].f_owner = NULL;
+	free(obj);
+}
+
+void pdstub_send(void *obj, const char *msg)
+{
+	t_class *c = *(t_class **)obj;
+	t_atom av[16];
+	int ac = pdstub_parse(msg, av, 16), i;
+
+	if (!ac)
+		return;
+	if (av[0].a_type == A_FLOAT && c->c_float)
+		((void (*)(void *, t_floatarg))c->c_float)(obj, av[0].a_w.w_float);
+	else if (av[0].a_w.w_symbol == &s_bang || av[0].a_w.w_symbol == gensym("bang"))
+	{
+		if (c->c_bang)
+			((void (*)(void *))c->c_bang)(obj);
+	}
+	else
+	{
+		for (i = 0; i < c->c_nmethods; i++)
+			if (c->c_methods[i].m_sel == av[0].a_w.w_symbol)
+			{
+				pdstub_call(c->c_methods[i].m_fn, obj, c->c_methods[i].m_args, ac - 1, av + 1);
+				return;
+			}
+		error("%s: no method for '%s'", c->c_name->s_name, av[0].a_w.w_symbol->s_name);
+	}
+}
+
+t_pdstub_chain pdstub_dsp(void *obj, int nsig, t_sample **vecs, int n, t_float sr)
+{
+	t_signal sig[PDSTUB_MAXSIGNALS], *sp[PDSTUB_MAXSIGNALS];
+	t_class *c = *(t_class **)obj;
+	t_pdstub_chain chain;
+	int i;
+
+	for (i = 0; i < nsig && i < PDSTUB_MAXSIGNALS; i++)
+	{
+		sig[i].s_n = n;
+		sig[i].s_vec = vecs[i];
+		sig[i].s_sr = sr;
+		sp[i] = &sig[i];
+	}
+	pdstub_perf = NULL;
+	for (i = 0; i < c->c_nmethods; i++)
+		if (c->c_methods[i].m_sel == gensym("dsp"))
+			((void (*)(void *, t_signal **))c->c_methods[i].m_fn)(obj, sp);
+	chain.c_perf = pdstub_perf;
+	memcpy(chain.c_vec, pdstub_vec, sizeof(chain.c_vec));
+	chain.c_vec[0] = (t_int)pdstub_perf;
+	return (chain);
+}
+
+void pdstub_run(t_pdstub_chain *c)
+{
+	if (c->c_perf)
+		c->c_perf(c->c_vec);
+}
+
+void pdstub_poll(double ms)
+{
+	struct timeval tv;
+	fd_set rs;
+	double now;
+	int i, maxfd = -1;
+
+	tv.tv_sec = 0;
+	tv.tv_usec = (long)(ms * 1000);
+	FD_ZERO(&rs);
+	for (i = 0; i < pdstub_npolls; i++)
+	{
+		FD_SET(pdstub_polls[i].p_fd, &rs);
+		if (pdstub_polls[i].p_fd > maxfd)
+			maxfd = pdstub_polls[i].p_fd;
+	}
+	if (select(maxfd + 1, &rs, NULL, NULL, &tv) > 0)
+	{
+		/* a poll function may remove itself */
+		t_pdstub_poll polls[PDSTUB_POLLS];
+		int n = pdstub_npolls;
+
+		memcpy(polls, pdstub_polls, n * sizeof(t_pdstub_poll));
+		for (i = 0; i < n; i++)
+			if (FD_ISSET(polls[i].p_fd, &rs))
+				polls[i].p_fn(polls[i].p_ptr, polls[i].p_fd);
+	}
+	now = pdstub_now();
+	for (i = 0; i < pdstub_nclocks; i++)
+		if (pdstub_clocks[i]->c_set && pdstub_clocks[i]->c_when <= now)
+		{
+			pdstub_clocks[i]->c_set = 0;
+			((void (*)(void *))pdstub_clocks[i]->c_fn)(pdstub_clocks[i]->c_owner);
+		}
+}
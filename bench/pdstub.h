@@ -0,0 +1,60 @@
+/* ------------------------ pdstub -------------------------------------------- */
+/*                                                                              */
+/* Just enough of a Pd runtime to create nstream~ and nsreceive~, send them     */
+/* messages, and run their DSP and network polling by hand, for "make bench".   */
+/*                                                                              */
+/* This program is free software; you can redistribute it and/or                */
+/* modify it under the terms of the GNU General Public License                  */
+/* as published by the Free Software Foundation; either version 2               */
+/* of the License, or (at your option) any later version.                       */
+/*                                                                              */
+/* See file LICENSE for further informations on licensing terms.                */
+/*                                                                              */
+/* This program is distributed in the hope that it will be useful,              */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of               */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                */
+/* GNU General Public License for more details.                                 */
+/*                                                                              */
+/* ---------------------------------------------------------------------------- */
+
+
+
+#ifndef PDSTUB_H
+#define PDSTUB_H
+
+#include "m_pd.h"
+
+#define PDSTUB_MAXSIGNALS 256           /* inlets and outlets of one dsp call */
+
+/* the perform routine and arguments one object added in its dsp method */
+typedef struct _pdstub_chain
+{
+	t_perfroutine c_perf;
+	t_int c_vec[PDSTUB_MAXSIGNALS + 8];
+} t_pdstub_chain;
+
+/* posts are dropped unless set */
+extern int pdstub_verbose;
+
+/* the last float an object sent out of an outlet */
+float pdstub_lastfloat(void *obj);
+
+/* when set, sees every message out of any outlet, floats as "float" */
+extern void (*pdstub_outlet)(void *obj, t_symbol *s, int argc, t_atom *argv);
+
+/* create an object of a class set up before, args as in a Pd box */
+void *pdstub_new(const char *name, const char *args);
+void pdstub_free(void *obj);
+
+/* send a message like "connect localhost 8000" */
+void pdstub_send(void *obj, const char *msg);
+
+/* call the dsp method with nsig vectors of n samples, inlets first */
+t_pdstub_chain pdstub_dsp(void *obj, int nsig, t_sample **vecs, int n, t_float sr);
+void pdstub_run(t_pdstub_chain *c);
+
+/* wait up to ms for the sockets of sys_addpollfn, call their functions,
+   then the clocks that are due */
+void pdstub_poll(double ms);
+
+#endif /* PDSTUB_H */
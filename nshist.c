@@ -0,0 +1,113 @@
+/* ------------------------ nshist -------------------------------------------- */
+/*                                                                              */
+/* Log-linear histograms in the manner of HdrHistogram: constant relative       */
+/* precision over a wide range, fixed memory, O(1) recording.                   */
+/*                                                                              */
+/* This program is free software; you can redistribute it and/or                */
+/* modify it under the terms of the GNU General Public License                  */
+/* as published by the Free Software Foundation; either version 2               */
+/* of the License, or (at your option) any later version.                       */
+/*                                                                              */
+/* See file LICENSE for further informations on licensing terms.                */
+/*                                                                              */
+/* This program is distributed in the hope that it will be useful,              */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of               */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                */
+/* GNU General Public License for more details.                                 */
+/*                                                                              */
+/* ---------------------------------------------------------------------------- */
+
+
+#include "nshist.h"
+
+#include <string.h>
+
+#define NSHIST_SUB (1 << NSHIST_SUBBITS)
+
+
+/* values below 2 * NSHIST_SUB have a bucket each, above that every power
+   of two is split into NSHIST_SUB buckets */
+static int nshist_index(unsigned long long v)
+{
+	int bit;
+
+	if (v < 2 * NSHIST_SUB)
+		return ((int)v);
+	bit = 63 - __builtin_clzll(v);
+	if (bit >= NSHIST_MAXBITS)
+		return (NSHIST_BUCKETS - 1);
+	return (((bit - NSHIST_SUBBITS + 1) << NSHIST_SUBBITS) + (int)((v >> (bit - NSHIST_SUBBITS)) & (NSHIST_SUB - 1)));
+}
+
+
+static unsigned long long nshist_lowest(int i)
+{
+	int shift;
+
+	if (i < 2 * NSHIST_SUB)
+		return (i);
+	shift = (i >> NSHIST_SUBBITS) - 1;
+	return ((unsigned long long)(NSHIST_SUB + (i & (NSHIST_SUB - 1))) << shift);
+}
+
+
+static unsigned long long nshist_highest(int i)
+{
+	return (i == NSHIST_BUCKETS - 1 ? ~0ULL : nshist_lowest(i + 1) - 1);
+}
+
+
+void nshist_clear(t_nshist *h)
+{
+	memset(h, 0, sizeof(*h));
+}
+
+
+void nshist_add(t_nshist *h, unsigned long long v)
+{
+	h->h_counts[nshist_index(v)]++;
+	h->h_total++;
+	h->h_sum += v;
+	if (v > h->h_max)
+		h->h_max = v;
+}
+
+
+double nshist_mean(const t_nshist *h)
+{
+	return (h->h_total ? (double)h->h_sum / h->h_total : 0);
+}
+
+
+unsigned long long nshist_percentile(const t_nshist *h, double pct)
+{
+	unsigned long long want, seen = 0;
+	int i;
+
+	if (!h->h_total)
+		return (0);
+	want = (unsigned long long)(pct / 100. * h->h_total + 0.5);
+	if (want < 1)
+		want = 1;
+	for (i = 0; i < NSHIST_BUCKETS; i++)
+		if ((seen += h->h_counts[i]) >= want)
+			break;
+	if (i == NSHIST_BUCKETS || nshist_highest(i) > h->h_max)
+		return (h->h_max);
+	return (nshist_highest(i));
+}
+
+
+int nshist_next(const t_nshist *h, int i, unsigned long long *lo, unsigned long long *hi,
+		unsigned int *count)
+{
+	for (; i < NSHIST_BUCKETS; i++)
+		if (h->h_counts[i])
+		{
+			*lo = nshist_lowest(i);
+			*hi = nshist_highest(i);
+			*count = h->h_counts[i];
+			return (i + 1);
+		}
+	return (-1);
+}
@@ -0,0 +1,66 @@
+/* ------------------------ nshist -------------------------------------------- */
+/*                                                                              */
+/* Log-linear histograms in the manner of HdrHistogram: constant relative       */
+/* precision over a wide range, fixed memory, O(1) recording.                   */
+/*                                                                              */
+/* This program is free software; you can redistribute it and/or                */
+/* modify it under the terms of the GNU General Public License                  */
+/* as published by the Free Software Foundation; either version 2               */
+/* of the License, or (at your option) any later version.                       */
+/*                                                                              */
+/* See file LICENSE for further informations on licensing terms.                */
+/*                                                                              */
+/* This program is distributed in the hope that it will be useful,              */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of               */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                */
+/* GNU General Public License for more details.                                 */
+/*                                                                              */
+/* ---------------------------------------------------------------------------- */
+
+
+#ifndef NSHIST_H
+#define NSHIST_H
+
+#define NSHIST_SUBBITS 5                /* 32 buckets per power of two, about 3% wide */
+#define NSHIST_MAXBITS 36               /* values up to 2^36 (69 s in ns) */
+#define NSHIST_BUCKETS ((NSHIST_MAXBITS - NSHIST_SUBBITS + 1) << NSHIST_SUBBITS)
+
+typedef struct _nshist
+{
+	unsigned int h_counts[NSHIST_BUCKETS];
+	unsigned long long h_total;
+	unsigned long long h_sum;
+	unsigned long long h_max;
+} t_nshist;
+
+void nshist_clear(t_nshist *h);
+
+/* count v, values beyond the range go to the last bucket */
+void nshist_add(t_nshist *h, unsigned long long v);
+
+double nshist_mean(const t_nshist *h);
+
+/* the highest value equivalent to the one below which pct percent of
+   the counts lie, 0 when empty */
+unsigned long long nshist_percentile(const t_nshist *h, double pct);
+
+/* walk the non-empty buckets: start with i = 0, each call fills in the
+   value range [lo, hi] and count of the next one and returns the index to
+   pass next time, -1 when done */
+int nshist_next(const t_nshist *h, int i, unsigned long long *lo, unsigned long long *hi,
+		unsigned int *count);
+
+
+/* timing of hot paths, compiled in with -DNSTREAM_PERF ("make PERF=1").
+   NSPERF_START(t) takes a timestamp, NSPERF_STOP(h, t) adds the ns since
+   then to histogram h. both vanish otherwise */
+#ifdef NSTREAM_PERF
+#include "nsreactor.h"
+#define NSPERF_START(t)     unsigned long long t = nsreactor_now()
+#define NSPERF_STOP(h, t)   nshist_add(&(h), nsreactor_now() - (t))
+#else
+#define NSPERF_START(t)
+#define NSPERF_STOP(h, t)
+#endif
+
+#endif /* NSHIST_H */
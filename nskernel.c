@@ -0,0 +1,186 @@
+/* ------------------------ nskernel ------------------------------------------ */
+/*                                                                              */
+/* Interleaving and sample format conversion of nstream~ and nsreceive~,        */
+/* unrolled for the common channel counts and picked once per format change.    */
+/*                                                                              */
+/* This program is free software; you can redistribute it and/or                */
+/* modify it under the terms of the GNU General Public License                  */
+/* as published by the Free Software Foundation; either version 2               */
+/* of the License, or (at your option) any later version.                       */
+/*                                                                              */
+/* See file LICENSE for further informations on licensing terms.                */
+/*                                                                              */
+/* This program is distributed in the hope that it will be useful,              */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of               */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                */
+/* GNU General Public License for more details.                                 */
+/*                                                                              */
+/* ---------------------------------------------------------------------------- */
+
+
+#ifdef PD
+#include "m_pd.h"
+#else
+#include "ext.h"
+#include "z_dsp.h"
+#include "m_fixed.h"
+#endif
+
+#include "nstream~.h"
+#include "nskernel.h"
+
+#include <math.h>
+#include <string.h>
+
+/* one sample, the same conversions the perform routines always did */
+#ifdef FIXEDPOINT
+#define NSKERNEL_TO16(s) ((short)SCALE16(s))
+#define NSKERNEL_TO8(s) ((unsigned char)SCALE8((t_sample)(1. + (s))))
+#define NSKERNEL_FROM16(v) ((t_sample)INVSCALE16(v))
+#define NSKERNEL_FROM8(v) ((t_sample)INVSCALE8(v) - 1.)
+#else
+#define NSKERNEL_TO16(s) ((short)lrint(32767.0 * (s)))
+#define NSKERNEL_TO8(s) ((unsigned char)(128. * (1.0 + (s))))
+#define NSKERNEL_FROM16(v) ((t_sample)((v) * 3.051850e-05))
+#define NSKERNEL_FROM8(v) ((t_sample)((0.0078125 * (v)) - 1.0))
+#endif
+#define NSKERNEL_COPY(v) (v)
+#define NSKERNEL_SWAP(v) nstream_float(v)
+
+/* with CH a constant the channel loop unrolls and the interleave can be
+   vectorized; the generic kernels pass the channels argument instead */
+#define NSKERNEL_ENCODE(name, type, convert, CH) \
+static void name(void *buf, t_sample **in, int channels, int n) \
+{ \
+	type *b = (type *)buf; \
+	int i, k; \
+ \
+	for (k = 0; k < n; k++, b += (CH)) \
+		for (i = 0; i < (CH); i++) \
+			b[i] = convert(in[i][k]); \
+}
+
+#define NSKERNEL_DECODE(name, type, convert, CH) \
+static void name(const void *buf, t_sample **out, int channels, int n) \
+{ \
+	const type *b = (const type *)buf; \
+	int i, k; \
+ \
+	for (k = 0; k < n; k++, b += (CH)) \
+		for (i = 0; i < (CH); i++) \
+			out[i][k] = convert(b[i]); \
+}
+
+/* the kernels of one format, FMT_n for any channel count */
+#define NSKERNEL_FORMAT(fmt, type, to, from) \
+	NSKERNEL_ENCODE(nskernel_encode_##fmt##_n, type, to, channels) \
+	NSKERNEL_ENCODE(nskernel_encode_##fmt##_1, type, to, 1) \
+	NSKERNEL_ENCODE(nskernel_encode_##fmt##_2, type, to, 2) \
+	NSKERNEL_ENCODE(nskernel_encode_##fmt##_4, type, to, 4) \
+	NSKERNEL_ENCODE(nskernel_encode_##fmt##_8, type, to, 8) \
+	NSKERNEL_DECODE(nskernel_decode_##fmt##_n, type, from, channels) \
+	NSKERNEL_DECODE(nskernel_decode_##fmt##_1, type, from, 1) \
+	NSKERNEL_DECODE(nskernel_decode_##fmt##_2, type, from, 2) \
+	NSKERNEL_DECODE(nskernel_decode_##fmt##_4, type, from, 4) \
+	NSKERNEL_DECODE(nskernel_decode_##fmt##_8, type, from, 8)
+
+#define NSKERNEL_PICK(kind, fmt, channels) \
+	((channels) == 1 ? kind##_##fmt##_1 : (channels) == 2 ? kind##_##fmt##_2 : \
+	 (channels) == 4 ? kind##_##fmt##_4 : (channels) == 8 ? kind##_##fmt##_8 : kind##_##fmt##_n)
+
+NSKERNEL_FORMAT(float, t_sample, NSKERNEL_COPY, NSKERNEL_COPY)
+NSKERNEL_FORMAT(16bit, short, NSKERNEL_TO16, NSKERNEL_FROM16)
+NSKERNEL_FORMAT(8bit, unsigned char, NSKERNEL_TO8, NSKERNEL_FROM8)
+/* from the other byte order, rare enough for the loop */
+NSKERNEL_DECODE(nskernel_decode_swapped_n, t_sample, NSKERNEL_SWAP, channels)
+
+
+t_nsencode nskernel_encode(int format, int channels)
+{
+	switch (format)
+	{
+	case SF_FLOAT:
+		return (NSKERNEL_PICK(nskernel_encode, float, channels));
+	case SF_16BIT:
+		return (NSKERNEL_PICK(nskernel_encode, 16bit, channels));
+	case SF_8BIT:
+		return (NSKERNEL_PICK(nskernel_encode, 8bit, channels));
+	}
+	return (0);
+}
+
+
+t_nsdecode nskernel_decode(int format, int swapped, int channels)
+{
+	switch (format)
+	{
+	case SF_FLOAT:
+		if (swapped)
+			return (nskernel_decode_swapped_n);
+		return (NSKERNEL_PICK(nskernel_decode, float, channels));
+	case SF_16BIT:
+		return (NSKERNEL_PICK(nskernel_decode, 16bit, channels));
+	case SF_8BIT:
+		return (NSKERNEL_PICK(nskernel_decode, 8bit, channels));
+	}
+	return (0);
+}
+
+
+/* on the bits: without the sign, floats compare like integers, which
+   vectorizes where a floating point maximum would need -ffast-math */
+t_sample nskernel_peak(const t_sample *in, int n)
+{
+#if defined(FIXEDPOINT) || (defined(PD_FLOATSIZE) && PD_FLOATSIZE == 64)
+	t_sample m = 0;
+	int k;
+
+	for (k = 0; k < n; k++)
+		if ((in[k] < 0 ? -in[k] : in[k]) > m)
+			m = in[k] < 0 ? -in[k] : in[k];
+	return (m);
+#else
+	unsigned int m = 0, v;
+	t_sample peak;
+	int k;
+
+	for (k = 0; k < n; k++)
+	{
+		memcpy(&v, in + k, sizeof(v));
+		v &= 0x7fffffff;
+		m = v > m ? v : m;
+	}
+	memcpy(&peak, &m, sizeof(peak));
+	return (peak);
+#endif
+}
+
+
+#define NSKERNEL_COMPACT(type) \
+	{ \
+		type *to = (type *)buf; \
+		const type *from = (const type *)buf; \
+		for (k = 0; k < n; k++, from += channels, to += kept) \
+			for (i = 0; i < kept; i++) \
+				to[i] = from[keep[i]]; \
+	}
+
+int nskernel_compact(void *buf, int size, int channels, unsigned int mask, int n)
+{
+	int keep[DEFAULT_AUDIO_CHANNELS];
+	int i, k, kept = 0;
+
+	for (i = 0; i < channels; i++)
+		if (mask & (1u << i))
+			keep[kept++] = i;
+	if (kept == channels)
+		return (kept);
+	/* in place: a sample only ever moves towards the start */
+	if (size == sizeof(t_float))
+		NSKERNEL_COMPACT(t_float)
+	else if (size == sizeof(short))
+		NSKERNEL_COMPACT(short)
+	else
+		NSKERNEL_COMPACT(unsigned char)
+	return (kept);
+}
@@ -0,0 +1,44 @@
+/* ------------------------ nskernel ------------------------------------------ */
+/*                                                                              */
+/* Interleaving and sample format conversion of nstream~ and nsreceive~,        */
+/* unrolled for the common channel counts and picked once per format change.    */
+/*                                                                              */
+/* This program is free software; you can redistribute it and/or                */
+/* modify it under the terms of the GNU General Public License                  */
+/* as published by the Free Software Foundation; either version 2               */
+/* of the License, or (at your option) any later version.                       */
+/*                                                                              */
+/* See file LICENSE for further informations on licensing terms.                */
+/*                                                                              */
+/* This program is distributed in the hope that it will be useful,              */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of               */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                */
+/* GNU General Public License for more details.                                 */
+/*                                                                              */
+/* ---------------------------------------------------------------------------- */
+
+
+#ifndef NSKERNEL_H
+#define NSKERNEL_H
+
+/* n sample frames of in[0..channels-1] into an interleaved buffer */
+typedef void (*t_nsencode)(void *buf, t_sample **in, int channels, int n);
+/* n sample frames of an interleaved buffer out to out[0..channels-1] */
+typedef void (*t_nsdecode)(const void *buf, t_sample **out, int channels, int n);
+
+/* the kernel of a format (SF_FLOAT, SF_16BIT, SF_8BIT) for channels,
+   unrolled for 1, 2, 4 and 8 and a loop over channels for the others.
+   NULL for formats without a kernel. decode takes swapped for floats
+   from a machine of the other byte order */
+t_nsencode nskernel_encode(int format, int channels);
+t_nsdecode nskernel_decode(int format, int swapped, int channels);
+
+/* the largest magnitude among n samples */
+t_sample nskernel_peak(const t_sample *in, int n);
+
+/* drop the channels not in mask (bit i for channel i) from an interleaved
+   buffer of n sample frames, samples of size bytes. returns the channels
+   left, in order */
+int nskernel_compact(void *buf, int size, int channels, unsigned int mask, int n);
+
+#endif /* NSKERNEL_H */
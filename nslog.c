@@ -0,0 +1,112 @@
+/* ------------------------ nslog --------------------------------------------- */
+/*                                                                              */
+/* Rate limited reporting for hot paths: events are only counted there, a       */
+/* clock posts one summary per kind of event and interval.                      */
+/*                                                                              */
+/* This program is free software; you can redistribute it and/or                */
+/* modify it under the terms of the GNU General Public License                  */
+/* as published by the Free Software Foundation; either version 2               */
+/* of the License, or (at your option) any later version.                       */
+/*                                                                              */
+/* See file LICENSE for further informations on licensing terms.                */
+/*                                                                              */
+/* This program is distributed in the hope that it will be useful,              */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of               */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                */
+/* GNU General Public License for more details.                                 */
+/*                                                                              */
+/* ---------------------------------------------------------------------------- */
+
+
+
+#ifdef PD
+#include "m_pd.h"
+#else
+#include "ext.h"
+#endif
+
+#include "nslog.h"
+
+#include <stdio.h>
+
+
+/* runs in the Pd thread every NSLOG_INTERVAL ms, one line per category
+   that saw events since the last time */
+static void nslog_tick(t_nslog *l)
+{
+	char msg[256];
+	unsigned int count, n;
+	int i;
+
+	for (i = 0; i < l->l_ncategories; i++)
+	{
+		count = __atomic_load_n(&l->l_count[i], __ATOMIC_RELAXED);
+		if (!(n = count - l->l_reported[i]))
+			continue;
+		l->l_reported[i] = count;
+		snprintf(msg, sizeof(msg), l->l_categories[i].c_message,
+			 __atomic_load_n(&l->l_value[i], __ATOMIC_RELAXED));
+		if (n == 1 && l->l_categories[i].c_error)
+			error("%s: %s", l->l_owner, msg);
+		else if (n == 1)
+			post("%s: %s", l->l_owner, msg);
+		else if (l->l_categories[i].c_error)
+			error("%s: %s (%u times in %g s)", l->l_owner, msg, n, NSLOG_INTERVAL / 1000.);
+		else
+			post("%s: %s (%u times in %g s)", l->l_owner, msg, n, NSLOG_INTERVAL / 1000.);
+	}
+	clock_delay(l->l_clock, NSLOG_INTERVAL);
+}
+
+
+void nslog_init(t_nslog *l, const char *owner, const t_nslogcategory *categories, int n)
+{
+	int i;
+
+	l->l_owner = owner;
+	l->l_categories = categories;
+	l->l_ncategories = n < NSLOG_CATEGORIES ? n : NSLOG_CATEGORIES;
+	for (i = 0; i < NSLOG_CATEGORIES; i++)
+		l->l_count[i] = l->l_value[i] = l->l_reported[i] = l->l_cleared[i] = 0;
+#ifdef PD
+	l->l_clock = clock_new(l, (t_method)nslog_tick);
+#else
+	l->l_clock = clock_new(l, (method)nslog_tick);
+#endif
+	clock_delay(l->l_clock, NSLOG_INTERVAL);
+}
+
+
+void nslog_free(t_nslog *l)
+{
+	if (l->l_clock)
+		clock_free(l->l_clock);
+	l->l_clock = 0;
+}
+
+
+void nslog_event(t_nslog *l, int category, int value)
+{
+	__atomic_store_n(&l->l_value[category], value, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&l->l_count[category], 1, __ATOMIC_RELAXED);
+}
+
+
+void nslog_print(t_nslog *l, int clear)
+{
+	unsigned int count;
+	int i, any = 0;
+
+	for (i = 0; i < l->l_ncategories; i++)
+	{
+		count = __atomic_load_n(&l->l_count[i], __ATOMIC_RELAXED);
+		if (count == l->l_cleared[i])
+			continue;
+		post("%s: %-10s %u", l->l_owner, l->l_categories[i].c_name, count - l->l_cleared[i]);
+		any = 1;
+		if (clear)
+			l->l_cleared[i] = count;
+	}
+	if (!any)
+		post("%s: nothing logged", l->l_owner);
+}
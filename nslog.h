@@ -0,0 +1,59 @@
+/* ------------------------ nslog --------------------------------------------- */
+/*                                                                              */
+/* Rate limited reporting for hot paths: events are only counted there, a       */
+/* clock posts one summary per kind of event and interval.                      */
+/*                                                                              */
+/* This program is free software; you can redistribute it and/or                */
+/* modify it under the terms of the GNU General Public License                  */
+/* as published by the Free Software Foundation; either version 2               */
+/* of the License, or (at your option) any later version.                       */
+/*                                                                              */
+/* See file LICENSE for further informations on licensing terms.                */
+/*                                                                              */
+/* This program is distributed in the hope that it will be useful,              */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of               */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                */
+/* GNU General Public License for more details.                                 */
+/*                                                                              */
+/* ---------------------------------------------------------------------------- */
+
+
+
+#ifndef NSLOG_H
+#define NSLOG_H
+
+#define NSLOG_CATEGORIES 16             /* kinds of events per object, max. */
+#define NSLOG_INTERVAL 1000             /* ms between two summaries */
+
+typedef struct _nslogcategory
+{
+	const char *c_name;                 /* one word, for the log message */
+	const char *c_message;              /* printf format, %d is the value of the last event */
+	int c_error;                        /* report with error() instead of post() */
+} t_nslogcategory;
+
+typedef struct _nslog
+{
+	const char *l_owner;                /* prefix of the messages, "nsreceive~" */
+	const t_nslogcategory *l_categories;
+	int l_ncategories;
+	unsigned int l_count[NSLOG_CATEGORIES];     /* events so far, bumped from any thread */
+	int l_value[NSLOG_CATEGORIES];              /* value of the latest event */
+	unsigned int l_reported[NSLOG_CATEGORIES];  /* l_count at the last summary */
+	unsigned int l_cleared[NSLOG_CATEGORIES];   /* l_count at the last "log clear" */
+	void *l_clock;
+} t_nslog;
+
+/* the categories must outlive the log, usually a static table */
+void nslog_init(t_nslog *l, const char *owner, const t_nslogcategory *categories, int n);
+void nslog_free(t_nslog *l);
+
+/* count an event of the given category; safe from the DSP, poll and
+   reactor threads, it neither locks nor prints */
+void nslog_event(t_nslog *l, int category, int value);
+
+/* post the count of every category since the last clear, then clear
+   when asked to */
+void nslog_print(t_nslog *l, int clear);
+
+#endif /* NSLOG_H */
@@ -0,0 +1,443 @@
+/* ------------------------ nsmetrics ----------------------------------------- */
+/*                                                                              */
+/* Export of the counters of all nstream~ and nsreceive~ of a process for       */
+/* monitoring, in Prometheus text or JSON lines, from a background thread.      */
+/*                                                                              */
+/* This program is free software; you can redistribute it and/or                */
+/* modify it under the terms of the GNU General Public License                  */
+/* as published by the Free Software Foundation; either version 2               */
+/* of the License, or (at your option) any later version.                       */
+/*                                                                              */
+/* See file LICENSE for further informations on licensing terms.                */
+/*                                                                              */
+/* This program is distributed in the hope that it will be useful,              */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of               */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                */
+/* GNU General Public License for more details.                                 */
+/*                                                                              */
+/* ---------------------------------------------------------------------------- */
+
+
+
+#include "nsmetrics.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <pthread.h>
+
+#if !defined(_WIN32)
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+typedef struct _nsmetricsbuf
+{
+	char *b_data;
+	size_t b_len;
+	size_t b_size;
+} t_nsmetricsbuf;
+
+struct _nsmetricsout
+{
+	int o_format;
+	char o_object[32];
+	char o_labels[512];                 /* prometheus: key="value",... */
+	char o_json[512];                   /* json: "key":"value",... */
+	int o_open;                         /* a json line is started */
+	t_nsmetricsbuf o_text;              /* json lines, or the prometheus samples */
+	size_t *o_samples;                  /* prometheus: offset of every sample in o_text */
+	size_t o_nsamples;
+	size_t o_maxsamples;
+};
+
+static pthread_mutex_t nsmetrics_lock = PTHREAD_MUTEX_INITIALIZER;
+static t_nsmetrics *nsmetrics_list;
+static int nsmetrics_ids;
+
+static pthread_t nsmetrics_thread;
+static int nsmetrics_running;
+static int nsmetrics_wake[2] = { -1, -1 };  /* a byte here stops the thread */
+static int nsmetrics_listen = -1;
+static char nsmetrics_path[256];
+static int nsmetrics_format;
+static int nsmetrics_interval;
+
+
+static void nsmetrics_printf(t_nsmetricsbuf *b, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	while (1)
+	{
+		va_start(ap, fmt);
+		n = vsnprintf(b->b_data + b->b_len, b->b_size - b->b_len, fmt, ap);
+		va_end(ap);
+		if (n >= 0 && b->b_len + n < b->b_size)
+			break;
+		{
+			size_t size = b->b_size ? b->b_size * 2 : 4096;
+			char *data;
+			while (size <= b->b_len + n)
+				size *= 2;
+			if (!(data = (char *)realloc(b->b_data, size)))
+				return;
+			b->b_data = data;
+			b->b_size = size;
+		}
+	}
+	b->b_len += n;
+}
+
+
+void nsmetrics_register(t_nsmetrics *m, t_nsmetrics_fn fn, void *owner)
+{
+	pthread_mutex_lock(&nsmetrics_lock);
+	m->m_fn = fn;
+	m->m_owner = owner;
+	m->m_id = ++nsmetrics_ids;
+	m->m_next = nsmetrics_list;
+	nsmetrics_list = m;
+	pthread_mutex_unlock(&nsmetrics_lock);
+}
+
+
+void nsmetrics_unregister(t_nsmetrics *m)
+{
+	t_nsmetrics **p;
+
+	pthread_mutex_lock(&nsmetrics_lock);
+	for (p = &nsmetrics_list; *p; p = &(*p)->m_next)
+		if (*p == m)
+		{
+			*p = m->m_next;
+			break;
+		}
+	pthread_mutex_unlock(&nsmetrics_lock);
+}
+
+
+static void nsmetrics_endseries(t_nsmetricsout *o)
+{
+	if (o->o_open)
+		nsmetrics_printf(&o->o_text, "}\n");
+	o->o_open = 0;
+}
+
+
+void nsmetrics_series(t_nsmetricsout *o, const char *object, int id)
+{
+	nsmetrics_endseries(o);
+	snprintf(o->o_object, sizeof(o->o_object), "%s", object);
+	o->o_labels[0] = o->o_json[0] = 0;
+	nsmetrics_labelint(o, "instance", id);
+}
+
+
+void nsmetrics_label(t_nsmetricsout *o, const char *key, const char *value)
+{
+	size_t n = strlen(o->o_labels), j = strlen(o->o_json);
+
+	/* label values are host names and numbers, drop what would need escaping */
+	if (strchr(value, '"') || strchr(value, '\\'))
+		value = "";
+	snprintf(o->o_labels + n, sizeof(o->o_labels) - n, "%s%s=\"%s\"", n ? "," : "", key, value);
+	snprintf(o->o_json + j, sizeof(o->o_json) - j, ",\"%s\":\"%s\"", key, value);
+}
+
+
+void nsmetrics_labelint(t_nsmetricsout *o, const char *key, int value)
+{
+	char buf[16];
+
+	snprintf(buf, sizeof(buf), "%d", value);
+	nsmetrics_label(o, key, buf);
+}
+
+
+void nsmetrics_value(t_nsmetricsout *o, const char *name, double value)
+{
+	if (o->o_format == NSMETRICS_JSON)
+	{
+		if (!o->o_open)
+		{
+			struct timeval tv;
+			gettimeofday(&tv, NULL);
+			nsmetrics_printf(&o->o_text, "{\"time\":%ld.%03ld,\"object\":\"%s\"%s",
+					 (long)tv.tv_sec, (long)tv.tv_usec / 1000, o->o_object, o->o_json);
+			o->o_open = 1;
+		}
+		nsmetrics_printf(&o->o_text, ",\"%s\":%.9g", name, value);
+		return;
+	}
+	/* offsets, o_text moves while it grows */
+	if (o->o_nsamples == o->o_maxsamples)
+	{
+		size_t max = o->o_maxsamples ? o->o_maxsamples * 2 : 256;
+		size_t *samples = (size_t *)realloc(o->o_samples, max * sizeof(size_t));
+		if (!samples)
+			return;
+		o->o_samples = samples;
+		o->o_maxsamples = max;
+	}
+	o->o_samples[o->o_nsamples++] = o->o_text.b_len;
+	nsmetrics_printf(&o->o_text, "%s_%s{%s} %.9g", o->o_object, name, o->o_labels, value);
+	nsmetrics_printf(&o->o_text, "%c", 0);
+}
+
+
+static int nsmetrics_cmp(const void *a, const void *b)
+{
+	const char *sa = *(const char **)a, *sb = *(const char **)b;
+	size_t na = strcspn(sa, "{"), nb = strcspn(sb, "{");
+	int c = strncmp(sa, sb, na < nb ? na : nb);
+
+	return (c ? c : (int)na - (int)nb);
+}
+
+
+/* the values of all registered objects in the selected format */
+static void nsmetrics_collect(t_nsmetricsbuf *out)
+{
+	t_nsmetricsout o;
+	t_nsmetrics *m;
+	char **samples;
+	size_t i;
+
+	memset(&o, 0, sizeof(o));
+	o.o_format = nsmetrics_format;
+	pthread_mutex_lock(&nsmetrics_lock);
+	for (m = nsmetrics_list; m; m = m->m_next)
+		m->m_fn(m->m_owner, &o);
+	pthread_mutex_unlock(&nsmetrics_lock);
+	nsmetrics_endseries(&o);
+
+	out->b_len = 0;
+	if (o.o_format == NSMETRICS_JSON)
+	{
+		if (o.o_text.b_len)
+			nsmetrics_printf(out, "%s", o.o_text.b_data);
+	}
+	else
+	{
+		/* the exposition format wants the samples of a metric together */
+		if (o.o_nsamples && (samples = (char **)malloc(o.o_nsamples * sizeof(char *))))
+		{
+			for (i = 0; i < o.o_nsamples; i++)
+				samples[i] = o.o_text.b_data + o.o_samples[i];
+			qsort(samples, o.o_nsamples, sizeof(char *), nsmetrics_cmp);
+			for (i = 0; i < o.o_nsamples; i++)
+			{
+				size_t n = strcspn(samples[i], "{");
+				if (!i || nsmetrics_cmp(&samples[i - 1], &samples[i]))
+					nsmetrics_printf(out, "# TYPE %.*s %s\n", (int)n, samples[i],
+							 n > 6 && !strncmp(samples[i] + n - 6, "_total", 6) ? "counter" : "gauge");
+				nsmetrics_printf(out, "%s\n", samples[i]);
+			}
+			free(samples);
+		}
+	}
+	if (!out->b_len)
+		nsmetrics_printf(out, "%s", "");
+	free(o.o_text.b_data);
+	free(o.o_samples);
+}
+
+
+static void nsmetrics_writeall(int fd, const char *p, size_t len)
+{
+	ssize_t n;
+
+	while (len && ((n = write(fd, p, len)) > 0 || (n < 0 && errno == EINTR)))
+		if (n > 0)
+		{
+			p += n;
+			len -= n;
+		}
+}
+
+
+/* write to a temporary file and rename it, readers never see half a file */
+static void nsmetrics_writefile(t_nsmetricsbuf *b)
+{
+	char tmp[sizeof(nsmetrics_path) + 8];
+	int fd;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", nsmetrics_path);
+	if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+		return;
+	nsmetrics_writeall(fd, b->b_data, b->b_len);
+	close(fd);
+	rename(tmp, nsmetrics_path);
+}
+
+
+static void *nsmetrics_run(void *zz)
+{
+	t_nsmetricsbuf b = { 0, 0, 0 };
+	struct pollfd fds[2];
+	int nfds = 1, fd;
+
+	fds[0].fd = nsmetrics_wake[0];
+	fds[0].events = POLLIN;
+	if (nsmetrics_listen >= 0)
+	{
+		fds[1].fd = nsmetrics_listen;
+		fds[1].events = POLLIN;
+		nfds = 2;
+	}
+	else
+	{
+		nsmetrics_collect(&b);
+		nsmetrics_writefile(&b);
+	}
+	while (1)
+	{
+		fds[0].revents = fds[1].revents = 0;
+		if (poll(fds, nfds, nsmetrics_listen >= 0 ? -1 : nsmetrics_interval) < 0 && errno != EINTR)
+			break;
+		if (fds[0].revents)
+			break;
+		if (nsmetrics_listen < 0)
+		{
+			nsmetrics_collect(&b);
+			nsmetrics_writefile(&b);
+		}
+		else if (fds[1].revents && (fd = accept(nsmetrics_listen, NULL, NULL)) >= 0)
+		{
+			/* one snapshot per connection, then hang up */
+			nsmetrics_collect(&b);
+			nsmetrics_writeall(fd, b.b_data, b.b_len);
+			close(fd);
+		}
+	}
+	free(b.b_data);
+	return (0);
+}
+
+
+static void nsmetrics_stop(void)
+{
+	if (!nsmetrics_running)
+		return;
+	(void)!write(nsmetrics_wake[1], "", 1);
+	pthread_join(nsmetrics_thread, NULL);
+	close(nsmetrics_wake[0]);
+	close(nsmetrics_wake[1]);
+	nsmetrics_wake[0] = nsmetrics_wake[1] = -1;
+	if (nsmetrics_listen >= 0)
+	{
+		close(nsmetrics_listen);
+		unlink(nsmetrics_path);
+	}
+	nsmetrics_listen = -1;
+	nsmetrics_running = 0;
+}
+
+
+int nsmetrics_start(const char *target, int format, int interval)
+{
+	size_t n = strlen(NSMETRICS_UNIX);
+	int err;
+
+	nsmetrics_stop();
+	if (!target)
+		return (0);
+	nsmetrics_format = format;
+	nsmetrics_interval = interval > 0 ? interval : DEFAULT_METRICS_INTERVAL;
+	if (!strncmp(target, NSMETRICS_UNIX, n))
+	{
+		struct sockaddr_un addr;
+
+		target += n;
+		if (strlen(target) >= sizeof(addr.sun_path))
+			return (ENAMETOOLONG);
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strcpy(addr.sun_path, target);
+		if ((nsmetrics_listen = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+			return (errno);
+		unlink(target);
+		if (bind(nsmetrics_listen, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+		    listen(nsmetrics_listen, 8) < 0)
+		{
+			err = errno;
+			close(nsmetrics_listen);
+			nsmetrics_listen = -1;
+			return (err);
+		}
+	}
+	else if (strlen(target) >= sizeof(nsmetrics_path))
+		return (ENAMETOOLONG);
+	snprintf(nsmetrics_path, sizeof(nsmetrics_path), "%s", target);
+	if (nsmetrics_listen < 0)
+	{
+		/* fail now rather than on the thread, where nobody hears about it */
+		char tmp[sizeof(nsmetrics_path) + 8];
+		int fd;
+
+		snprintf(tmp, sizeof(tmp), "%s.tmp", nsmetrics_path);
+		if ((fd = open(tmp, O_WRONLY | O_CREAT, 0644)) < 0)
+			return (errno);
+		close(fd);
+	}
+	if (pipe(nsmetrics_wake) < 0)
+		err = errno;
+	else if ((err = pthread_create(&nsmetrics_thread, NULL, nsmetrics_run, 0)))
+	{
+		close(nsmetrics_wake[0]);
+		close(nsmetrics_wake[1]);
+	}
+	if (err)
+	{
+		if (nsmetrics_listen >= 0)
+			close(nsmetrics_listen);
+		nsmetrics_listen = -1;
+		nsmetrics_wake[0] = nsmetrics_wake[1] = -1;
+		return (err);
+	}
+	nsmetrics_running = 1;
+	return (0);
+}
+
+#else /* _WIN32 */
+
+void nsmetrics_register(t_nsmetrics *m, t_nsmetrics_fn fn, void *owner)
+{
+	m->m_fn = fn;
+	m->m_owner = owner;
+}
+
+void nsmetrics_unregister(t_nsmetrics *m)
+{
+}
+
+int nsmetrics_start(const char *target, int format, int interval)
+{
+	return (target ? ENOSYS : 0);
+}
+
+void nsmetrics_series(t_nsmetricsout *o, const char *object, int id)
+{
+}
+
+void nsmetrics_label(t_nsmetricsout *o, const char *key, const char *value)
+{
+}
+
+void nsmetrics_labelint(t_nsmetricsout *o, const char *key, int value)
+{
+}
+
+void nsmetrics_value(t_nsmetricsout *o, const char *name, double value)
+{
+}
+
+#endif /* _WIN32 */
@@ -0,0 +1,63 @@
+/* ------------------------ nsmetrics ----------------------------------------- */
+/*                                                                              */
+/* Export of the counters of all nstream~ and nsreceive~ of a process for       */
+/* monitoring, in Prometheus text or JSON lines, from a background thread.      */
+/*                                                                              */
+/* This program is free software; you can redistribute it and/or                */
+/* modify it under the terms of the GNU General Public License                  */
+/* as published by the Free Software Foundation; either version 2               */
+/* of the License, or (at your option) any later version.                       */
+/*                                                                              */
+/* See file LICENSE for further informations on licensing terms.                */
+/*                                                                              */
+/* This program is distributed in the hope that it will be useful,              */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of               */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                */
+/* GNU General Public License for more details.                                 */
+/*                                                                              */
+/* ---------------------------------------------------------------------------- */
+
+
+
+#ifndef NSMETRICS_H
+#define NSMETRICS_H
+
+#define DEFAULT_METRICS_INTERVAL 10000  /* ms between two writes of the file */
+#define NSMETRICS_UNIX "unix:"          /* metrics unix:<path> serves a socket instead */
+
+#define NSMETRICS_PROMETHEUS 0
+#define NSMETRICS_JSON 1
+
+typedef struct _nsmetricsout t_nsmetricsout;
+
+/* adds the series of one object to o. runs on the exporter thread while
+   the object is registered: read the counters, never call Pd */
+typedef void (*t_nsmetrics_fn)(void *owner, t_nsmetricsout *o);
+
+typedef struct _nsmetrics
+{
+	t_nsmetrics_fn m_fn;
+	void *m_owner;
+	int m_id;                           /* unique in the process, the "instance" label */
+	struct _nsmetrics *m_next;
+} t_nsmetrics;
+
+/* unregister waits for a running export, after that fn is not called
+   anymore and the owner can go */
+void nsmetrics_register(t_nsmetrics *m, t_nsmetrics_fn fn, void *owner);
+void nsmetrics_unregister(t_nsmetrics *m);
+
+/* export to the file target every interval ms (replaced atomically), or
+   answer every connection to unix:<path> with the current values. a NULL
+   target stops the export. returns 0 or an errno value */
+int nsmetrics_start(const char *target, int format, int interval);
+
+/* for t_nsmetrics_fn: a series is one object (or one sender of it) with
+   its labels, followed by its values */
+void nsmetrics_series(t_nsmetricsout *o, const char *object, int id);
+void nsmetrics_label(t_nsmetricsout *o, const char *key, const char *value);
+void nsmetrics_labelint(t_nsmetricsout *o, const char *key, int value);
+/* names ending in _total are counters, the others gauges */
+void nsmetrics_value(t_nsmetricsout *o, const char *name, double value);
+
+#endif /* NSMETRICS_H */
@@ -0,0 +1,1168 @@
+/* ------------------------ nsreactor ----------------------------------------- */
+/*                                                                              */
+/* Shared I/O threads for nstream~ and nsreceive~: a small number of epoll or   */
+/* io_uring threads serve the sockets and send queues of every object.          */
+/*                                                                              */
+/* This program is free software; you can redistribute it and/or                */
+/* modify it under the terms of the GNU General Public License                  */
+/* as published by the Free Software Foundation; either version 2               */
+/* of the License, or (at your option) any later version.                       */
+/*                                                                              */
+/* See file LICENSE for further informations on licensing terms.                */
+/*                                                                              */
+/* This program is distributed in the hope that it will be useful,              */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of               */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                */
+/* GNU General Public License for more details.                                 */
+/*                                                                              */
+/* ---------------------------------------------------------------------------- */
+
+/* pd loads externals with global symbols, so nstream~ and nsreceive~ end up
+   sharing these threads. the entry points are not pd specific. */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE	/* pthread_setaffinity_np() */
+#endif
+
+#include "nsreactor.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/socket.h>
+#include <time.h>
+#endif
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <sched.h>
+
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <poll.h>
+#if !defined(IORING_RECV_MULTISHOT) || !defined(IORING_RECVSEND_FIXED_BUF) || !defined(__NR_io_uring_setup)
+#undef HAVE_IO_URING	/* headers predate multishot receives */
+#endif
+#endif
+
+#define REACTOR_MAXEVENTS 64
+
+/* room for the receive timestamp and the UDP_GRO segment size */
+#ifdef UDP_GRO
+#define URING_CONTROL_SIZE (CMSG_SPACE(sizeof(struct timespec)) + CMSG_SPACE(sizeof(int)))
+#else
+#define URING_CONTROL_SIZE CMSG_SPACE(sizeof(struct timespec))
+#endif
+
+#ifdef HAVE_IO_URING
+#define URING_ENTRIES 256
+#define URING_RECV_BUFFERS 32		/* provided receive buffers, power of two */
+#define URING_SEND_BUFFERS 32		/* registered send buffers */
+#define URING_RECV_BUFSIZE (NSREACTOR_BUFFER_SIZE + 256)	/* a full datagram after the recvmsg headers */
+#define URING_BGID 0
+
+/* user_data: operation in the top byte, entry id or buffer index below */
+#define URING_OP_WAKE 1
+#define URING_OP_POLL 2
+#define URING_OP_RECV 3
+#define URING_OP_SEND 4
+#define URING_OP_CANCEL 5
+#define URING_DATA(op, id) (((uint64_t)(op) << 56) | (uint32_t)(id))
+
+typedef struct _nssendbuf
+{
+	int b_busy;                 /* until the kernel is done with it */
+	void *b_owner;
+	int *b_err;
+} t_nssendbuf;
+
+typedef struct _nsuring
+{
+	int u_fd;
+	void *u_sqring;
+	void *u_cqring;
+	size_t u_sqringsize;
+	size_t u_cqringsize;
+	struct io_uring_sqe *u_sqes;
+	size_t u_sqessize;
+	unsigned *u_sqhead;
+	unsigned *u_sqtail;
+	unsigned *u_sqarray;
+	unsigned u_sqmask;
+	unsigned u_sqentries;
+	unsigned *u_cqhead;
+	unsigned *u_cqtail;
+	unsigned u_cqmask;
+	struct io_uring_cqe *u_cqes;
+	unsigned u_pending;         /* queued, not yet submitted */
+	struct msghdr u_msg;        /* template for the multishot recvmsg */
+	struct io_uring_buf_ring *u_bufring;
+	unsigned short u_buftail;
+	char *u_recvbufs;
+	char *u_sendbufs;
+	t_nssendbuf u_send[URING_SEND_BUFFERS];
+	int u_zerocopy;             /* send buffers are registered, use SEND_ZC */
+	int u_sendblocked;          /* a flush ran out of send buffers */
+} t_nsuring;
+#endif /* HAVE_IO_URING */
+
+typedef struct _nsentry
+{
+	int e_fd;                   /* -1 for flush entries */
+	unsigned e_id;
+	t_nsreactor_fn e_fn;
+	t_nsreactor_recvfn e_recvfn;
+	void *e_owner;
+} t_nsentry;
+
+struct _nsreactor
+{
+	pthread_t r_thread;
+	pthread_mutex_t r_mutex;    /* held while callbacks run, detach waits on it */
+	int r_backend;
+	int r_epfd;
+	int r_wakefd;               /* eventfd, wakes the thread for flush entries */
+	int r_quit;
+	t_nsentry *r_entries;
+	int r_nentries;
+	int r_size;
+	unsigned r_nextid;
+#ifdef HAVE_IO_URING
+	t_nsuring *r_uring;
+#endif
+	struct _nsreactor *r_next;  /* retired threads */
+};
+
+static t_nsreactor *reactors[MAX_REACTOR_THREADS];
+static int nreactors;
+static int nextreactor;         /* round robin among threads */
+static int reactorbackend = NSREACTOR_EPOLL;
+static t_nsreactor *retired;    /* threads of the previous backend, still in use */
+static pthread_mutex_t reactors_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int reactorcpu = -1;     /* thread i runs on reactorcpu + i */
+static int reactorpriority;     /* SCHED_FIFO priority, 0 for SCHED_OTHER */
+static int reactorbusypoll;     /* usec a thread spins before it sleeps */
+static __thread unsigned long long reactorwaketime;
+
+
+unsigned long long nsreactor_waketime(void)
+{
+	return (reactorwaketime);
+}
+
+
+/* spin without sleeping until then, 0 when busy polling is off */
+static unsigned long long nsreactor_spinuntil(void)
+{
+	int usec = NS_LOAD_ACQUIRE(&reactorbusypoll);
+
+	return (usec ? reactorwaketime + usec * 1000ULL : 0);
+}
+
+
+static void nsreactor_runflush(t_nsreactor *r)
+{
+	int i;
+
+	for (i = 0; i < r->r_nentries; i++)
+		if (r->r_entries[i].e_fd == -1)
+			r->r_entries[i].e_fn(r->r_entries[i].e_owner);
+}
+
+
+static void *nsreactor_thread(void *zz)
+{
+	t_nsreactor *r = (t_nsreactor *)zz;
+	struct epoll_event events[REACTOR_MAXEVENTS];
+	unsigned long long spinuntil = 0;
+	int i, j, n;
+
+	while (!NS_LOAD_ACQUIRE(&r->r_quit))
+	{
+		/* busy polling: no sleep while events came in recently */
+		int spin = spinuntil && nsreactor_now() < spinuntil;
+		n = epoll_wait(r->r_epfd, events, REACTOR_MAXEVENTS, spin ? 0 : -1);
+		if (n <= 0)
+		{
+			if (n < 0 && errno != EINTR)
+				break;
+			continue;
+		}
+		reactorwaketime = nsreactor_now();
+		spinuntil = nsreactor_spinuntil();
+		pthread_mutex_lock(&r->r_mutex);
+		for (i = 0; i < n; i++)
+		{
+			int fd = (int)events[i].data.fd;
+			if (fd == r->r_wakefd)
+			{
+				uint64_t count;
+				ssize_t got = read(r->r_wakefd, &count, sizeof(count));
+				(void)got;	/* < 0: already drained */
+				nsreactor_runflush(r);
+				continue;
+			}
+			/* look the fd up under the lock, it may have been detached
+			   since epoll_wait returned */
+			for (j = 0; j < r->r_nentries; j++)
+				if (r->r_entries[j].e_fd == fd)
+				{
+					r->r_entries[j].e_fn(r->r_entries[j].e_owner);
+					break;
+				}
+		}
+		pthread_mutex_unlock(&r->r_mutex);
+	}
+	return (0);
+}
+
+
+#ifdef HAVE_IO_URING
+
+/* no liburing: the three system calls and the ring layout are all we need */
+
+static int nsuring_setup(unsigned entries, struct io_uring_params *params)
+{
+	return ((int)syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int nsuring_enter(int fd, unsigned submit, unsigned wait, unsigned flags)
+{
+	return ((int)syscall(__NR_io_uring_enter, fd, submit, wait, flags, 0, 0));
+}
+
+static int nsuring_register(int fd, unsigned op, void *arg, unsigned n)
+{
+	return ((int)syscall(__NR_io_uring_register, fd, op, arg, n));
+}
+
+
+static void nsuring_free(t_nsuring *u)
+{
+	if (u->u_sqes && u->u_sqes != MAP_FAILED)
+		munmap(u->u_sqes, u->u_sqessize);
+	if (u->u_cqring && u->u_cqring != MAP_FAILED && u->u_cqring != u->u_sqring)
+		munmap(u->u_cqring, u->u_cqringsize);
+	if (u->u_sqring && u->u_sqring != MAP_FAILED)
+		munmap(u->u_sqring, u->u_sqringsize);
+	if (u->u_bufring && (void *)u->u_bufring != MAP_FAILED)
+		munmap(u->u_bufring, URING_RECV_BUFFERS * sizeof(struct io_uring_buf));
+	if (u->u_fd >= 0)
+		close(u->u_fd);
+	free(u->u_recvbufs);
+	free(u->u_sendbufs);
+	free(u);
+}
+
+
+/* hand receive buffer bid back to the kernel */
+static void nsuring_putbuf(t_nsuring *u, int bid)
+{
+	struct io_uring_buf *b = &u->u_bufring->bufs[u->u_buftail & (URING_RECV_BUFFERS - 1)];
+
+	b->addr = (uint64_t)(uintptr_t)(u->u_recvbufs + (size_t)bid * URING_RECV_BUFSIZE);
+	b->len = URING_RECV_BUFSIZE;
+	b->bid = bid;
+	u->u_buftail++;
+	__atomic_store_n(&u->u_bufring->tail, u->u_buftail, __ATOMIC_RELEASE);
+}
+
+
+static t_nsuring *nsuring_new(void)
+{
+	t_nsuring *u = (t_nsuring *)calloc(1, sizeof(t_nsuring));
+	struct io_uring_params params;
+	struct io_uring_buf_reg reg;
+	struct io_uring_probe *probe;
+	struct iovec iov[URING_SEND_BUFFERS];
+	char *sq, *cq;
+	int i, ok;
+
+	if (!u)
+		return (0);
+	u->u_fd = -1;
+	memset(&params, 0, sizeof(params));
+	if ((u->u_fd = nsuring_setup(URING_ENTRIES, &params)) < 0)
+		goto fail;
+
+	/* multishot recvmsg and SEND_ZC came with the same kernel (6.0) */
+	probe = (struct io_uring_probe *)calloc(1, sizeof(*probe) + 256 * sizeof(struct io_uring_probe_op));
+	ok = probe && nsuring_register(u->u_fd, IORING_REGISTER_PROBE, probe, 256) >= 0 &&
+		probe->last_op >= IORING_OP_SEND_ZC && (probe->ops[IORING_OP_SEND_ZC].flags & IO_URING_OP_SUPPORTED);
+	free(probe);
+	if (!ok)
+		goto fail;
+
+	u->u_sqringsize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	u->u_cqringsize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		if (u->u_cqringsize > u->u_sqringsize)
+			u->u_sqringsize = u->u_cqringsize;
+		u->u_cqringsize = u->u_sqringsize;
+	}
+	u->u_sqring = mmap(0, u->u_sqringsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			   u->u_fd, IORING_OFF_SQ_RING);
+	if (u->u_sqring == MAP_FAILED)
+		goto fail;
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+		u->u_cqring = u->u_sqring;
+	else if ((u->u_cqring = mmap(0, u->u_cqringsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+				     u->u_fd, IORING_OFF_CQ_RING)) == MAP_FAILED)
+		goto fail;
+	u->u_sqessize = params.sq_entries * sizeof(struct io_uring_sqe);
+	u->u_sqes = (struct io_uring_sqe *)mmap(0, u->u_sqessize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+						u->u_fd, IORING_OFF_SQES);
+	if (u->u_sqes == MAP_FAILED)
+		goto fail;
+	sq = (char *)u->u_sqring;
+	cq = (char *)u->u_cqring;
+	u->u_sqhead = (unsigned *)(sq + params.sq_off.head);
+	u->u_sqtail = (unsigned *)(sq + params.sq_off.tail);
+	u->u_sqarray = (unsigned *)(sq + params.sq_off.array);
+	u->u_sqmask = *(unsigned *)(sq + params.sq_off.ring_mask);
+	u->u_sqentries = params.sq_entries;
+	u->u_cqhead = (unsigned *)(cq + params.cq_off.head);
+	u->u_cqtail = (unsigned *)(cq + params.cq_off.tail);
+	u->u_cqmask = *(unsigned *)(cq + params.cq_off.ring_mask);
+	u->u_cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+	/* provided buffers: the kernel picks one for each datagram it receives */
+	u->u_bufring = (struct io_uring_buf_ring *)mmap(0, URING_RECV_BUFFERS * sizeof(struct io_uring_buf),
+							PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if ((void *)u->u_bufring == MAP_FAILED)
+		goto fail;
+	if (!(u->u_recvbufs = (char *)malloc((size_t)URING_RECV_BUFFERS * URING_RECV_BUFSIZE)))
+		goto fail;
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (uint64_t)(uintptr_t)u->u_bufring;
+	reg.ring_entries = URING_RECV_BUFFERS;
+	reg.bgid = URING_BGID;
+	if (nsuring_register(u->u_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+		goto fail;
+	for (i = 0; i < URING_RECV_BUFFERS; i++)
+		nsuring_putbuf(u, i);
+
+	/* send buffers, registered so SEND_ZC doesn't have to pin pages per
+	   packet. without the registration (memlock limit) we copy */
+	if (!(u->u_sendbufs = (char *)malloc((size_t)URING_SEND_BUFFERS * NSREACTOR_BUFFER_SIZE)))
+		goto fail;
+	for (i = 0; i < URING_SEND_BUFFERS; i++)
+	{
+		iov[i].iov_base = u->u_sendbufs + (size_t)i * NSREACTOR_BUFFER_SIZE;
+		iov[i].iov_len = NSREACTOR_BUFFER_SIZE;
+	}
+	u->u_zerocopy = nsuring_register(u->u_fd, IORING_REGISTER_BUFFERS, iov, URING_SEND_BUFFERS) >= 0;
+
+	u->u_msg.msg_namelen = sizeof(struct sockaddr_in);
+	u->u_msg.msg_controllen = URING_CONTROL_SIZE;
+	return (u);
+
+fail:
+	nsuring_free(u);
+	return (0);
+}
+
+
+static void nsuring_submit(t_nsuring *u)
+{
+	while (u->u_pending)
+	{
+		int n = nsuring_enter(u->u_fd, u->u_pending, 0, 0);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			break;	/* EAGAIN/EBUSY: retried with the next submission */
+		}
+		u->u_pending -= (n < u->u_pending) ? n : u->u_pending;
+		if (!n)
+			break;
+	}
+}
+
+
+/* next free submission entry, queued with nsuring_push once filled in */
+static struct io_uring_sqe *nsuring_getsqe(t_nsuring *u)
+{
+	unsigned tail = *u->u_sqtail;
+	struct io_uring_sqe *sqe;
+
+	if (tail - __atomic_load_n(u->u_sqhead, __ATOMIC_ACQUIRE) >= u->u_sqentries)
+	{
+		nsuring_submit(u);
+		if (tail - __atomic_load_n(u->u_sqhead, __ATOMIC_ACQUIRE) >= u->u_sqentries)
+			return (0);
+	}
+	sqe = &u->u_sqes[tail & u->u_sqmask];
+	memset(sqe, 0, sizeof(*sqe));
+	return (sqe);
+}
+
+static void nsuring_push(t_nsuring *u)
+{
+	unsigned tail = *u->u_sqtail;
+
+	u->u_sqarray[tail & u->u_sqmask] = tail & u->u_sqmask;
+	__atomic_store_n(u->u_sqtail, tail + 1, __ATOMIC_RELEASE);
+	u->u_pending++;
+}
+
+
+static void nsuring_armwake(t_nsreactor *r)
+{
+	struct io_uring_sqe *sqe = nsuring_getsqe(r->r_uring);
+
+	if (!sqe)
+		return;
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = r->r_wakefd;
+	sqe->poll32_events = POLLIN;
+	sqe->len = IORING_POLL_ADD_MULTI;
+	sqe->user_data = URING_DATA(URING_OP_WAKE, 0);
+	nsuring_push(r->r_uring);
+}
+
+
+/* sockets with a recvfn get a multishot recvmsg, others a multishot poll */
+static void nsuring_arm(t_nsreactor *r, t_nsentry *e)
+{
+	t_nsuring *u = r->r_uring;
+	struct io_uring_sqe *sqe = nsuring_getsqe(u);
+
+	if (!sqe)
+		return;
+	sqe->fd = e->e_fd;
+	if (e->e_recvfn)
+	{
+		sqe->opcode = IORING_OP_RECVMSG;
+		sqe->addr = (uint64_t)(uintptr_t)&u->u_msg;
+		sqe->len = 1;
+		sqe->ioprio = IORING_RECV_MULTISHOT;
+		sqe->flags = IOSQE_BUFFER_SELECT;
+		sqe->buf_group = URING_BGID;
+		sqe->user_data = URING_DATA(URING_OP_RECV, e->e_id);
+	}
+	else
+	{
+		sqe->opcode = IORING_OP_POLL_ADD;
+		sqe->poll32_events = POLLIN;
+		sqe->len = IORING_POLL_ADD_MULTI;
+		sqe->user_data = URING_DATA(URING_OP_POLL, e->e_id);
+	}
+	nsuring_push(u);
+}
+
+
+static void nsuring_cancel(t_nsreactor *r, t_nsentry *e)
+{
+	struct io_uring_sqe *sqe = nsuring_getsqe(r->r_uring);
+
+	if (!sqe)
+		return;
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = URING_DATA(e->e_recvfn ? URING_OP_RECV : URING_OP_POLL, e->e_id);
+	sqe->user_data = URING_DATA(URING_OP_CANCEL, 0);
+	nsuring_push(r->r_uring);
+}
+
+
+static t_nsentry *nsreactor_findid(t_nsreactor *r, unsigned id)
+{
+	int i;
+
+	for (i = 0; i < r->r_nentries; i++)
+		if (r->r_entries[i].e_id == id)
+			return (&r->r_entries[i]);
+	return (0);
+}
+
+
+/* a recvmsg completion: io_uring_recvmsg_out, the address, the control
+   messages, the payload. datagrams the kernel coalesced (UDP_GRO) are
+   handed on one by one */
+static void nsuring_recvmsg(t_nsentry *e, char *buf, int len)
+{
+	struct io_uring_recvmsg_out *out = (struct io_uring_recvmsg_out *)buf;
+	struct sockaddr_in *from = (struct sockaddr_in *)(buf + sizeof(struct io_uring_recvmsg_out));
+	int hdr = sizeof(struct io_uring_recvmsg_out) + sizeof(struct sockaddr_in) + URING_CONTROL_SIZE;
+	int segsize = 0;
+	char *data = buf + hdr;
+	unsigned long long stamp;
+	struct msghdr msg;
+
+	if (len < hdr || (out->flags & MSG_TRUNC))
+		return;
+	len -= hdr;
+	if (out->payloadlen < len)
+		len = out->payloadlen;
+
+	/* the control messages as recvmsg would have returned them */
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_control = buf + hdr - URING_CONTROL_SIZE;
+	msg.msg_controllen = out->controllen;
+	stamp = nsreactor_rxstamp(&msg);
+#ifdef UDP_GRO
+	{
+		struct cmsghdr *cm;
+		for (cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm))
+			if (cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_GRO)
+				memcpy(&segsize, CMSG_DATA(cm), sizeof(int));
+	}
+#endif
+	if (segsize <= 0)
+		segsize = len;
+	for (; len > 0; data += segsize, len -= segsize)
+		e->e_recvfn(e->e_owner, data, len < segsize ? len : segsize, from, stamp);
+}
+
+
+/* returns the number of completions */
+static int nsuring_reap(t_nsreactor *r)
+{
+	t_nsuring *u = r->r_uring;
+	unsigned head = *u->u_cqhead;
+	unsigned tail = __atomic_load_n(u->u_cqtail, __ATOMIC_ACQUIRE);
+	int flush = 0, n = tail - head;
+
+	while (head != tail)
+	{
+		struct io_uring_cqe *cqe = &u->u_cqes[head & u->u_cqmask];
+		uint64_t data = cqe->user_data;
+		unsigned id = (uint32_t)data;
+		unsigned flags = cqe->flags;
+		int res = cqe->res;
+		int more = (flags & IORING_CQE_F_MORE) != 0;
+		t_nsentry *e;
+
+		__atomic_store_n(u->u_cqhead, ++head, __ATOMIC_RELEASE);
+		switch (data >> 56)
+		{
+			case URING_OP_WAKE:
+			{
+				uint64_t count;
+				ssize_t got = read(r->r_wakefd, &count, sizeof(count));
+				(void)got;	/* < 0: already drained */
+				flush = 1;
+				if (!more && !NS_LOAD_ACQUIRE(&r->r_quit))
+					nsuring_armwake(r);
+				break;
+			}
+			case URING_OP_POLL:
+				if ((e = nsreactor_findid(r, id)))
+				{
+					if (res > 0)
+						e->e_fn(e->e_owner);
+					if (!more && res != -EINVAL)
+						nsuring_arm(r, e);
+				}
+				break;
+			case URING_OP_RECV:
+				e = nsreactor_findid(r, id);
+				if (flags & IORING_CQE_F_BUFFER)
+				{
+					int bid = flags >> IORING_CQE_BUFFER_SHIFT;
+					if (e && res > 0)
+						nsuring_recvmsg(e, u->u_recvbufs + (size_t)bid * URING_RECV_BUFSIZE, res);
+					nsuring_putbuf(u, bid);
+				}
+				/* the kernel ends multishot receives now and then (e.g.
+				   out of buffers), keep them armed */
+				if (e && !more && res != -EINVAL)
+					nsuring_arm(r, e);
+				break;
+			case URING_OP_SEND:
+			{
+				t_nssendbuf *b = &u->u_send[id];
+				if (res < 0 && res != -EAGAIN && res != -ENOBUFS && b->b_err)
+					*b->b_err = -res;
+				/* zero copy sends complete twice, the buffer is free
+				   with the notification */
+				if (!more)
+				{
+					b->b_busy = 0;
+					b->b_owner = 0;
+					b->b_err = 0;
+					if (u->u_sendblocked)
+					{
+						u->u_sendblocked = 0;
+						flush = 1;
+					}
+				}
+				break;
+			}
+			default:
+				break;
+		}
+	}
+	if (flush)
+		nsreactor_runflush(r);
+	return (n);
+}
+
+
+static void *nsreactor_uringthread(void *zz)
+{
+	t_nsreactor *r = (t_nsreactor *)zz;
+	t_nsuring *u = r->r_uring;
+	unsigned long long spinuntil = 0;
+
+	pthread_mutex_lock(&r->r_mutex);
+	nsuring_armwake(r);
+	nsuring_submit(u);
+	pthread_mutex_unlock(&r->r_mutex);
+	while (!NS_LOAD_ACQUIRE(&r->r_quit))
+	{
+		if (spinuntil && nsreactor_now() < spinuntil)
+		{
+			/* busy polling: watch the completion ring, no syscall */
+			if (*u->u_cqhead == __atomic_load_n(u->u_cqtail, __ATOMIC_ACQUIRE))
+				continue;
+		}
+		else if (nsuring_enter(u->u_fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 &&
+			 errno != EINTR && errno != EAGAIN && errno != EBUSY)
+			break;
+		reactorwaketime = nsreactor_now();
+		/* everything the callbacks queue goes out with one submission */
+		pthread_mutex_lock(&r->r_mutex);
+		if (nsuring_reap(r))
+			spinuntil = nsreactor_spinuntil();
+		nsuring_submit(u);
+		pthread_mutex_unlock(&r->r_mutex);
+	}
+	return (0);
+}
+
+#endif /* HAVE_IO_URING */
+
+
+static t_nsreactor *nsreactor_new(int backend)
+{
+	t_nsreactor *r = (t_nsreactor *)calloc(1, sizeof(t_nsreactor));
+	struct epoll_event ev;
+
+	if (!r)
+		return (0);
+	r->r_epfd = -1;
+	r->r_wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (r->r_wakefd < 0)
+		goto fail;
+#ifdef HAVE_IO_URING
+	if (backend == NSREACTOR_URING && (r->r_uring = nsuring_new()))
+		r->r_backend = NSREACTOR_URING;
+	else
+#endif
+	{
+		r->r_backend = NSREACTOR_EPOLL;
+		if ((r->r_epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+			goto fail;
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.fd = r->r_wakefd;
+		if (epoll_ctl(r->r_epfd, EPOLL_CTL_ADD, r->r_wakefd, &ev) < 0)
+			goto fail;
+	}
+	pthread_mutex_init(&r->r_mutex, 0);
+	if (pthread_create(&r->r_thread, 0,
+#ifdef HAVE_IO_URING
+			   r->r_uring ? nsreactor_uringthread :
+#endif
+			   nsreactor_thread, r))
+	{
+		pthread_mutex_destroy(&r->r_mutex);
+		goto fail;
+	}
+	return (r);
+
+fail:
+#ifdef HAVE_IO_URING
+	if (r->r_uring)
+		nsuring_free(r->r_uring);
+#endif
+	if (r->r_epfd >= 0)
+		close(r->r_epfd);
+	if (r->r_wakefd >= 0)
+		close(r->r_wakefd);
+	free(r);
+	return (0);
+}
+
+
+/* affinity and priority of thread index, called with reactors_mutex held */
+static int nsreactor_sched(t_nsreactor *r, int index)
+{
+	struct sched_param param;
+	cpu_set_t set;
+	int err, err2;
+
+	if (reactorcpu >= 0)
+	{
+		long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+		CPU_ZERO(&set);
+		CPU_SET((reactorcpu + index) % (ncpu > 0 && ncpu < CPU_SETSIZE ? ncpu : CPU_SETSIZE), &set);
+	}
+	else if (sched_getaffinity(0, sizeof(set), &set) < 0)	/* the cpus pd may use */
+		return (errno);
+	err = pthread_setaffinity_np(r->r_thread, sizeof(set), &set);
+
+	memset(&param, 0, sizeof(param));
+	param.sched_priority = reactorpriority;
+	err2 = pthread_setschedparam(r->r_thread, reactorpriority > 0 ? SCHED_FIFO : SCHED_OTHER, &param);
+	return (err ? err : err2);
+}
+
+
+static int nsreactor_schedall(void)
+{
+	int i, err = 0;
+
+	for (i = 0; i < MAX_REACTOR_THREADS; i++)
+	{
+		int e;
+		if (reactors[i] && (e = nsreactor_sched(reactors[i], i)) && !err)
+			err = e;
+	}
+	return (err);
+}
+
+
+int nsreactor_setaffinity(int cpu)
+{
+	int err;
+
+	pthread_mutex_lock(&reactors_mutex);
+	reactorcpu = cpu < 0 ? -1 : cpu;
+	err = nsreactor_schedall();
+	pthread_mutex_unlock(&reactors_mutex);
+	return (err);
+}
+
+
+int nsreactor_setpriority(int priority)
+{
+	int err;
+
+	if (priority < 0)
+		priority = 0;
+	if (priority > sched_get_priority_max(SCHED_FIFO))
+		priority = sched_get_priority_max(SCHED_FIFO);
+	pthread_mutex_lock(&reactors_mutex);
+	reactorpriority = priority;
+	err = nsreactor_schedall();
+	pthread_mutex_unlock(&reactors_mutex);
+	return (err);
+}
+
+
+void nsreactor_setbusypoll(int usec)
+{
+	if (usec < 0)
+		usec = 0;
+	if (usec > MAX_BUSY_POLL)
+		usec = MAX_BUSY_POLL;
+	NS_STORE_RELEASE(&reactorbusypoll, usec);
+	/* sleeping threads pick it up with their next events */
+}
+
+
+int nsreactor_getbusypoll(void)
+{
+	return (NS_LOAD_ACQUIRE(&reactorbusypoll));
+}
+
+
+/* threads only go away once their last entry is detached */
+static void nsreactor_free(t_nsreactor *r)
+{
+	NS_STORE_RELEASE(&r->r_quit, 1);
+	nsreactor_wakeup(r);
+	pthread_join(r->r_thread, 0);
+#ifdef HAVE_IO_URING
+	if (r->r_uring)
+		nsuring_free(r->r_uring);
+#endif
+	if (r->r_epfd >= 0)
+		close(r->r_epfd);
+	close(r->r_wakefd);
+	pthread_mutex_destroy(&r->r_mutex);
+	free(r->r_entries);
+	free(r);
+}
+
+
+static int nsreactor_busy(t_nsreactor *r)
+{
+	int busy;
+
+	pthread_mutex_lock(&r->r_mutex);
+	busy = r->r_nentries > 0;
+	pthread_mutex_unlock(&r->r_mutex);
+	return (busy);
+}
+
+
+/* called with reactors_mutex held */
+static void nsreactor_cleanup(void)
+{
+	t_nsreactor **rp = &retired;
+
+	while (*rp)
+	{
+		t_nsreactor *r = *rp;
+		if (nsreactor_busy(r))
+			rp = &r->r_next;
+		else
+		{
+			*rp = r->r_next;
+			nsreactor_free(r);
+		}
+	}
+}
+
+
+int nsreactor_setthreads(int n, int backend)
+{
+	int i;
+
+	if (n < 0)
+		n = 0;
+	if (n > MAX_REACTOR_THREADS)
+		n = MAX_REACTOR_THREADS;
+	pthread_mutex_lock(&reactors_mutex);
+	/* threads of the other backend retire, they keep serving their
+	   entries until those are detached */
+	if (backend != reactorbackend)
+	{
+		for (i = 0; i < MAX_REACTOR_THREADS; i++)
+			if (reactors[i])
+			{
+				reactors[i]->r_next = retired;
+				retired = reactors[i];
+				reactors[i] = 0;
+			}
+		reactorbackend = backend;
+	}
+	/* existing threads keep serving their entries, new entries go to
+	   the first n threads */
+	for (i = 0; i < n; i++)
+	{
+		if (reactors[i])
+			continue;
+		if (!(reactors[i] = nsreactor_new(backend)))
+			break;
+		if (reactorcpu >= 0 || reactorpriority)
+			nsreactor_sched(reactors[i], i);
+	}
+	nreactors = i;
+	for (i = nreactors; i < MAX_REACTOR_THREADS; i++)
+	{
+		if (reactors[i] && !nsreactor_busy(reactors[i]))
+		{
+			nsreactor_free(reactors[i]);
+			reactors[i] = 0;
+		}
+	}
+	nsreactor_cleanup();
+	n = nreactors;
+	pthread_mutex_unlock(&reactors_mutex);
+	return (n);
+}
+
+
+int nsreactor_getthreads(void)
+{
+	return (nreactors);
+}
+
+
+/* what the threads really run, io_uring may have fallen back to epoll */
+int nsreactor_getbackend(void)
+{
+	int backend;
+
+	pthread_mutex_lock(&reactors_mutex);
+	backend = nreactors ? reactors[0]->r_backend : reactorbackend;
+	pthread_mutex_unlock(&reactors_mutex);
+	return (backend);
+}
+
+
+t_nsreactor *nsreactor_attach(int fd, t_nsreactor_fn fn, t_nsreactor_recvfn recvfn, void *owner)
+{
+	t_nsreactor *r;
+	t_nsentry *e;
+
+	pthread_mutex_lock(&reactors_mutex);
+	if (!nreactors)
+	{
+		pthread_mutex_unlock(&reactors_mutex);
+		return (0);
+	}
+	r = reactors[nextreactor++ % nreactors];
+	pthread_mutex_unlock(&reactors_mutex);
+
+	pthread_mutex_lock(&r->r_mutex);
+	if (r->r_nentries == r->r_size)
+	{
+		int size = r->r_size ? 2 * r->r_size : 16;
+		t_nsentry *entries = (t_nsentry *)realloc(r->r_entries, size * sizeof(t_nsentry));
+		if (!entries)
+		{
+			pthread_mutex_unlock(&r->r_mutex);
+			return (0);
+		}
+		r->r_entries = entries;
+		r->r_size = size;
+	}
+	if (fd >= 0 && r->r_epfd >= 0)
+	{
+		struct epoll_event ev;
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.fd = fd;
+		if (epoll_ctl(r->r_epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+		{
+			pthread_mutex_unlock(&r->r_mutex);
+			return (0);
+		}
+	}
+	e = &r->r_entries[r->r_nentries++];
+	e->e_fd = fd;
+	e->e_id = r->r_nextid++;
+	e->e_fn = fn;
+	e->e_recvfn = recvfn;
+	e->e_owner = owner;
+#ifdef HAVE_IO_URING
+	if (fd >= 0 && r->r_uring)
+	{
+		nsuring_arm(r, e);
+		nsuring_submit(r->r_uring);
+	}
+#endif
+	pthread_mutex_unlock(&r->r_mutex);
+	return (r);
+}
+
+
+void nsreactor_detach(t_nsreactor *r, int fd, void *owner)
+{
+	int i;
+
+	if (!r)
+		return;
+	pthread_mutex_lock(&r->r_mutex);
+	for (i = 0; i < r->r_nentries; i++)
+		if (r->r_entries[i].e_fd == fd && r->r_entries[i].e_owner == owner)
+		{
+#ifdef HAVE_IO_URING
+			/* completions still in flight find no entry and are dropped */
+			if (r->r_uring && fd >= 0)
+			{
+				nsuring_cancel(r, &r->r_entries[i]);
+				nsuring_submit(r->r_uring);
+			}
+#endif
+			if (fd >= 0 && r->r_epfd >= 0)
+				epoll_ctl(r->r_epfd, EPOLL_CTL_DEL, fd, 0);
+			r->r_entries[i] = r->r_entries[--r->r_nentries];
+			break;
+		}
+#ifdef HAVE_IO_URING
+	if (r->r_uring)
+		for (i = 0; i < URING_SEND_BUFFERS; i++)
+			if (r->r_uring->u_send[i].b_owner == owner)
+				r->r_uring->u_send[i].b_err = 0;
+#endif
+	pthread_mutex_unlock(&r->r_mutex);
+
+	pthread_mutex_lock(&reactors_mutex);
+	nsreactor_cleanup();
+	pthread_mutex_unlock(&reactors_mutex);
+}
+
+
+void nsreactor_wakeup(t_nsreactor *r)
+{
+	uint64_t one = 1;
+
+	if (r)
+	{
+		ssize_t put = write(r->r_wakefd, &one, sizeof(one));
+		(void)put;	/* < 0: counter full, the thread is awake anyway */
+	}
+}
+
+
+int nsreactor_send(t_nsreactor *r, int fd, const struct iovec *iov, int iovcnt, void *owner, int *err)
+{
+	struct msghdr msg;
+	int i, len = 0;
+
+	for (i = 0; i < iovcnt; i++)
+		len += iov[i].iov_len;
+#ifdef HAVE_IO_URING
+	if (r->r_uring)
+	{
+		t_nsuring *u = r->r_uring;
+		struct io_uring_sqe *sqe;
+		char *buf;
+		int k;
+
+		if (len > NSREACTOR_BUFFER_SIZE)
+		{
+			*err = EMSGSIZE;
+			return (0);
+		}
+		for (i = 0; i < URING_SEND_BUFFERS && u->u_send[i].b_busy; i++)
+			;
+		if (i == URING_SEND_BUFFERS || !(sqe = nsuring_getsqe(u)))
+		{
+			u->u_sendblocked = 1;
+			return (-1);
+		}
+		buf = u->u_sendbufs + (size_t)i * NSREACTOR_BUFFER_SIZE;
+		for (k = 0; k < iovcnt; buf += iov[k].iov_len, k++)
+			memcpy(buf, iov[k].iov_base, iov[k].iov_len);
+		sqe->fd = fd;
+		sqe->addr = (uint64_t)(uintptr_t)(u->u_sendbufs + (size_t)i * NSREACTOR_BUFFER_SIZE);
+		sqe->len = len;
+		sqe->msg_flags = MSG_NOSIGNAL;
+		sqe->user_data = URING_DATA(URING_OP_SEND, i);
+		if (u->u_zerocopy)
+		{
+			sqe->opcode = IORING_OP_SEND_ZC;
+			sqe->ioprio = IORING_RECVSEND_FIXED_BUF;
+			sqe->buf_index = i;
+		}
+		else
+			sqe->opcode = IORING_OP_SEND;
+		u->u_send[i].b_busy = 1;
+		u->u_send[i].b_owner = owner;
+		u->u_send[i].b_err = err;
+		nsuring_push(u);
+		return (0);
+	}
+#endif
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = (struct iovec *)iov;
+	msg.msg_iovlen = iovcnt;
+	if (sendmsg(fd, &msg, MSG_NOSIGNAL) <= 0 &&
+	    errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS)
+		*err = errno;
+	return (0);
+}
+
+#else /* __linux__ */
+
+/* no epoll: objects fall back to their own I/O */
+
+int nsreactor_setthreads(int n, int backend)
+{
+	return (0);
+}
+
+int nsreactor_getthreads(void)
+{
+	return (0);
+}
+
+int nsreactor_getbackend(void)
+{
+	return (NSREACTOR_EPOLL);
+}
+
+t_nsreactor *nsreactor_attach(int fd, t_nsreactor_fn fn, t_nsreactor_recvfn recvfn, void *owner)
+{
+	return (0);
+}
+
+void nsreactor_detach(t_nsreactor *r, int fd, void *owner)
+{
+}
+
+void nsreactor_wakeup(t_nsreactor *r)
+{
+}
+
+int nsreactor_send(t_nsreactor *r, int fd, const struct iovec *iov, int iovcnt, void *owner, int *err)
+{
+	return (0);
+}
+
+int nsreactor_setaffinity(int cpu)
+{
+	return (cpu < 0 ? 0 : ENOSYS);
+}
+
+int nsreactor_setpriority(int priority)
+{
+	return (priority <= 0 ? 0 : ENOSYS);
+}
+
+void nsreactor_setbusypoll(int usec)
+{
+}
+
+int nsreactor_getbusypoll(void)
+{
+	return (0);
+}
+
+unsigned long long nsreactor_waketime(void)
+{
+	return (0);
+}
+
+#endif /* __linux__ */
+
+
+unsigned long long nsreactor_now(void)
+{
+#ifdef _WIN32
+	return ((unsigned long long)GetTickCount64() * 1000000ULL);
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+#endif
+}
+
+
+/* the kernel stamps with the wall clock, which may step. only the age of
+   the datagram is taken from it, a step between receive and read aside */
+unsigned long long nsreactor_rxstamp(struct msghdr *msg)
+{
+	unsigned long long now = nsreactor_now();
+#ifdef SCM_TIMESTAMPNS
+	struct cmsghdr *cm;
+
+	for (cm = CMSG_FIRSTHDR(msg); cm; cm = CMSG_NXTHDR(msg, cm))
+		if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_TIMESTAMPNS)
+		{
+			struct timespec ts, wall;
+			long long age;
+
+			memcpy(&ts, CMSG_DATA(cm), sizeof(ts));
+			clock_gettime(CLOCK_REALTIME, &wall);
+			age = (long long)(wall.tv_sec - ts.tv_sec) * 1000000000LL + (wall.tv_nsec - ts.tv_nsec);
+			if (age > 0 && (unsigned long long)age < now)
+				now -= age;
+			break;
+		}
+#endif
+	return (now);
+}
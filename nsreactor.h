@@ -0,0 +1,108 @@
+/* ------------------------ nsreactor ----------------------------------------- */
+/*                                                                              */
+/* Shared I/O threads for nstream~ and nsreceive~: a small number of epoll      */
+/* threads serve the sockets and send queues of every object of the process.   */
+/*                                                                              */
+/* This program is free software; you can redistribute it and/or                */
+/* modify it under the terms of the GNU General Public License                  */
+/* as published by the Free Software Foundation; either version 2               */
+/* of the License, or (at your option) any later version.                       */
+/*                                                                              */
+/* See file LICENSE for further informations on licensing terms.                */
+/*                                                                              */
+/* This program is distributed in the hope that it will be useful,              */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of               */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                */
+/* GNU General Public License for more details.                                 */
+/*                                                                              */
+/* ---------------------------------------------------------------------------- */
+
+#ifndef NSREACTOR_H
+#define NSREACTOR_H
+
+#define DEFAULT_REACTOR_THREADS 1       /* I/O threads started by "reactor" without argument */
+#define MAX_REACTOR_THREADS 8
+
+#define NSREACTOR_EPOLL 0               /* readiness: the callbacks do the syscalls */
+#define NSREACTOR_URING 1               /* io_uring: multishot receives, batched sends */
+
+#define NSREACTOR_BUFFER_SIZE 65536     /* largest datagram the io_uring backend moves */
+#define MAX_BUSY_POLL 100000            /* usec, longest spin budget of "busypoll" */
+
+typedef struct _nsreactor t_nsreactor;
+struct sockaddr_in;
+struct iovec;
+struct msghdr;
+
+/* called from a reactor thread when fd is readable, or on every wakeup
+   for flush entries (fd -1). never call pd functions from there */
+typedef void (*t_nsreactor_fn)(void *owner);
+
+/* io_uring backend: called with each datagram received on fd and its
+   arrival time (see nsreactor_rxstamp) */
+typedef void (*t_nsreactor_recvfn)(void *owner, char *data, int len, struct sockaddr_in *from,
+				   unsigned long long stamp);
+
+/* number of threads, 0 disables the reactor. backend applies to threads
+   created from now on, NSREACTOR_URING falls back to epoll when the
+   kernel or the build lacks io_uring. returns the new count */
+int nsreactor_setthreads(int n, int backend);
+int nsreactor_getthreads(void);
+int nsreactor_getbackend(void);
+
+/* pin thread i to cpu + i, -1 lets the threads run anywhere again.
+   applies to running threads and those started later. returns 0 or an
+   errno value */
+int nsreactor_setaffinity(int cpu);
+
+/* run the threads SCHED_FIFO at priority (1-99, needs CAP_SYS_NICE or an
+   rtprio limit), 0 goes back to normal scheduling. returns 0 or errno */
+int nsreactor_setpriority(int priority);
+
+/* after serving events a thread keeps polling for usec without sleeping,
+   0 sleeps at once */
+void nsreactor_setbusypoll(int usec);
+int nsreactor_getbusypoll(void);
+
+/* CLOCK_MONOTONIC in ns */
+unsigned long long nsreactor_now(void);
+
+/* when the kernel received the datagram of msg (SO_TIMESTAMPNS on the
+   socket), moved to nsreactor_now() time. nsreactor_now() when msg
+   carries no timestamp */
+unsigned long long nsreactor_rxstamp(struct msghdr *msg);
+
+/* when the calling reactor thread last found events, 0 outside of one */
+unsigned long long nsreactor_waketime(void);
+
+/* register fd (or -1 for a flush entry) with one of the threads, NULL
+   when the reactor is disabled or not supported on this system. recvfn
+   may be NULL, the io_uring backend then only reports readiness via fn */
+t_nsreactor *nsreactor_attach(int fd, t_nsreactor_fn fn, t_nsreactor_recvfn recvfn, void *owner);
+
+/* unregister, when it returns fn is not running and won't be called again */
+void nsreactor_detach(t_nsreactor *r, int fd, void *owner);
+
+/* run the flush entries of r, safe to call from the DSP thread */
+void nsreactor_wakeup(t_nsreactor *r);
+
+/* from a flush entry: send the iovcnt pieces in iov as one sendmsg on fd.
+   with io_uring they are gathered into a registered buffer and sent with
+   the next submission. returns
+   -1 when no buffer is free, the entry is flushed again once one is.
+   send errors are stored in *err, unless owner was detached by then */
+int nsreactor_send(t_nsreactor *r, int fd, const struct iovec *iov, int iovcnt, void *owner, int *err);
+
+
+/* single producer / single consumer ring indices shared between the DSP
+   thread and a reactor thread */
+#define NS_LOAD_ACQUIRE(p)      __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define NS_STORE_RELEASE(p, v)  __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+/* sequentially consistent, for handshakes where a store has to be visible
+   before a following load of another variable */
+#define NS_LOAD_SEQ(p)          __atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define NS_STORE_SEQ(p, v)      __atomic_store_n((p), (v), __ATOMIC_SEQ_CST)
+#define NS_EXCHANGE(p, v)       __atomic_exchange_n((p), (v), __ATOMIC_SEQ_CST)
+
+#endif /* NSREACTOR_H */
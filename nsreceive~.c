@@ -29,6 +29,10 @@
 /* ---------------------------------------------------------------------------- */
 
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE	/* recvmmsg() */
+#endif
+
 #ifdef PD
 #include "m_pd.h"
 
@@ -42,6 +46,14 @@
 #endif
 
 #include "nstream~.h"
+#include "nsreactor.h"
+#include "nsshm.h"
+#include "nshist.h"
+#include "nstrace.h"
+#include "nslog.h"
+#include "nsmetrics.h"
+#include "nskernel.h"
+#include "nsresample.h"
 
 
 
@@ -52,6 +64,7 @@
 #include <errno.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <netinet/udp.h>
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <sys/time.h>
@@ -76,6 +89,20 @@
 #define DEFAULT_AVERAGE_NUMBER 10		/* number of values we store for average history */
 #define DEFAULT_NETWORK_POLLTIME 1		/* interval in ms for polling for input data (Max/MSP only) */
 #define DEFAULT_QUEUE_LENGTH 3			/* min. number of buffers that can be used reliably on your hardware */
+#define DEFAULT_MCAST_GROUPS 8			/* max. number of multicast memberships per receiver */
+#define DEFAULT_MAX_SOURCES 16			/* max. number of senders per receiver */
+#define DEFAULT_SOURCE_TIMEOUT 1000		/* ms without data before a sender's slot is released */
+#define DEFAULT_RECV_BATCH 16			/* max. number of datagrams read per poll */
+#define DEFAULT_GRO_BATCH 4			/* coalesced reads per poll with UDP_GRO */
+#define DEFAULT_GRO_SIZE 65536			/* one coalesced read, several datagrams */
+#define DEFAULT_PORT_GROUPS 64			/* max. number of multicast memberships per port */
+#define DEFAULT_INBOX_FRAMES 8			/* frames queued by a reactor thread for the DSP thread */
+
+#if defined(__linux__) && defined(MSG_WAITFORONE)
+#define HAVE_RECVMMSG
+/* control messages of one read: receive timestamp and UDP_GRO segment size */
+#define NSRECEIVE_CONTROL_SIZE (CMSG_SPACE(sizeof(struct timespec)) + CMSG_SPACE(sizeof(int)))
+#endif
 
 
 #ifndef _WINDOWS
@@ -124,6 +151,45 @@ static int nsreceive_tilde_sockerror(char *s)
 /* ------------------------ nsreceive~ ----------------------------- */
 
 
+/* multicast membership, source.s_addr is INADDR_ANY for any-source groups */
+typedef struct _mcastgroup
+{
+	struct in_addr group;
+	struct in_addr source;
+} t_mcastgroup;
+
+
+/* what the hot paths report through x_log instead of posting */
+#define NSRECEIVE_LOG_FORMAT 0
+#define NSRECEIVE_LOG_MP3 1
+#define NSRECEIVE_LOG_CHANNELS 2
+#define NSRECEIVE_LOG_ORDER 3
+#define NSRECEIVE_LOG_SHORT 4
+#define NSRECEIVE_LOG_BLOCKSIZE 5
+#define NSRECEIVE_LOG_FRAMESIZE 6
+#define NSRECEIVE_LOG_VECSIZE 7
+#define NSRECEIVE_LOG_SOURCE 8
+#define NSRECEIVE_LOG_TIMEOUT 9
+#define NSRECEIVE_LOG_SAMPLERATE 10
+#define NSRECEIVE_LOG_RATIO 11
+
+static const t_nslogcategory nsreceive_tilde_log_categories[] =
+{
+	{ "format", "unknown format (%d)", 0 },
+	{ "mp3", "mp3 format not supported", 0 },
+	{ "channels", "incoming stream has too many channels (%d)", 1 },
+	{ "order", "out of order data received (packet %d)", 0 },
+	{ "short", "got incomplete header tag (%d bytes)", 1 },
+	{ "blocksize", "incoming blocksize changed to %d", 0 },
+	{ "framesize", "receiving framesize too large: %d bytes", 0 },
+	{ "vecsize", "signal vector size changed to %d", 0 },
+	{ "source", "new source in slot %d", 0 },
+	{ "timeout", "source in slot %d timed out", 0 },
+	{ "samplerate", "incoming samplerate changed to %d", 0 },
+	{ "ratio", "can't convert from samplerate %d, played as is", 1 },
+};
+
+
 static t_class *nsreceive_tilde_class;
 static t_symbol *ps_format, *ps_channels, *ps_framesize, *ps_overflow, *ps_underflow,
                 *ps_queuesize, *ps_average, *ps_sf_float, *ps_sf_16bit, *ps_sf_8bit, 
@@ -135,7 +201,110 @@ static t_symbol  *ps_datathrp;
 static t_symbol  *ps_avlosses;
 static t_symbol  *ps_losses;
 static t_symbol  *ps_jitter;
+static t_symbol  *ps_interarrival;
+static t_symbol  *ps_arrivaltime, *ps_depth, *ps_latency, *ps_bucket;
 static t_symbol  *ps_blocksize;
+static t_symbol  *ps_source;
+
+
+struct _nsreceive_tilde;
+
+/* a frame the sender split into several datagrams, being put together */
+typedef struct _nspartial
+{
+	struct sockaddr_in f_from;
+	char f_streamid;
+	short f_count;
+	int f_bytes;                /* 0: slot unused */
+	int f_nfrag;                /* datagrams the frame was cut into */
+	int f_chunk;                /* payload of each but the last */
+	unsigned long long f_have;  /* bit k: datagram k is in */
+	t_frame *f_frame;
+} t_nspartial;
+
+
+/* one socket per UDP port, shared by every nsreceive~ listening on it.
+   datagrams are routed to the receivers by the streamid of their header */
+typedef struct _nsport
+{
+	int p_fd;
+	int p_portno;
+	struct _nsreceive_tilde *p_receivers;	/* linked through x_nextonport */
+	t_mcastgroup p_groups[DEFAULT_PORT_GROUPS];
+	int p_grouprefs[DEFAULT_PORT_GROUPS];	/* receivers using each membership */
+	int p_ngroups;
+	t_frame *p_batch[DEFAULT_RECV_BATCH];	/* frames the datagrams are read into */
+	char *p_grobuf;				/* UDP_GRO: coalesced datagrams are read here, then split */
+	t_nspartial p_partials[DEFAULT_MAX_SOURCES];	/* one frame in reassembly per sender */
+	int p_nextpartial;			/* slot taken over when all are in use */
+	int p_incomplete;			/* frames given up with datagrams missing */
+	int p_unrouted;				/* datagrams no receiver wanted */
+	int p_short;				/* datagrams shorter than a header */
+	int p_threaded;				/* served by a reactor thread instead of pd's poll loop */
+	int p_kernelstamps;			/* the kernel stamps arrivals (SO_TIMESTAMPNS) */
+	t_nsreactor *p_reactor;
+	struct _nsport *p_next;
+} t_nsport;
+
+static t_nsport *nsreceive_tilde_ports;
+
+
+/* datagram handed from a reactor thread to the DSP thread. the slot always
+   owns a frame: the producer swaps in a full one, the consumer an empty one */
+typedef struct _nsinbox
+{
+	t_frame *i_frame;
+	int i_len;
+	struct sockaddr_in i_from;
+	unsigned long long i_stamp; /* arrival */
+	unsigned long long i_wake;  /* the reactor thread woke up for it (ns) */
+	unsigned long long i_posted;
+} t_nsinbox;
+
+
+/* per sender state, each source has its own jitter buffer */
+typedef struct _nsource
+{
+	struct sockaddr_in s_from;  /* sender address and port identify the source */
+	int s_active;
+	int s_idle;                 /* DSP ticks without data, the slot is released after x_idlelimit */
+
+	/* buffering */
+	int s_framein;
+	int s_frameout;
+	t_frame *s_frames[DEFAULT_AUDIO_BUFFER_FRAMES];
+	long s_framecount;
+	int s_blocksize;            /* samples per frame of this sender */
+	int s_framepos;             /* samples of s_frames[s_frameout] already played */
+	int s_samplerate;           /* of this sender, 0 if it doesn't tell */
+	int s_decimation;           /* it sends every s_decimation-th sample */
+	t_nsresample *s_resample;   /* to x_samplerate, when s_samplerate or s_decimation differ */
+        //stats
+        long s_blockduration; //in usec
+        long s_jittermin;
+        long s_jittermax;
+      
+        unsigned long long s_datebegin;	/* ns, the clock of the packet stamps */
+        unsigned long long s_lastdate;
+        long s_lastusecdate;
+        int s_lastcounter;
+        int s_lost;
+        int s_lastlost;
+        int s_lastnumber;
+        int s_loopcounter;
+        int s_counter; //count the number of messages received
+	int s_average[DEFAULT_AVERAGE_NUMBER];
+	int s_averagecur;
+	int s_underflow;
+	int s_overflow;
+	unsigned long long s_arrival;   /* monotonic arrival of the last packet, ns */
+	short s_arrivalcount;       /* its frame count */
+	double s_ijitter;           /* interarrival jitter estimate (RFC 3550), ns */
+	unsigned long long s_stamps[DEFAULT_AUDIO_BUFFER_FRAMES];	/* arrival of each queued frame */
+	t_nshist s_harrival;        /* time between packets, ns */
+	t_nshist s_hdepth;          /* frames queued when one starts to play */
+	t_nshist s_hlatency;        /* arrival to playout plus the frame duration, ns */
+} t_nsource;
 
 
 typedef struct _nsreceive_tilde
@@ -151,126 +320,320 @@ typedef struct _nsreceive_tilde
 	void *x_connectpoll;
 	void *x_datapoll;
 #endif
-	int x_socket;
+	int x_socket;               /* socket of x_port */
+	t_nsport *x_port;
+	int x_metricsport;          /* x_port's number, the exporter thread can't follow x_port */
+	struct _nsreceive_tilde *x_nextonport;
+	int x_streamid;             /* only packets with this streamid are ours */
 	int x_connectsocket;
 	int x_nconnections;
-	int x_ndrops;
+	int x_ndrops;               /* packets dropped because all source slots are taken */
 	
         int x_portno;
         t_symbol *x_mcastaddress;
+	t_mcastgroup x_mcastgroup;  /* group joined by connect */
+	int x_mcastjoined;
+	t_symbol *x_mcastif;        /* interface for memberships, ps_nothing for any */
+	t_mcastgroup x_groups[DEFAULT_MCAST_GROUPS];
+	int x_ngroups;
 	t_symbol *x_hostname;
 
+	/* sources */
+	t_nsource *x_sources;
+	int x_nsources;             /* number of source slots */
+	int x_mix;                  /* sum all sources into one set of outlets */
+	t_frame *x_recvframe;       /* spare frame, swapped with the port's batch frames */
+	t_nsinbox *x_inbox;         /* reactor mode: datagrams waiting for perform */
+	int x_inboxhead;            /* written by the reactor thread */
+	int x_inboxtail;            /* written by the DSP thread */
+	int x_inboxdrops;
+	/* reactor latency since the last print, in ns: thread wakeup to the
+	   datagram delivered to our inbox, and inbox to perform */
+	unsigned long long x_wakelat, x_wakelatmax;
+	unsigned long long x_queuelat, x_queuelatmax;
+	int x_latcount;
+	t_sample *x_mixbuf;         /* one vector per channel for the mixer */
+	int x_mixbufsize;
+	int x_idlelimit;            /* DSP ticks without data before a source slot is released */
+
+	/* same-host ring, replaces the port after connect shm:<name> */
+	t_nsshmring *x_shm;
+	unsigned int x_shmpos;      /* next frame to play */
+	int x_shmsync;              /* x_shmpos follows the writer, 2 while refilling */
+	int x_shmunderflows;
+	int x_shmoverruns;
+
+	t_nstrace *x_trace;         /* recent events, "trace dump" writes them out */
+	t_nslog x_log;              /* hot path reports, posted once per interval */
+	t_nsmetrics x_metrics;      /* entry in the exported counters */
+
+#ifdef NSTREAM_PERF
+	t_nshist x_perfperform;     /* ns per call of perform */
+	t_nshist x_perfinbox;       /* taking the reactor's packets into the jitter buffers */
+	t_nshist x_perfdecode;      /* converting the frames to the outlets */
+#endif
+
 	/* buffering */
-	int x_framein;
-	int x_frameout;
-	t_frame x_frames[DEFAULT_AUDIO_BUFFER_FRAMES];
 	int x_maxframes;
-	long x_framecount;
-	int x_blocksize;
-	int x_blocksperrecv;
-	int x_blockssincerecv;
+	t_float x_latency;          /* jitter buffer target in ms, 0: x_maxframes frames */
         int x_lastmallocblocksize;
-        //stats
-        long x_blockduration; //in usec
         long x_loopduration;
-        long x_jittermin;
-        long x_jittermax;
-      
-        long x_datebegin;  
-        long x_lastdate;
-        long x_lastusecdate;
-        int x_lastcounter;
-        int x_lost;
-        int x_lastlost;
-        int x_lastnumber;
-        int x_loopcounter;
-        int x_counter; //count the number of messages received
-	int x_average[DEFAULT_AVERAGE_NUMBER];
-	int x_averagecur;
-	int x_underflow;
-	int x_overflow;
 
 
 	long x_samplerate;
-	int x_noutlets;
+	int x_noutlets;             /* channels per source */
+	int x_nsignals;             /* signal outlets: x_noutlets per source, or x_noutlets when mixing */
 	int x_vecsize;
 	t_int **x_myvec;            /* vector we pass on to the DSP routine */
 } t_nsreceive_tilde;
 
 
 
-static int nsreceive_tilde_setsocketoptions(t_nsreceive_tilde *x, int sockfd)
+/* resolve a host name or dotted address */
+static int nsreceive_tilde_getaddr(t_symbol *host, struct in_addr *addr)
+{
+	struct hostent *hp;
+
+	if ((hp = gethostbyname(host->s_name)) == (struct hostent *)0)
+		return 0;
+	memcpy((char *)addr, (char *)hp->h_addr, sizeof(struct in_addr));
+	return 1;
+}
+
+
+/* add or drop a membership on sockfd. source-specific memberships (IGMPv3)
+   make the kernel discard packets from other senders before we see them */
+static int nsreceive_tilde_membership(t_nsreceive_tilde *x, int sockfd, t_mcastgroup *g, int add)
+{
+	struct in_addr ifaddr;
+
+	ifaddr.s_addr = htonl(INADDR_ANY);
+	if (x->x_mcastif != ps_nothing && !nsreceive_tilde_getaddr(x->x_mcastif, &ifaddr))
+		post("nsreceive~: bad multicast interface %s, using any", x->x_mcastif->s_name);
+
+	if (g->source.s_addr != htonl(INADDR_ANY))
+	{
+#ifdef IP_ADD_SOURCE_MEMBERSHIP
+		struct ip_mreq_source mreqs;
+
+		memset(&mreqs, 0, sizeof(mreqs));
+		mreqs.imr_multiaddr = g->group;
+		mreqs.imr_sourceaddr = g->source;
+		mreqs.imr_interface = ifaddr;
+		if (setsockopt(sockfd, IPPROTO_IP, add ? IP_ADD_SOURCE_MEMBERSHIP : IP_DROP_SOURCE_MEMBERSHIP,
+			       (const char*)&mreqs, sizeof(mreqs)) == -1)
+		{
+			nsreceive_tilde_sockerror("setsockopt source multicast");
+			return 0;
+		}
+		return 1;
+#else
+		error("nsreceive~: source-specific multicast not supported on this system");
+		return 0;
+#endif
+	}
+	else
+	{
+		struct ip_mreq mreq;
+
+		memset(&mreq, 0, sizeof(mreq));
+		mreq.imr_multiaddr = g->group;
+		mreq.imr_interface = ifaddr;
+		if (setsockopt(sockfd, IPPROTO_IP, add ? IP_ADD_MEMBERSHIP : IP_DROP_MEMBERSHIP,
+			       (const char*)&mreq, sizeof(mreq)) == -1)
+		{
+			nsreceive_tilde_sockerror("setsockopt multicast");
+			return 0;
+		}
+		return 1;
+	}
+}
+
+
+static int nsreceive_tilde_setsocketoptions(int sockfd)
 { 
- 
-  
-  if(x->x_mcastaddress != ps_localhost)
-    {
- 
-      struct sockaddr_in sockaddr_group;
-      struct hostent *group;
-      struct ip_mreq mreq;
-      
-      bzero(&mreq,sizeof(struct ip_mreq));
- 
-      
-      // set group
-      
-      if ((group = gethostbyname(x->x_mcastaddress->s_name))==(struct hostent *)0) {
-	nsreceive_tilde_sockerror("gethostbyname multicast");
-	return (0);
-      }
+  int sockopt = 1;    
+
+  /* other programs may listen to the same group and port */
+  if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, (const char*)&sockopt, sizeof(int)) < 0)
+    post("nsreceive~: setsockopt REUSEADDR failed");
+
+#ifdef IP_MULTICAST_ALL
+  /* only deliver the groups joined on this socket, not every group
+     joined on the host for our port */
+  sockopt = 0;
+  if (setsockopt(sockfd, IPPROTO_IP, IP_MULTICAST_ALL, (const char*)&sockopt, sizeof(int)) < 0)
+    post("nsreceive~: setsockopt IP_MULTICAST_ALL failed");
+#endif
 
-      
-      struct in_addr ia;
-      bcopy((void*)group->h_addr,
-	    (void*)&ia,
-	    group->h_length); 
-      bcopy(&ia,
-	    &mreq.imr_multiaddr.s_addr,
-	    sizeof(struct in_addr));
+#ifdef O_NONBLOCK
+  /* the poll function reads until the socket is empty */
+  fcntl(sockfd, F_SETFL, O_NONBLOCK);
+#endif
+  return 1;
+}
 
-      
-      // set interface
-      
-      mreq.imr_interface.s_addr = htonl(INADDR_ANY);
 
-      
-      // do membership call
-      
-      if (setsockopt(sockfd,
-		     IPPROTO_IP,
-		     IP_ADD_MEMBERSHIP,
-		     &mreq,
-		     sizeof(struct ip_mreq)) 
-	  == -1) {
-	nsreceive_tilde_sockerror("setsockopt multicast"); 
-	  return(0);
-      }
- 
-      
-      
-    }
-  else
-    {
- 
-      int sockopt = 1;
-      if (setsockopt(sockfd, SOL_IP, TCP_NODELAY, (const char*)&sockopt, sizeof(int)) < 0)
-	post("setsockopt NODELAY failed");
-      
-      sockopt = 1;    
-      if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, (const char*)&sockopt, sizeof(int)) < 0)
-	post("nsreceive~: setsockopt REUSEADDR failed");
-      
+/* add or drop a membership of x on its port. the port socket is shared,
+   so a membership is only dropped when its last receiver leaves */
+static int nsreceive_tilde_portmembership(t_nsreceive_tilde *x, t_mcastgroup *g, int add)
+{
+	t_nsport *p = x->x_port;
+	int i;
 
-      
-    }
- 
-  
+	if (!p)
+		return 1;
+	for (i = 0; i < p->p_ngroups; i++)
+		if (p->p_groups[i].group.s_addr == g->group.s_addr && p->p_groups[i].source.s_addr == g->source.s_addr)
+			break;
+	if (add)
+	{
+		if (i < p->p_ngroups)
+		{
+			p->p_grouprefs[i]++;
+			return 1;
+		}
+		if (p->p_ngroups >= DEFAULT_PORT_GROUPS)
+		{
+			error("nsreceive~: too many groups on port %d (max. %d)", p->p_portno, DEFAULT_PORT_GROUPS);
+			return 0;
+		}
+		if (!nsreceive_tilde_membership(x, p->p_fd, g, 1))
+			return 0;
+		p->p_groups[p->p_ngroups] = *g;
+		p->p_grouprefs[p->p_ngroups++] = 1;
+		return 1;
+	}
+	if (i == p->p_ngroups)
+		return 0;
+	if (--p->p_grouprefs[i] == 0)
+	{
+		nsreceive_tilde_membership(x, p->p_fd, g, 0);
+		p->p_ngroups--;
+		p->p_groups[i] = p->p_groups[p->p_ngroups];
+		p->p_grouprefs[i] = p->p_grouprefs[p->p_ngroups];
+	}
+	return 1;
+}
+
+
+/* join the group given to connect and the ones added with join */
+static void nsreceive_tilde_joinall(t_nsreceive_tilde *x)
+{
+	int i;
+
+	x->x_mcastjoined = 0;
+	if (x->x_mcastaddress != ps_localhost)
+	{
+		if (!nsreceive_tilde_getaddr(x->x_mcastaddress, &x->x_mcastgroup.group))
+		{
+			nsreceive_tilde_sockerror("gethostbyname multicast");
+		}
+		else
+		{
+			x->x_mcastgroup.source.s_addr = htonl(INADDR_ANY);
+			x->x_mcastjoined = nsreceive_tilde_portmembership(x, &x->x_mcastgroup, 1);
+		}
+	}
+
+	/* memberships added at runtime survive a reconnect */
+	for (i = 0; i < x->x_ngroups; i++)
+		nsreceive_tilde_portmembership(x, &x->x_groups[i], 1);
+}
+
+
+static void nsreceive_tilde_leaveall(t_nsreceive_tilde *x)
+{
+	int i;
+
+	if (x->x_mcastjoined)
+		nsreceive_tilde_portmembership(x, &x->x_mcastgroup, 0);
+	x->x_mcastjoined = 0;
+	for (i = 0; i < x->x_ngroups; i++)
+		nsreceive_tilde_portmembership(x, &x->x_groups[i], 0);
+}
+
+
+
+static void nsreceive_tilde_join(t_nsreceive_tilde *x, t_symbol *group, t_symbol *source)
+{
+	t_mcastgroup g;
+	int i;
+
+	if (!nsreceive_tilde_getaddr(group, &g.group) || !IN_MULTICAST(ntohl(g.group.s_addr)))
+	{
+		error("nsreceive~: join: %s is not a multicast group", group->s_name);
+		return;
+	}
+	g.source.s_addr = htonl(INADDR_ANY);
+	if (source != ps_nothing && !nsreceive_tilde_getaddr(source, &g.source))
+	{
+		error("nsreceive~: join: bad source %s", source->s_name);
+		return;
+	}
+
+	for (i = 0; i < x->x_ngroups; i++)
+		if (x->x_groups[i].group.s_addr == g.group.s_addr && x->x_groups[i].source.s_addr == g.source.s_addr)
+		{
+			post("nsreceive~: already joined %s", group->s_name);
+			return;
+		}
+	if (x->x_ngroups >= DEFAULT_MCAST_GROUPS)
+	{
+		error("nsreceive~: join: too many groups (max. %d)", DEFAULT_MCAST_GROUPS);
+		return;
+	}
+
+	if (!nsreceive_tilde_portmembership(x, &g, 1))
+		return;
+	x->x_groups[x->x_ngroups++] = g;
+	if (source != ps_nothing)
+		post("nsreceive~: joined %s from source %s", group->s_name, source->s_name);
+	else
+		post("nsreceive~: joined %s", group->s_name);
+}
+
+
+static void nsreceive_tilde_leave(t_nsreceive_tilde *x, t_symbol *group, t_symbol *source)
+{
+	t_mcastgroup g;
+	int i;
+
+	if (!nsreceive_tilde_getaddr(group, &g.group))
+	{
+		error("nsreceive~: leave: bad group %s", group->s_name);
+		return;
+	}
+	g.source.s_addr = htonl(INADDR_ANY);
+	if (source != ps_nothing && !nsreceive_tilde_getaddr(source, &g.source))
+	{
+		error("nsreceive~: leave: bad source %s", source->s_name);
+		return;
+	}
 
-  return 0;
+	for (i = 0; i < x->x_ngroups; i++)
+		if (x->x_groups[i].group.s_addr == g.group.s_addr && x->x_groups[i].source.s_addr == g.source.s_addr)
+		{
+			nsreceive_tilde_portmembership(x, &g, 0);
+			x->x_groups[i] = x->x_groups[--x->x_ngroups];
+			post("nsreceive~: left %s", group->s_name);
+			return;
+		}
+	post("nsreceive~: leave: %s not joined", group->s_name);
 }
 
 
+/* select the interface used by memberships, applied by rejoining */
+static void nsreceive_tilde_interface(t_nsreceive_tilde *x, t_symbol *ifaddr)
+{
+	nsreceive_tilde_leaveall(x);
+	x->x_mcastif = ifaddr;
+	nsreceive_tilde_joinall(x);
+	if (ifaddr != ps_nothing)
+		post("nsreceive~: multicast interface set to %s", ifaddr->s_name);
+	else
+		post("nsreceive~: multicast interface set to any");
+}
 
 
 
@@ -299,36 +662,50 @@ static void nsreceive_tilde_closesocket(t_nsreceive_tilde* x)
 
 
 
+static void nsreceive_tilde_resetsource(t_nsreceive_tilde* x, t_nsource *src)
+{
+	int i;
+	nstrace_add(x->x_trace, NSTRACE_RESET, (int)(src - x->x_sources), 0, 0);
+	src->s_counter = 0;
+	src->s_framein = 0;
+	src->s_frameout = 0;
+	src->s_framecount = 0;
+	src->s_datebegin=0;
+        src->s_lastdate=0;
+	src->s_loopcounter=0;
+        src->s_lastusecdate=0;
+        src->s_jittermin=0;
+	src->s_jittermax=0;
+	src->s_lastnumber=0;
+	src->s_lastcounter=0;
+	src->s_lost=0;
+	src->s_lastlost=0;
+	src->s_idle = 0;
+	src->s_framepos = 0;
+
+	for (i = 0; i < DEFAULT_AVERAGE_NUMBER; i++)
+		src->s_average[i] = x->x_maxframes;
+	src->s_averagecur = 0;
+	src->s_underflow = 0;
+	src->s_overflow = 0;
+	src->s_arrival = 0;
+	src->s_ijitter = 0;
+	nshist_clear(&src->s_harrival);
+	nshist_clear(&src->s_hdepth);
+	nshist_clear(&src->s_hlatency);
+}
+
+
 #ifdef PD
 static void nsreceive_tilde_reset(t_nsreceive_tilde* x, t_floatarg buffer)
 #else
 static void nsreceive_tilde_reset(t_nsreceive_tilde* x, double buffer)
 #endif
 {
-	int i;
-	x->x_counter = 0;
-
-	
+	int k;
 
-	x->x_framein = 0;
-	x->x_frameout = 0;
-	x->x_datebegin=0;
-        x->x_lastdate=0;
-	x->x_loopcounter=0;
-        x->x_lastusecdate=0;
-        x->x_jittermin=0;
-	x->x_jittermax=0;
-	x->x_lastnumber=0;
-	x->x_lastcounter=0;
-	x->x_lost=0;
-	x->x_lastlost=0;
-	x->x_blockssincerecv = 0;
-	x->x_blocksperrecv = x->x_blocksize / x->x_vecsize;
-
-
-	for (i = 0; i < DEFAULT_AVERAGE_NUMBER; i++)
-		x->x_average[i] = x->x_maxframes;
-	x->x_averagecur = 0;
+	for (k = 0; k < x->x_nsources; k++)
+		nsreceive_tilde_resetsource(x, &x->x_sources[k]);
 
 	if (buffer == 0.0)	/* set default */
 		x->x_maxframes = DEFAULT_QUEUE_LENGTH;
@@ -337,362 +714,782 @@ static void nsreceive_tilde_reset(t_nsreceive_tilde* x, double buffer)
 		buffer = (float)CLIP((float)buffer, 0., 1.);
 		x->x_maxframes = (int)(DEFAULT_AUDIO_BUFFER_FRAMES * buffer);
 		x->x_maxframes = CLIP(x->x_maxframes, 1, DEFAULT_AUDIO_BUFFER_FRAMES - 1);
-		post("nsreceive~: set buffer to %g (%d frames), %d usec", buffer, x->x_maxframes,x->x_blockduration * x->x_maxframes );
+		post("nsreceive~: set buffer to %g (%d frames), %d usec", buffer, x->x_maxframes,x->x_sources[0].s_blockduration * x->x_maxframes );
 	}
-	x->x_underflow = 0;
-	x->x_overflow = 0;
 }
 
 
-#define QUEUESIZE (int)((x->x_framein + DEFAULT_AUDIO_BUFFER_FRAMES - x->x_frameout) % DEFAULT_AUDIO_BUFFER_FRAMES)
-#define BLOCKOFFSET (x->x_blockssincerecv * x->x_vecsize * x->x_frames[x->x_frameout].tag.channels)
-
-static void nsreceive_tilde_datapoll(t_nsreceive_tilde *x)
+/* find the slot of the sender of a packet, taking a free one for new senders */
+static t_nsource *nsreceive_tilde_findsource(t_nsreceive_tilde *x, struct sockaddr_in *from)
 {
-#ifndef PD
-	int ret;
-	struct timeval timout;
-    fd_set readset;
-    timout.tv_sec = 0;
-    timout.tv_usec = 0;
-    FD_ZERO(&readset);
-    FD_SET(x->x_socket, &readset);
-
-	ret = select(x->x_socket + 1, &readset, NULL, NULL, &timout);
-    if (ret < 0)
-    {
-    	nsreceive_tilde_sockerror("select");
-		return;
-    }
+	t_nsource *free = NULL;
+	int k;
 
-	if (FD_ISSET(x->x_socket, &readset))	/* data available */
-#endif
+	for (k = 0; k < x->x_nsources; k++)
+	{
+		t_nsource *src = &x->x_sources[k];
+		if (!src->s_active)
+		{
+			if (!free)
+				free = src;
+		}
+		else if (src->s_from.sin_addr.s_addr == from->sin_addr.s_addr
+			 && src->s_from.sin_port == from->sin_port)
+			return src;
+	}
+	if (free)
 	{
-		int ret;
+		nsreceive_tilde_resetsource(x, free);
+		free->s_from = *from;
+		free->s_active = 1;
+		x->x_hostname = gensym(inet_ntoa(from->sin_addr));
+		if (x->x_nsources > 1)
+			nslog_event(&x->x_log, NSRECEIVE_LOG_SOURCE, (int)(free - x->x_sources));
+	}
+	return free;
+}
 
-		int nic =0;
-		int framein=0;
 
+#define QUEUESIZE(src) (int)(((src)->s_framein + DEFAULT_AUDIO_BUFFER_FRAMES - (src)->s_frameout) % DEFAULT_AUDIO_BUFFER_FRAMES)
+#define QUEUESAMPLES(src) (QUEUESIZE(src) * (src)->s_blocksize - (src)->s_framepos)
+#define SOURCERATE(x, src) (((src)->s_samplerate ? (src)->s_samplerate : (x)->x_samplerate) / (src)->s_decimation)
 
 
-		/* UDP */
-		{
-		  //n = x->x_nbytes;
-
-		  //nicnbytesif (x->x_nbytes == 0)	/* we ate all the samples and need a new header tag */
-		  //nicnbytes {
-				/* receive header tag */
-				//ret = recv(x->x_socket,
-		  //(char*)&x->x_frames[x->x_framein].tag,
-		  //sizeof(t_tag), 0);
-		  //post("sizeof(t_tag) %d DEFAULT_CBUF_SIZE %d header %d",sizeof(t_tag),DEFAULT_CBUF_SIZE,sizeof(t_tag),DEFAULT_CBUF_SIZE-sizeof(t_tag));
-
-		  //ret = recv(x->x_socket, (char*)&x->x_frames[x->x_framein].tag, sizeof(t_tag) - DEFAULT_CBUF_SIZE, 0);
-				
-		  ret = recv(x->x_socket, (char*)&x->x_frames[x->x_framein], sizeof(t_frame), 0);
-		
-		               if (ret <= 0)	/* error */
-				  {
-					if (nsreceive_tilde_sockerror("recv tag"))
-						goto bail;
-					nsreceive_tilde_reset(x, 0);
-					x->x_datebegin=0;
-					x->x_lastdate=0;
-					x->x_lastusecdate=0;
-					x->x_jittermin=0;
-					x->x_jittermax=0;
-					x->x_lastnumber=0;
-					x->x_lastcounter=0;
-					x->x_loopcounter=0;
-					x->x_lost=0;
-					x->x_lastlost=0;
-					x->x_counter = 0;
-					return;
-				}
-				else if (ret <= sizeof(t_frame) - DEFAULT_CBUF_SIZE)
-				{
-					/* incomplete header tag: return and try again later */
-					/* in the hope that more data will be available */
-					error("nsreceive~: got incomplete header tag");
-					return;
-				}
-			       
-			       struct timeval tv;
-		
-			       gettimeofday(&tv, NULL); 
+/* channels in the frame, the sender leaves silent ones out */
+static int nsreceive_tilde_carried(t_tag *tag)
+{
+	int i, carried = 0;
+
+	if (!tag->channelmask)
+		return (tag->channels);
+	for (i = 0; i < tag->channels; i++)
+		if (tag->channelmask & (1u << i))
+			carried++;
+	return (carried);
+}
 
-			       if(x->x_datebegin == 0)
-				 {
-				   x->x_datebegin=tv.tv_sec;
-				   
-		
-				 }
-				if(x->x_lastdate==0)
-				  {
-				    x->x_lastdate= (long) tv.tv_sec;
-				    x->x_lastusecdate=tv.tv_usec;
-				    x->x_jittermin=0;
-				    x->x_jittermax=0;
-				    x->x_lastcounter=0;
-				    x->x_loopcounter=0;
-				    x->x_lastnumber=x->x_frames[x->x_framein].tag.count;
-				    x->x_lastlost=0;
-
-				  }
-			
-			       /* adjust byte order if neccessarry headers are sent using little endian format*/
-				//	if ( SF_BYTE_NATIVE ==  SF_BYTE_BE && x->x_frames[x->x_framein].tag.version != SF_BYTE_LE )//x->x_frames[x->x_framein].tag.version == SF_BYTE_BE)
-				if ( x->x_frames[x->x_framein].tag.version != SF_BYTE_LE )
-				{
-					x->x_frames[x->x_framein].tag.count = toles(x->x_frames[x->x_framein].tag.count);
-					x->x_frames[x->x_framein].tag.framesize = toles(x->x_frames[x->x_framein].tag.framesize);
-				}
-
-
-				/* get info from header tag */
-				if (x->x_frames[x->x_framein].tag.channels > x->x_noutlets)
-				{
-					error("nsreceive~: incoming stream has too many channels (%d)", x->x_frames[x->x_framein].tag.channels);
-					x->x_datebegin=0;
-					x->x_lastdate=0;
-					x->x_lastusecdate=0;
-					x->x_jittermin=0;
-					x->x_jittermax=0;
-					x->x_lastnumber=0;
-					x->x_lastcounter=0;
-					x->x_loopcounter=0;
-					x->x_lost=0;
-					x->x_lastlost=0;
-					x->x_counter = 0;
-					return;
-				}
-		
 
-				/* check whether the data packet has the correct count */
-				if ((x->x_framecount != x->x_frames[x->x_framein].tag.count)
-				    && (x->x_frames[x->x_framein].tag.count > 100)
-				    && (x->x_framecount != 0 ) )
-				{
-		
-					
-		
-				  if(x->x_framecount < x->x_frames[x->x_framein].tag.count)
-				    {
-				      x->x_lost += (int)(x->x_frames[x->x_framein].tag.count - x->x_framecount);
-				      x->x_lastlost += (int)(x->x_frames[x->x_framein].tag.count - x->x_framecount);
-				    }
-				  else //data arrive out of order
-				    {
-				      post("nsreceive~: out of order data received");
-				      goto bail;
-				    }
-				}
-				x->x_framecount = x->x_frames[x->x_framein].tag.count + 1;
-				
-				
-				int nbsample =x->x_frames[x->x_framein].tag.framesize / ( SF_SIZEOF(x->x_frames[x->x_framein].tag.format) * x->x_frames[x->x_framein].tag.channels) ;
-				
-				
+/* samples of src to keep queued */
+static int nsreceive_tilde_target(t_nsreceive_tilde *x, t_nsource *src)
+{
+	int target = x->x_latency > 0 ? (int)(x->x_latency * SOURCERATE(x, src) / 1000.) :
+		x->x_maxframes * src->s_blocksize;
 
-		
-				
-				if ( x->x_blocksize != nbsample )
-				  {
-		
-				    framein=x->x_framein;
-				    x->x_framein=0;
-				    x->x_datebegin=0;
-				    x->x_lastdate=0;
-				    x->x_lastusecdate=0;
-				    x->x_lastcounter=0;
-				    x->x_loopcounter=0;
-				    x->x_lastnumber=0;
-				    x->x_frameout=0;
-				    x->x_lost=0;
-				    x->x_lastlost=0;
-				    x->x_counter=0;
-		
-				    for (nic = 0; nic < DEFAULT_AVERAGE_NUMBER; nic++)
-				      x->x_average[nic] = x->x_maxframes;
-				    x->x_averagecur = 0;
-				    x->x_underflow = 0;
-				    x->x_overflow = 0;
-				    
-				    //freein memory
-				    //for (nic = 0; nic <  DEFAULT_AUDIO_BUFFER_FRAMES; nic++)
-				    // {
-				    //t_freebytes(x->x_frames[nic].data, x->x_blocksize * x->x_noutlets * sizeof(t_float));
-				    // }				   
-				    
-				    //computing new block size
-				    x->x_blocksize = x->x_frames[framein].tag.framesize / ( SF_SIZEOF(x->x_frames[framein].tag.format) * x->x_frames[framein].tag.channels );
-				    
-				    x->x_blockduration= (1000000 * x->x_blocksize) / x->x_samplerate;
-				    post("blockduration %d",	x->x_blockduration);  
-				    post("nsreceive: changement de blocksize UDP %d",x->x_blocksize);
-				    x->x_loopduration= (1000000 * 64) / x->x_samplerate;
-				    post("loopduration %d",	x->x_blockduration);  
-				    
-				    
-				    x->x_blockssincerecv = 0;  
-				    x->x_blocksperrecv = x->x_blocksize / x->x_vecsize;
-				    
-				    //cheking pb with max size
-				    //nic
-				    if(x->x_blocksize * x->x_noutlets * sizeof(t_float) > x->x_lastmallocblocksize )
-				      {
-					
-					//post("nsreceive resizing
-					//buffer from %d to %d
-					//bytes",x->x_lastmallocblocksize,x->x_blocksize
-					//* x->x_noutlets *
-					//sizeof(t_float));
-					post("receiving framesize to large : %d bytes",x->x_blocksize * x->x_noutlets * sizeof(t_float));
-					
-					/* for (nic = 0; nic <  DEFAULT_AUDIO_BUFFER_FRAMES; nic++) */
-					/* 					  { */
-					
-/* 					    x->x_frames[nic].data = (char *)t_resizebytes(x->x_frames[nic].data, */
-/* 											  x->x_lastmallocblocksize,  */
-/* 											  x->x_blocksize  */
-/* 											  * x->x_noutlets  */
-/* 											  * sizeof(t_float));  */
-/* 					  } */
-					
-/* 					x->x_lastmallocblocksize = x->x_blocksize  */
-/* 					  * x->x_noutlets * sizeof(t_float); */
-				      }
-
-				    //updating tags for the new frame
-				    x->x_frames[x->x_framein].tag.count=x->x_frames[framein].tag.count;
-				    x->x_frames[x->x_framein].tag.framesize=x->x_frames[framein].tag.framesize;
-				    x->x_frames[x->x_framein].tag.channels=x->x_frames[framein].tag.channels;
-				    //x->x_maxframes = DEFAULT_QUEUE_LENGTH;
-				    
-				  } //end frame size update
-
-
-
-
-				{
-				  
-				  x->x_counter++;
-				  x->x_lastcounter++;
-				  
-				  //computing jitter
-				  //post("blockduration %d ", x->x_blockduration);
-				  //	long jit =  (x->x_lastlost + x->x_lastcounter) * x->x_blockduration
-				  //- ( 1000000 * (tv.tv_sec - x->x_lastdate) + tv.tv_usec - x->x_lastusecdate ) ;
-				  //long jit =  (x->x_frames[x->x_framein].tag.count - x->x_lastnumber ) * x->x_blockduration
-				  //- ( 1000000 * (tv.tv_sec - x->x_lastdate) + tv.tv_usec - x->x_lastusecdate ) ;
-				  
-				  //using only sound card clock (more accurate)
-				  //soustraction du temps coorespondant aux paquets recus moins celui correspondant au paquets lus
-				  long jit =  (x->x_frames[x->x_framein].tag.count - x->x_lastnumber ) * x->x_blockduration
-				    - ( x->x_loopduration * x->x_loopcounter ) ;
-				  //post("duree bloc %d duree syst %d diff %d",(x->x_lastlost + x->x_lastcounter) * x->x_blockduration, 1000000 * (tv.tv_sec - x->x_lastdate) + tv.tv_usec - x->x_lastusecdate, jit );
-				  if(jit < x->x_jittermin) 
-				    {
-				      x->x_jittermin = jit;
-				      // post("min: jit %d, lastcout %d",jit,x->x_lastcounter);
-				    }
-				  if(jit > x->x_jittermax) 
-				    {
-				      x->x_jittermax = jit; 
-				      //post("max: jit %d, lastcout %d",jit,x->x_lastcounter);
-				    }			
-				  
-				  //clock skew hiding
-				  if(QUEUESIZE < 2 * x->x_maxframes)
-				    {
-				      x->x_framein++;
-				      x->x_framein %= DEFAULT_AUDIO_BUFFER_FRAMES;
-				    }
-				  else
-				    {
-				      x->x_overflow++;
-				    }
-				  
-				  /* check for buffer overflow */
-				  if (x->x_framein == x->x_frameout)
-				    {
-				      x->x_overflow++;
-				    }
-				}
+	return (target > 0 ? target : 1);
+}
+
+
+/* drop the oldest samples of src until at most target are queued */
+static void nsreceive_tilde_trim(t_nsreceive_tilde *x, t_nsource *src, int target)
+{
+	int excess = QUEUESAMPLES(src) - target;
 
+	while (excess > 0)
+	{
+		int k = src->s_blocksize - src->s_framepos;
+		if (k > excess)
+			k = excess;
+		excess -= k;
+		if ((src->s_framepos += k) >= src->s_blocksize)
+		{
+			src->s_framepos = 0;
+			src->s_frameout = (src->s_frameout + 1) % DEFAULT_AUDIO_BUFFER_FRAMES;
 		}
 	}
- bail:
-	;
-#ifndef PD
-	clock_delay(x->x_datapoll, DEFAULT_NETWORK_POLLTIME);
-#endif
 }
 
-static void nsreceive_tilde_connectpoll(t_nsreceive_tilde *x)
+
+/* (re)build the converter of src from its samplerate to ours, none when
+   they are the same or the sender doesn't tell. a decimated stream is
+   converted from rate / decimation, kept as a ratio of integers */
+static void nsreceive_tilde_resampler(t_nsreceive_tilde *x, t_nsource *src)
 {
-#ifndef PD
-	int ret;
-    struct timeval timout;
-    fd_set readset;
-    timout.tv_sec = 0;
-    timout.tv_usec = 0;
-    FD_ZERO(&readset);
-    FD_SET(x->x_connectsocket, &readset);
+	int rate = src->s_samplerate ? src->s_samplerate : (int)x->x_samplerate;
+	int to = (int)x->x_samplerate * src->s_decimation;
 
-	ret = select(x->x_connectsocket + 1, &readset, NULL, NULL, &timout);
-    if (ret < 0)
-    {
-    	nsreceive_tilde_sockerror("select");
+	if (src->s_resample && src->s_resample->r_inrate == rate && src->s_resample->r_outrate == to)
 		return;
-    }
+	if (src->s_resample)
+		nsresample_free(src->s_resample);
+	src->s_resample = 0;
+	if (rate != to && x->x_samplerate &&
+	    !(src->s_resample = nsresample_new(rate, to, x->x_noutlets)))
+		nslog_event(&x->x_log, NSRECEIVE_LOG_RATIO, SOURCERATE(x, src));
+}
 
-	if (FD_ISSET(x->x_connectsocket, &readset))	/* pending connection */
-#endif
-	{
-		int sockaddrl = (int)sizeof(struct sockaddr);
-		struct sockaddr_in incomer_address;
-		int fd = accept(x->x_connectsocket, (struct sockaddr*)&incomer_address, &sockaddrl);
-		if (fd < 0) 
-		{
-			post("nsreceive~: accept failed");
-			return;
-		}
-#ifdef O_NONBLOCK
-		fcntl(fd, F_SETFL, O_NONBLOCK);
-#endif
-		if (x->x_socket != -1)
-		{
-			post("nsreceive~: new connection");
-			nsreceive_tilde_closesocket(x);
-		}
 
-		nsreceive_tilde_reset(x, 0);
-		x->x_socket = fd;
-		//x->x_nbytes = 0;
-		x->x_hostname = gensym(inet_ntoa(incomer_address.sin_addr));
+/* jitter buffer target in ms, to the sample instead of whole frames: play
+   starts once that much arrived and anything queued beyond it is dropped
+   now. 0 goes back to the frames of buffer/reset */
 #ifdef PD
-		sys_addpollfn(fd, nsreceive_tilde_datapoll, x);
-		outlet_float(x->x_outlet1, 1);
+static void nsreceive_tilde_latency(t_nsreceive_tilde* x, t_floatarg ms)
 #else
-		clock_delay(x->x_datapoll, 0);
-		outlet_int(x->x_outlet1, 1);
-#endif
-	}
-#ifndef PD
-	clock_delay(x->x_connectpoll, DEFAULT_NETWORK_POLLTIME);
+static void nsreceive_tilde_latency(t_nsreceive_tilde* x, double ms)
 #endif
+{
+	int k;
+
+	x->x_latency = ms > 0 ? ms : 0;
+	for (k = 0; k < x->x_nsources; k++)
+		if (x->x_sources[k].s_active)
+			nsreceive_tilde_trim(x, &x->x_sources[k], nsreceive_tilde_target(x, &x->x_sources[k]));
+	if (x->x_latency > 0)
+		post("nsreceive~: latency set to %g ms (%d samples)", x->x_latency,
+		     (int)(x->x_latency * x->x_samplerate / 1000.));
+	else
+		post("nsreceive~: latency set to %d frames", x->x_maxframes);
 }
 
 
-static int nsreceive_tilde_createsocket(t_nsreceive_tilde* x, int portno)
+/* queue the frame in x_recvframe into the jitter buffer of src.
+   the frame is swapped with the free slot of the ring, not copied */
+/* stamp is the arrival time of the packet on the nsreactor_now() clock */
+static void nsreceive_tilde_packet(t_nsreceive_tilde *x, t_nsource *src, unsigned long long stamp)
 {
-    struct sockaddr_in server;
-    int sockfd;
-    
-
-
-      sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+	t_frame *frame = x->x_recvframe;
+	int nic = 0;
+	int carried;
+
+	if(src->s_datebegin == 0)
+	  {
+	    src->s_datebegin = stamp;
+	  }
+	if(src->s_lastdate==0)
+	  {
+	    src->s_lastdate = stamp;
+	    src->s_lastusecdate = (long)(stamp / 1000 % 1000000);
+	    src->s_jittermin=0;
+	    src->s_jittermax=0;
+	    src->s_lastcounter=0;
+	    src->s_loopcounter=0;
+	    src->s_lastnumber=frame->tag.count;
+	    src->s_lastlost=0;
+	  }
+
+	/* adjust byte order if neccessarry headers are sent using little endian format*/
+	if ( frame->tag.version != SF_BYTE_LE )
+	{
+		frame->tag.count = toles(frame->tag.count);
+		frame->tag.framesize = tolel(frame->tag.framesize);
+		frame->tag.samplerate = tolel(frame->tag.samplerate);
+		frame->tag.decimation = tolel(frame->tag.decimation);
+		frame->tag.channelmask = tolel(frame->tag.channelmask);
+	}
+
+	/* get info from header tag */
+	if (frame->tag.channels > x->x_noutlets)
+	{
+		nslog_event(&x->x_log, NSRECEIVE_LOG_CHANNELS, frame->tag.channels);
+		nsreceive_tilde_resetsource(x, src);
+		return;
+	}
+
+	/* check whether the data packet has the correct count */
+	if ((src->s_framecount != frame->tag.count)
+	    && (frame->tag.count > 100)
+	    && (src->s_framecount != 0 ) )
+	{
+	  if(src->s_framecount < frame->tag.count)
+	    {
+	      src->s_lost += (int)(frame->tag.count - src->s_framecount);
+	      src->s_lastlost += (int)(frame->tag.count - src->s_framecount);
+	      nstrace_add(x->x_trace, NSTRACE_LOST, (int)(src - x->x_sources), (int)src->s_framecount,
+			  (int)(frame->tag.count - src->s_framecount));
+	    }
+	  else //data arrive out of order
+	    {
+	      nslog_event(&x->x_log, NSRECEIVE_LOG_ORDER, frame->tag.count);
+	      return;
+	    }
+	}
+	src->s_framecount = frame->tag.count + 1;
+
+	/* a sender at another samplerate, or decimating, is converted to ours */
+	if (frame->tag.decimation < 1 || frame->tag.decimation > NSRESAMPLE_MAXDOWN)
+	    frame->tag.decimation = 1;
+	if (frame->tag.samplerate != src->s_samplerate || frame->tag.decimation != src->s_decimation)
+	  {
+	    src->s_samplerate = frame->tag.samplerate;
+	    src->s_decimation = frame->tag.decimation;
+	    if (SOURCERATE(x, src))
+	      src->s_blockduration = (1000000 * src->s_blocksize) / SOURCERATE(x, src);
+	    nslog_event(&x->x_log, NSRECEIVE_LOG_SAMPLERATE, SOURCERATE(x, src));
+	    nsreceive_tilde_resampler(x, src);
+	  }
+
+	carried = nsreceive_tilde_carried(&frame->tag);
+	if (!carried)
+	  {
+	    nslog_event(&x->x_log, NSRECEIVE_LOG_CHANNELS, 0);
+	    return;
+	  }
+	int nbsample = frame->tag.framesize / ( SF_SIZEOF(frame->tag.format) * carried) ;
+
+	if ( src->s_blocksize != nbsample )
+	  {
+	    src->s_framein=0;
+	    src->s_datebegin=0;
+	    src->s_lastdate=0;
+	    src->s_lastusecdate=0;
+	    src->s_lastcounter=0;
+	    src->s_loopcounter=0;
+	    src->s_lastnumber=0;
+	    src->s_arrival=0;
+	    src->s_ijitter=0;
+	    nshist_clear(&src->s_harrival);
+	    nshist_clear(&src->s_hdepth);
+	    nshist_clear(&src->s_hlatency);
+	    src->s_frameout=0;
+	    src->s_lost=0;
+	    src->s_lastlost=0;
+	    src->s_counter=0;
+
+	    for (nic = 0; nic < DEFAULT_AVERAGE_NUMBER; nic++)
+	      src->s_average[nic] = x->x_maxframes;
+	    src->s_averagecur = 0;
+	    src->s_underflow = 0;
+	    src->s_overflow = 0;
+
+	    //computing new block size
+	    src->s_blocksize = nbsample;
+	    src->s_blockduration= (1000000 * src->s_blocksize) / SOURCERATE(x, src);
+	    nslog_event(&x->x_log, NSRECEIVE_LOG_BLOCKSIZE, src->s_blocksize);
+	    nstrace_add(x->x_trace, NSTRACE_FORMAT, (int)(src - x->x_sources), frame->tag.format, frame->tag.channels);
+	    x->x_loopduration= (1000000 * 64) / x->x_samplerate;
+
+	    src->s_framepos = 0;
+
+	    //cheking pb with max size
+	    if(src->s_blocksize * x->x_noutlets * sizeof(t_float) > x->x_lastmallocblocksize )
+	      {
+		nslog_event(&x->x_log, NSRECEIVE_LOG_FRAMESIZE, (int)(src->s_blocksize * x->x_noutlets * sizeof(t_float)));
+	      }
+	  } //end frame size update
+
+	src->s_counter++;
+	src->s_lastcounter++;
+	src->s_idle = 0;
+	nstrace_add(x->x_trace, NSTRACE_RECV, (int)(src - x->x_sources), frame->tag.count, frame->tag.framesize);
+
+	/* interarrival jitter (RFC 3550): how far the spacing of the arrivals
+	   strays from the spacing the sender produced the frames at */
+	if (src->s_arrival)
+	    nshist_add(&src->s_harrival, stamp - src->s_arrival);
+	if (src->s_arrival && SOURCERATE(x, src))
+	  {
+	    short frames = (short)(frame->tag.count - src->s_arrivalcount);
+	    long long d = (long long)(stamp - src->s_arrival)
+	      - (long long)frames * src->s_blocksize * 1000000000LL / SOURCERATE(x, src);
+	    if (d < 0)
+	      d = -d;
+	    src->s_ijitter += (d - src->s_ijitter) / 16.;
+	  }
+	src->s_arrival = stamp;
+	src->s_arrivalcount = frame->tag.count;
+
+	//using only sound card clock (more accurate)
+	//soustraction du temps coorespondant aux paquets recus moins celui correspondant au paquets lus
+	long jit =  (frame->tag.count - src->s_lastnumber ) * src->s_blockduration
+	  - ( x->x_loopduration * src->s_loopcounter ) ;
+	if(jit < src->s_jittermin) 
+	  {
+	    src->s_jittermin = jit;
+	  }
+	if(jit > src->s_jittermax) 
+	  {
+	    src->s_jittermax = jit; 
+	  }			
+
+	//clock skew hiding, and room in the ring
+	if (QUEUESAMPLES(src) < 2 * nsreceive_tilde_target(x, src) && QUEUESIZE(src) < DEFAULT_AUDIO_BUFFER_FRAMES - 1)
+	  {
+	    x->x_recvframe = src->s_frames[src->s_framein];
+	    src->s_frames[src->s_framein] = frame;
+	    src->s_stamps[src->s_framein] = stamp;
+	    src->s_framein++;
+	    src->s_framein %= DEFAULT_AUDIO_BUFFER_FRAMES;
+	  }
+	else
+	  {
+	    src->s_overflow++;
+	    nstrace_add(x->x_trace, NSTRACE_OVERFLOW, (int)(src - x->x_sources), frame->tag.count, 0);
+	  }
+
+	/* check for buffer overflow */
+	if (src->s_framein == src->s_frameout)
+	  {
+	    src->s_overflow++;
+	    nstrace_add(x->x_trace, NSTRACE_OVERFLOW, (int)(src - x->x_sources), frame->tag.count, 0);
+	  }
+}
+
+
+/* hand a datagram to x: the frame is swapped with x_recvframe, or copied
+   when other receivers of the port want it too */
+static void nsreceive_tilde_deliver(t_nsreceive_tilde *x, t_frame **frame, int len, int copy,
+				    struct sockaddr_in *from, unsigned long long stamp)
+{
+	t_nsource *src;
+
+	if (copy)
+		memcpy(x->x_recvframe, *frame, len);
+	else
+	{
+		t_frame *tmp = x->x_recvframe;
+		x->x_recvframe = *frame;
+		*frame = tmp;
+	}
+
+	/* a second sender on our port gets its own jitter buffer */
+	if (!(src = nsreceive_tilde_findsource(x, from)))
+	{
+		x->x_ndrops++;
+		return;
+	}
+	nsreceive_tilde_packet(x, src, stamp);
+}
+
+
+/* reactor thread: queue a datagram for the DSP thread of x */
+static void nsreceive_tilde_inboxpost(t_nsreceive_tilde *x, t_frame **frame, int len, int copy,
+				      struct sockaddr_in *from, unsigned long long stamp)
+{
+	int head = x->x_inboxhead;
+	int next = (head + 1) % DEFAULT_INBOX_FRAMES;
+	t_nsinbox *slot = &x->x_inbox[head];
+
+	if (next == NS_LOAD_ACQUIRE(&x->x_inboxtail))
+	{
+		x->x_inboxdrops++;	/* perform is not keeping up */
+		return;
+	}
+	if (copy)
+		memcpy(slot->i_frame, *frame, len);
+	else
+	{
+		t_frame *tmp = slot->i_frame;
+		slot->i_frame = *frame;
+		*frame = tmp;
+	}
+	slot->i_len = len;
+	slot->i_from = *from;
+	slot->i_stamp = stamp;
+	slot->i_wake = nsreactor_waketime();
+	slot->i_posted = nsreactor_now();
+	NS_STORE_RELEASE(&x->x_inboxhead, next);
+}
+
+
+/* DSP thread: take the datagrams queued by the reactor */
+static void nsreceive_tilde_inboxdrain(t_nsreceive_tilde *x)
+{
+	int tail = x->x_inboxtail;
+	int head = NS_LOAD_ACQUIRE(&x->x_inboxhead);
+	unsigned long long now = tail != head ? nsreactor_now() : 0;
+
+	while (tail != head)
+	{
+		t_nsinbox *slot = &x->x_inbox[tail];
+		unsigned long long wake = slot->i_posted - slot->i_wake;
+		unsigned long long queue = now - slot->i_posted;
+
+		x->x_wakelat += wake;
+		x->x_queuelat += queue;
+		if (wake > x->x_wakelatmax)
+			x->x_wakelatmax = wake;
+		if (queue > x->x_queuelatmax)
+			x->x_queuelatmax = queue;
+		x->x_latcount++;
+		nsreceive_tilde_deliver(x, &slot->i_frame, slot->i_len, 0, &slot->i_from, slot->i_stamp);
+		tail = (tail + 1) % DEFAULT_INBOX_FRAMES;
+		NS_STORE_RELEASE(&x->x_inboxtail, tail);
+	}
+}
+
+
+/* a frame sent as several datagrams (segment size, UDP GSO): collect the
+   pieces per sender. returns the length of the whole frame once the last
+   piece is in, it then sits in p_batch[i] like a frame that came in one */
+static int nsreceive_tilde_reassemble(t_nsport *p, int i, int len, struct sockaddr_in *from)
+{
+	t_frame *frag = p->p_batch[i];
+	t_nspartial *f = 0;
+	int offset = frag->tag.fragoffset;
+	int framesize = frag->tag.framesize;
+	int nfrag = frag->tag.fragments;
+	int k, chunk, index;
+
+	if (frag->tag.version != SF_BYTE_LE)
+	{
+		offset = tolel(offset);
+		framesize = tolel(framesize);
+		nfrag = toles(frag->tag.fragments);
+	}
+	len -= SF_HEADER_SIZE;
+	if (len <= 0 || offset < 0 || framesize <= 0 || framesize > DEFAULT_CBUF_SIZE || offset > framesize - len ||
+	    nfrag < 2 || nfrag > DEFAULT_MAX_SEGMENTS)
+	{
+		p->p_short++;
+		return 0;
+	}
+	/* the sender cuts at offsets k * chunk, all but the last datagram are
+	   chunk long. the last one tells chunk by its offset */
+	chunk = (offset + len < framesize) ? len : offset / (nfrag - 1);
+	if (chunk <= 0 || offset % chunk || (index = offset / chunk) >= nfrag ||
+	    (index == nfrag - 1) != (offset + len == framesize))
+	{
+		p->p_short++;
+		return 0;
+	}
+	for (k = 0; k < DEFAULT_MAX_SOURCES; k++)
+	{
+		t_nspartial *g = &p->p_partials[k];
+		if (g->f_bytes && g->f_streamid == frag->tag.streamid &&
+		    g->f_from.sin_addr.s_addr == from->sin_addr.s_addr && g->f_from.sin_port == from->sin_port)
+		{
+			f = g;
+			break;
+		}
+		if (!f && !g->f_bytes)
+			f = g;
+	}
+	if (!f)
+	{
+		/* more senders than slots: take one over, its frame is lost */
+		f = &p->p_partials[p->p_nextpartial++ % DEFAULT_MAX_SOURCES];
+		f->f_bytes = 0;
+		p->p_incomplete++;
+	}
+	if (!f->f_frame)
+		f->f_frame = (t_frame *)getbytes(sizeof(t_frame));
+
+	/* a piece of the next frame: the last one won't be completed */
+	if (f->f_bytes && f->f_count != frag->tag.count)
+	{
+		f->f_bytes = 0;
+		p->p_incomplete++;
+	}
+	if (!f->f_bytes)
+	{
+		memcpy(&f->f_frame->tag, &frag->tag, SF_HEADER_SIZE);
+		f->f_from = *from;
+		f->f_streamid = frag->tag.streamid;
+		f->f_count = frag->tag.count;
+		f->f_nfrag = nfrag;
+		f->f_chunk = chunk;
+		f->f_have = 0;
+	}
+	/* a datagram that doesn't fit the frame begun, or one we have: UDP
+	   may duplicate */
+	if (f->f_nfrag != nfrag || f->f_chunk != chunk)
+	{
+		p->p_short++;
+		return 0;
+	}
+	if (f->f_have & (1ULL << index))
+		return 0;
+	memcpy(f->f_frame->tag.cbuf + offset, frag->tag.cbuf, len);
+	f->f_have |= 1ULL << index;
+	f->f_bytes += len;
+	if (f->f_have != (nfrag == 64 ? ~0ULL : (1ULL << nfrag) - 1))
+		return 0;
+
+	p->p_batch[i] = f->f_frame;
+	f->f_frame = frag;
+	f->f_bytes = 0;
+	return framesize + SF_HEADER_SIZE;
+}
+
+
+static void nsreceive_tilde_portdispatch(t_nsport *p, int i, int len, struct sockaddr_in *from,
+					 unsigned long long stamp)
+{
+	t_nsreceive_tilde *x, *first = NULL;
+	int streamid;
+
+	if (len <= sizeof(t_frame) - DEFAULT_CBUF_SIZE)
+	{
+		/* incomplete header tag */
+		p->p_short++;
+		if (p->p_receivers)
+			nslog_event(&p->p_receivers->x_log, NSRECEIVE_LOG_SHORT, len);
+		return;
+	}
+
+	if (p->p_batch[i]->tag.fragments != 1 && p->p_batch[i]->tag.fragments != toles(1))
+	{
+		if (!(len = nsreceive_tilde_reassemble(p, i, len, from)))
+			return;
+	}
+	else
+	{
+		/* a whole frame: the header must not claim more than came in */
+		int framesize = p->p_batch[i]->tag.framesize;
+		if (p->p_batch[i]->tag.version != SF_BYTE_LE)
+			framesize = tolel(framesize);
+		if (framesize < 0 || framesize > DEFAULT_CBUF_SIZE || framesize > len - (int)SF_HEADER_SIZE)
+		{
+			p->p_short++;
+			if (p->p_receivers)
+				nslog_event(&p->p_receivers->x_log, NSRECEIVE_LOG_FRAMESIZE, framesize);
+			return;
+		}
+	}
+
+	streamid = (unsigned char)p->p_batch[i]->tag.streamid;
+	for (x = p->p_receivers; x; x = x->x_nextonport)
+	{
+		if (x->x_streamid != streamid)
+			continue;
+		if (!first)
+			first = x;
+		else if (p->p_threaded)
+			nsreceive_tilde_inboxpost(x, &p->p_batch[i], len, 1, from, stamp);
+		else
+			nsreceive_tilde_deliver(x, &p->p_batch[i], len, 1, from, stamp);
+	}
+	/* the first receiver gets the frame itself, after the others made their copy */
+	if (!first)
+		p->p_unrouted++;
+	else if (p->p_threaded)
+		nsreceive_tilde_inboxpost(first, &p->p_batch[i], len, 0, from, stamp);
+	else
+		nsreceive_tilde_deliver(first, &p->p_batch[i], len, 0, from, stamp);
+}
+
+
+/* one datagram from an io_uring buffer or a GRO batch: into p_batch[0], then dispatch */
+static void nsreceive_tilde_portrecv(t_nsport *p, char *data, int len, struct sockaddr_in *from,
+				    unsigned long long stamp)
+{
+	if (len > sizeof(t_frame))
+		len = sizeof(t_frame);
+	memcpy(p->p_batch[0], data, len);
+	nsreceive_tilde_portdispatch(p, 0, len, from, stamp);
+}
+
+
+#ifdef UDP_GRO
+/* UDP_GRO: the kernel hands us several datagrams of the same size in one
+   buffer, the cmsg says how long each one is */
+static void nsreceive_tilde_portgro(t_nsport *p, char *buf, int len, struct msghdr *msg,
+				    struct sockaddr_in *from)
+{
+	struct cmsghdr *cm;
+	int segsize = 0;
+	unsigned long long stamp = nsreactor_rxstamp(msg);
+
+	for (cm = CMSG_FIRSTHDR(msg); cm; cm = CMSG_NXTHDR(msg, cm))
+		if (cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_GRO)
+			memcpy(&segsize, CMSG_DATA(cm), sizeof(int));
+	if (segsize <= 0)
+		segsize = len;
+	for (; len > 0; buf += segsize, len -= segsize)
+		nsreceive_tilde_portrecv(p, buf, len < segsize ? len : segsize, from, stamp);
+}
+#endif
+
+
+/* read all pending datagrams of a port, in batches where the system allows */
+static void nsreceive_tilde_portpoll(t_nsport *p)
+{
+	t_nsreceive_tilde *x;
+	struct sockaddr_in from[DEFAULT_RECV_BATCH];
+	int i, n;
+#ifdef HAVE_RECVMMSG
+	struct mmsghdr msgs[DEFAULT_RECV_BATCH];
+	struct iovec iov[DEFAULT_RECV_BATCH];
+	char control[DEFAULT_RECV_BATCH][NSRECEIVE_CONTROL_SIZE];
+#ifdef UDP_GRO
+
+	while (p->p_grobuf)
+	{
+		memset(msgs, 0, sizeof(msgs));
+		for (i = 0; i < DEFAULT_GRO_BATCH; i++)
+		{
+			iov[i].iov_base = p->p_grobuf + i * DEFAULT_GRO_SIZE;
+			iov[i].iov_len = DEFAULT_GRO_SIZE;
+			msgs[i].msg_hdr.msg_iov = &iov[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+			msgs[i].msg_hdr.msg_name = &from[i];
+			msgs[i].msg_hdr.msg_namelen = sizeof(from[i]);
+			msgs[i].msg_hdr.msg_control = control[i];
+			msgs[i].msg_hdr.msg_controllen = sizeof(control[i]);
+		}
+		n = recvmmsg(p->p_fd, msgs, DEFAULT_GRO_BATCH, MSG_DONTWAIT, NULL);
+		if (n < 0)
+			goto fail;
+		for (i = 0; i < n; i++)
+			nsreceive_tilde_portgro(p, (char *)iov[i].iov_base, msgs[i].msg_len,
+						&msgs[i].msg_hdr, &from[i]);
+		if (n < DEFAULT_GRO_BATCH)
+			return;
+	}
+#endif
+
+	do
+	{
+		memset(msgs, 0, sizeof(msgs));
+		for (i = 0; i < DEFAULT_RECV_BATCH; i++)
+		{
+			iov[i].iov_base = (char*)p->p_batch[i];
+			iov[i].iov_len = sizeof(t_frame);
+			msgs[i].msg_hdr.msg_iov = &iov[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+			msgs[i].msg_hdr.msg_name = &from[i];
+			msgs[i].msg_hdr.msg_namelen = sizeof(from[i]);
+			msgs[i].msg_hdr.msg_control = control[i];
+			msgs[i].msg_hdr.msg_controllen = sizeof(control[i]);
+		}
+		n = recvmmsg(p->p_fd, msgs, DEFAULT_RECV_BATCH, MSG_DONTWAIT, NULL);
+		if (n < 0)
+			goto fail;
+		for (i = 0; i < n; i++)
+			nsreceive_tilde_portdispatch(p, i, msgs[i].msg_len, &from[i],
+						     nsreactor_rxstamp(&msgs[i].msg_hdr));
+	} while (n == DEFAULT_RECV_BATCH);
+	return;
+#else
+	for (n = 0; n < DEFAULT_RECV_BATCH; n++)
+	{
+		socklen_t fromlen = sizeof(from[0]);
+		int ret = recvfrom(p->p_fd, (char*)p->p_batch[0], sizeof(t_frame), 0,
+				   (struct sockaddr *)&from[0], &fromlen);
+		if (ret < 0)
+			goto fail;
+		nsreceive_tilde_portdispatch(p, 0, ret, &from[0], nsreactor_now());
+	}
+	return;
+#endif
+
+fail:
+	if (errno == EAGAIN || errno == EWOULDBLOCK || p->p_threaded)
+		return;
+	if (nsreceive_tilde_sockerror("recv tag"))
+		return;
+	for (x = p->p_receivers; x; x = x->x_nextonport)
+		nsreceive_tilde_reset(x, 0);
+}
+
+
+static void nsreceive_tilde_datapoll(t_nsreceive_tilde *x)
+{
+#ifndef PD
+	int ret;
+	struct timeval timout;
+    fd_set readset;
+    timout.tv_sec = 0;
+    timout.tv_usec = 0;
+    FD_ZERO(&readset);
+    FD_SET(x->x_socket, &readset);
+
+	ret = select(x->x_socket + 1, &readset, NULL, NULL, &timout);
+    if (ret < 0)
+    {
+    	nsreceive_tilde_sockerror("select");
+		return;
+    }
+
+	if (FD_ISSET(x->x_socket, &readset))	/* data available */
+#endif
+	{
+		nsreceive_tilde_portpoll(x->x_port);
+	}
+#ifndef PD
+	clock_delay(x->x_datapoll, DEFAULT_NETWORK_POLLTIME);
+#endif
+}
+
+static void nsreceive_tilde_connectpoll(t_nsreceive_tilde *x)
+{
+#ifndef PD
+	int ret;
+    struct timeval timout;
+    fd_set readset;
+    timout.tv_sec = 0;
+    timout.tv_usec = 0;
+    FD_ZERO(&readset);
+    FD_SET(x->x_connectsocket, &readset);
+
+	ret = select(x->x_connectsocket + 1, &readset, NULL, NULL, &timout);
+    if (ret < 0)
+    {
+    	nsreceive_tilde_sockerror("select");
+		return;
+    }
+
+	if (FD_ISSET(x->x_connectsocket, &readset))	/* pending connection */
+#endif
+	{
+		int sockaddrl = (int)sizeof(struct sockaddr);
+		struct sockaddr_in incomer_address;
+		int fd = accept(x->x_connectsocket, (struct sockaddr*)&incomer_address, &sockaddrl);
+		if (fd < 0) 
+		{
+			post("nsreceive~: accept failed");
+			return;
+		}
+#ifdef O_NONBLOCK
+		fcntl(fd, F_SETFL, O_NONBLOCK);
+#endif
+		if (x->x_socket != -1)
+		{
+			post("nsreceive~: new connection");
+			nsreceive_tilde_closesocket(x);
+		}
+
+		nsreceive_tilde_reset(x, 0);
+		x->x_socket = fd;
+		//x->x_nbytes = 0;
+		x->x_hostname = gensym(inet_ntoa(incomer_address.sin_addr));
+#ifdef PD
+		sys_addpollfn(fd, nsreceive_tilde_datapoll, x);
+		outlet_float(x->x_outlet1, 1);
+#else
+		clock_delay(x->x_datapoll, 0);
+		outlet_int(x->x_outlet1, 1);
+#endif
+	}
+#ifndef PD
+	clock_delay(x->x_connectpoll, DEFAULT_NETWORK_POLLTIME);
+#endif
+}
+
+
+/* let receives on the socket poll the device queue for usec before they
+   sleep (SO_BUSY_POLL, raising it needs CAP_NET_ADMIN) */
+static int nsreceive_tilde_portbusypoll(t_nsport *p, int usec)
+{
+#ifdef SO_BUSY_POLL
+	if (setsockopt(p->p_fd, SOL_SOCKET, SO_BUSY_POLL, (char *)&usec, sizeof(usec)) < 0)
+		return 0;
+#ifdef SO_PREFER_BUSY_POLL
+	{
+		int prefer = usec > 0;
+		setsockopt(p->p_fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, (char *)&prefer, sizeof(prefer));
+	}
+#endif
+	return 1;
+#else
+	return (usec == 0);
+#endif
+}
+
+
+/* find the port or open its socket */
+static t_nsport *nsreceive_tilde_portopen(int portno)
+{
+    struct sockaddr_in server;
+    t_nsport *p;
+    int sockfd, i;
+
+    for (p = nsreceive_tilde_ports; p; p = p->p_next)
+    {
+      if (p->p_portno == portno)
+	return p;
+    }
+
+      sockfd = socket(AF_INET, SOCK_DGRAM, 0);
 
 
     if (sockfd < 0)
@@ -708,7 +1505,7 @@ static int nsreceive_tilde_createsocket(t_nsreceive_tilde* x, int portno)
     server.sin_port = htons((u_short)portno);
     post("listening to port number %d", portno);
 
-    nsreceive_tilde_setsocketoptions(x,sockfd);
+    nsreceive_tilde_setsocketoptions(sockfd);
 
 
     /* name the socket */
@@ -719,15 +1516,194 @@ static int nsreceive_tilde_createsocket(t_nsreceive_tilde* x, int portno)
          return 0;
     }
 
+    p = (t_nsport *)getbytes(sizeof(t_nsport));
+    p->p_fd = sockfd;
+    p->p_portno = portno;
+    for (i = 0; i < DEFAULT_RECV_BATCH; i++)
+      p->p_batch[i] = (t_frame *)getbytes(sizeof(t_frame));
+#if defined(UDP_GRO) && defined(HAVE_RECVMMSG)
+	/* large frames come as many datagrams, let the kernel coalesce them
+	   (Linux 5.0). without it we read them one by one */
+	{
+		int one = 1;
+		if (setsockopt(sockfd, SOL_UDP, UDP_GRO, &one, sizeof(one)) == 0)
+			p->p_grobuf = (char *)getbytes(DEFAULT_GRO_BATCH * DEFAULT_GRO_SIZE);
+	}
+#endif
+#ifdef SO_TIMESTAMPNS
+    /* arrival times for the jitter statistics come from the kernel, not
+       from when pd got around to reading */
+    {
+      int one = 1;
+      p->p_kernelstamps = setsockopt(sockfd, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one)) == 0;
+    }
+#endif
+    if (nsreactor_getbusypoll())
+      nsreceive_tilde_portbusypoll(p, nsreactor_getbusypoll());
+    p->p_next = nsreceive_tilde_ports;
+    nsreceive_tilde_ports = p;
+
+#ifdef PD
+    sys_addpollfn(sockfd, nsreceive_tilde_portpoll, p);
+#endif
+    return p;
+}
 
- 
-	
-         x->x_socket = sockfd;
 
+static int nsreceive_tilde_inboxalloc(t_nsreceive_tilde *x)
+{
+	int i;
+
+	if (x->x_inbox)
+		return 1;
+	if (!(x->x_inbox = (t_nsinbox *)getbytes(DEFAULT_INBOX_FRAMES * sizeof(t_nsinbox))))
+		return 0;
+	for (i = 0; i < DEFAULT_INBOX_FRAMES; i++)
+		x->x_inbox[i].i_frame = (t_frame *)getbytes(sizeof(t_frame));
+	x->x_inboxhead = x->x_inboxtail = 0;
+	return 1;
+}
+
+
+/* move a port between pd's poll loop and the reactor threads */
+static void nsreceive_tilde_portsetio(t_nsport *p, int threaded)
+{
+	t_nsreceive_tilde *x;
+
+	if (threaded && !p->p_threaded)
+	{
+		for (x = p->p_receivers; x; x = x->x_nextonport)
+			if (!nsreceive_tilde_inboxalloc(x))
+				return;
 #ifdef PD
-         sys_addpollfn(sockfd, nsreceive_tilde_datapoll, x);
-#else
-		 clock_delay(x->x_datapoll, 0);
+		sys_rmpollfn(p->p_fd);
+#endif
+		p->p_threaded = 1;
+		if (!(p->p_reactor = nsreactor_attach(p->p_fd, (t_nsreactor_fn)nsreceive_tilde_portpoll,
+						 (t_nsreactor_recvfn)nsreceive_tilde_portrecv, p)))
+			threaded = 0;
+	}
+	if (!threaded && p->p_threaded)
+	{
+		nsreactor_detach(p->p_reactor, p->p_fd, p);
+		p->p_reactor = 0;
+		p->p_threaded = 0;
+#ifdef PD
+		sys_addpollfn(p->p_fd, nsreceive_tilde_portpoll, p);
+#endif
+	}
+}
+
+
+/* the reactor thread walks p_receivers, take the port away from it while
+   the list changes */
+static void nsreceive_tilde_portlock(t_nsport *p)
+{
+	if (p->p_reactor)
+		nsreactor_detach(p->p_reactor, p->p_fd, p);
+}
+
+static void nsreceive_tilde_portunlock(t_nsport *p)
+{
+	if (p->p_reactor && !(p->p_reactor = nsreactor_attach(p->p_fd, (t_nsreactor_fn)nsreceive_tilde_portpoll,
+						 (t_nsreactor_recvfn)nsreceive_tilde_portrecv, p)))
+	{
+		p->p_threaded = 0;
+#ifdef PD
+		sys_addpollfn(p->p_fd, nsreceive_tilde_portpoll, p);
+#endif
+	}
+}
+
+
+static void nsreceive_tilde_portclose(t_nsport *p)
+{
+	t_nsport **pp;
+	int i;
+
+	for (pp = &nsreceive_tilde_ports; *pp; pp = &(*pp)->p_next)
+		if (*pp == p)
+		{
+			*pp = p->p_next;
+			break;
+		}
+	if (p->p_threaded)
+		nsreactor_detach(p->p_reactor, p->p_fd, p);
+#ifdef PD
+	else
+		sys_rmpollfn(p->p_fd);
+#endif
+	CLOSESOCKET(p->p_fd);
+	for (i = 0; i < DEFAULT_RECV_BATCH; i++)
+		freebytes(p->p_batch[i], sizeof(t_frame));
+	if (p->p_grobuf)
+		freebytes(p->p_grobuf, DEFAULT_GRO_BATCH * DEFAULT_GRO_SIZE);
+	for (i = 0; i < DEFAULT_MAX_SOURCES; i++)
+		if (p->p_partials[i].f_frame)
+			freebytes(p->p_partials[i].f_frame, sizeof(t_frame));
+	freebytes(p, sizeof(t_nsport));
+}
+
+
+/* stop listening, the port socket is closed with its last receiver */
+static void nsreceive_tilde_detach(t_nsreceive_tilde *x)
+{
+	t_nsport *p = x->x_port;
+	t_nsreceive_tilde **xp;
+
+	if (!p)
+		return;
+	nsreceive_tilde_leaveall(x);
+	nsreceive_tilde_portlock(p);
+	for (xp = &p->p_receivers; *xp; xp = &(*xp)->x_nextonport)
+		if (*xp == x)
+		{
+			*xp = x->x_nextonport;
+			break;
+		}
+	nsreceive_tilde_portunlock(p);
+#ifndef PD
+	clock_unset(x->x_datapoll);
+#endif
+	x->x_port = 0;
+	x->x_metricsport = 0;
+	x->x_socket = -1;
+	if (!p->p_receivers)
+		nsreceive_tilde_portclose(p);
+}
+
+
+static void nsreceive_tilde_shmclose(t_nsreceive_tilde *x)
+{
+	if (!x->x_shm)
+		return;
+	nsshm_close(x->x_shm);
+	x->x_shm = 0;
+	x->x_shmsync = 0;
+	x->x_shmunderflows = x->x_shmoverruns = 0;
+}
+
+
+static int nsreceive_tilde_createsocket(t_nsreceive_tilde* x, int portno)
+{
+	t_nsport *p;
+
+	if (nsreactor_getthreads() && !nsreceive_tilde_inboxalloc(x))
+		return 0;
+	if (!(p = nsreceive_tilde_portopen(portno)))
+		return 0;
+	x->x_port = p;
+	x->x_metricsport = p->p_portno;
+	x->x_socket = p->p_fd;
+	nsreceive_tilde_portlock(p);
+	x->x_nextonport = p->p_receivers;
+	p->p_receivers = x;
+	nsreceive_tilde_portunlock(p);
+	nsreceive_tilde_portsetio(p, nsreactor_getthreads() > 0);
+	nsreceive_tilde_joinall(x);
+
+#ifndef PD
+	clock_delay(x->x_datapoll, 0);
 #endif
     return 1;
 }
@@ -740,8 +1716,19 @@ static void nsreceive_tilde_receivefrom(t_nsreceive_tilde *x, t_symbol *host, t_
 static void nsreceive_tilde_receivefrom(t_nsreceive_tilde *x, t_symbol *host, long fportno)
 #endif
 {
-  
+  const char *name;
 
+  nsreceive_tilde_detach(x);
+  nsreceive_tilde_shmclose(x);
+
+  /* same host: read the ring an nstream~ connected to shm:<name> writes */
+  if (host != ps_nothing && (name = nsshm_name(host->s_name)))
+  {
+    if (!(x->x_shm = nsshm_open(name)))
+      nsreceive_tilde_sockerror("shm_open");
+    x->x_mcastaddress = host;
+    return;
+  }
 
   if (host != ps_nothing)
     x->x_mcastaddress = host;
@@ -753,280 +1740,487 @@ static void nsreceive_tilde_receivefrom(t_nsreceive_tilde *x, t_symbol *host, lo
   else
     x->x_portno = (int)fportno;
 
+  nsreceive_tilde_createsocket(x, x->x_portno);
+}
+
+
+/* only play packets sent with this stream id, lets many receivers share a port */
+#ifdef PD
+static void nsreceive_tilde_streamid(t_nsreceive_tilde *x, t_floatarg id)
+#else
+static void nsreceive_tilde_streamid(t_nsreceive_tilde *x, long id)
+#endif
+{
+	x->x_streamid = CLIP((int)id, 0, 255);
+	nsreceive_tilde_reset(x, 0);
+	post("nsreceive~: stream id set to %d", x->x_streamid);
+}
+
+
+/* serve the sockets of all receivers from n shared I/O threads (epoll, or
+   uring for io_uring), 0 goes back to pd's poll loop */
+#ifdef PD
+static void nsreceive_tilde_reactor(t_nsreceive_tilde *x, t_floatarg n, t_symbol *backend)
+#else
+static void nsreceive_tilde_reactor(t_nsreceive_tilde *x, long n, t_symbol *backend)
+#endif
+{
+	t_nsport *p;
+	int threads;
+
+	/* ports move to the new threads, the old ones go away */
+	for (p = nsreceive_tilde_ports; p; p = p->p_next)
+		nsreceive_tilde_portsetio(p, 0);
+	threads = nsreactor_setthreads((int)n, backend == gensym("uring") ? NSREACTOR_URING : NSREACTOR_EPOLL);
+	for (p = nsreceive_tilde_ports; p; p = p->p_next)
+		nsreceive_tilde_portsetio(p, threads > 0);
+	if (threads)
+		post("nsreceive~: %d reactor threads (%s)", threads,
+		     nsreactor_getbackend() == NSREACTOR_URING ? "io_uring" : "epoll");
+	else if (n > 0)
+		error("nsreceive~: reactor not available on this system");
+	else
+		post("nsreceive~: reactor off");
+}
+
+
+/* lowest latency: the reactor threads and the sockets spin for up to usec
+   after each packet before they sleep, 0 turns it off. costs a core */
+#ifdef PD
+static void nsreceive_tilde_busypoll(t_nsreceive_tilde *x, t_floatarg usec)
+#else
+static void nsreceive_tilde_busypoll(t_nsreceive_tilde *x, long usec)
+#endif
+{
+	t_nsport *p;
+	int ok = 1;
+
+	nsreactor_setbusypoll((int)usec);
+	for (p = nsreceive_tilde_ports; p; p = p->p_next)
+		if (!nsreceive_tilde_portbusypoll(p, nsreactor_getbusypoll()))
+			ok = 0;
+	if (!ok)
+		nsreceive_tilde_sockerror("SO_BUSY_POLL");
+	if (!nsreactor_getbusypoll())
+		post("nsreceive~: busy polling off");
+	else if (!nsreactor_getthreads())
+		post("nsreceive~: busy polling %d usec, takes effect with reactor", nsreactor_getbusypoll());
+	else
+		post("nsreceive~: busy polling %d usec", nsreactor_getbusypoll());
+}
+
+
+/* pin the reactor threads to cpu, cpu + 1, ..., -1 unpins them */
+#ifdef PD
+static void nsreceive_tilde_affinity(t_nsreceive_tilde *x, t_floatarg cpu)
+#else
+static void nsreceive_tilde_affinity(t_nsreceive_tilde *x, long cpu)
+#endif
+{
+	int err = nsreactor_setaffinity((int)cpu);
+
+	if (err)
+		error("nsreceive~: affinity: %s", strerror(err));
+	else if (cpu >= 0)
+		post("nsreceive~: reactor threads pinned from cpu %d", (int)cpu);
+	else
+		post("nsreceive~: reactor threads not pinned");
+}
+
+
+/* SCHED_FIFO priority of the reactor threads, 0 for normal scheduling */
+#ifdef PD
+static void nsreceive_tilde_priority(t_nsreceive_tilde *x, t_floatarg priority)
+#else
+static void nsreceive_tilde_priority(t_nsreceive_tilde *x, long priority)
+#endif
+{
+	int err = nsreactor_setpriority((int)priority);
+
+	if (err)
+		error("nsreceive~: priority: %s%s", strerror(err),
+		      err == EPERM ? " (needs CAP_SYS_NICE or an rtprio limit)" : "");
+	else if (priority > 0)
+		post("nsreceive~: reactor threads run SCHED_FIFO %d", (int)priority);
+	else
+		post("nsreceive~: reactor threads run normal scheduling");
+}
+
+
+
+
+
+
+
+
+
+/* write n samples of every channel of src to out[0..x_noutlets-1]. the
+   queued frames are one sample FIFO: a block can take the end of one frame
+   and the start of the next, whatever the sender's frame size */
+static void nsreceive_tilde_pull(t_nsreceive_tilde *x, t_nsource *src, t_sample **out, int n)
+{
+	int channels, carried;
+	int i, c, k, done = 0;
+
+	while (done < n)
+	{
+		t_nsdecode decode;
+		t_tag *tag;
+
+		if (src->s_framein == src->s_frameout)
+		{
+			/* ran dry within the block, the rest is silence */
+			src->s_underflow++;
+			nstrace_add(x->x_trace, NSTRACE_UNDERFLOW, (int)(src - x->x_sources), 0, 0);
+			for (i = 0; i < x->x_noutlets; i++)
+				memset(out[i] + done, 0, (n - done) * sizeof(t_sample));
+			return;
+		}
+		tag = &src->s_frames[src->s_frameout]->tag;
+		channels = tag->channels;
+		carried = nsreceive_tilde_carried(tag);
+
+		/* a frame starts to play: how deep the queue was and how long since
+		   its first sample was produced, the network transit aside */
+		if (!src->s_framepos)
+		{
+			unsigned long long now = nsreactor_now();
+			unsigned long long stamp = src->s_stamps[src->s_frameout];
+			nshist_add(&src->s_hdepth, QUEUESIZE(src));
+			nstrace_add(x->x_trace, NSTRACE_PLAY, (int)(src - x->x_sources),
+				    tag->count, QUEUESIZE(src));
+			nshist_add(&src->s_hlatency, (now > stamp ? now - stamp : 0) +
+				   (unsigned long long)src->s_blocksize * 1000000000ULL / SOURCERATE(x, src));
+		}
+		/* every frame carries its own format, the kernel follows it */
+		decode = nskernel_decode(tag->format, tag->version != SF_BYTE_NATIVE, carried);
+
+		k = src->s_blocksize - src->s_framepos;
+		if (k > n - done)
+			k = n - done;
+
+		if (decode)
+		{
+			t_sample *o[DEFAULT_AUDIO_CHANNELS];
+			/* the carried channels in order, the ones left out play silence */
+			for (i = c = 0; i < x->x_noutlets; i++)
+			{
+				if (i < channels && (!tag->channelmask || (tag->channelmask & (1u << i))))
+					o[c++] = out[i] + done;
+				else
+					memset(out[i] + done, 0, k * sizeof(t_sample));
+			}
+			decode(tag->cbuf + src->s_framepos * carried * SF_SIZEOF(tag->format), o, carried, k);
+		}
+		else
+		{
+			if (tag->format == SF_MP3)
+				nslog_event(&x->x_log, NSRECEIVE_LOG_MP3, SF_MP3);
+			else
+				nslog_event(&x->x_log, NSRECEIVE_LOG_FORMAT, tag->format);
+			for (i = 0; i < x->x_noutlets; i++)
+				memset(out[i] + done, 0, k * sizeof(t_sample));
+		}
+		done += k;
+
+		if ((src->s_framepos += k) >= src->s_blocksize)
+		{
+			src->s_framepos = 0;
+			src->s_frameout++;
+			src->s_frameout %= DEFAULT_AUDIO_BUFFER_FRAMES;
+		}
+	}
+}
+
+
+/* play n samples of src to out[0..x_noutlets-1], through the converter
+   when the sender runs at another samplerate */
+static void nsreceive_tilde_playsource(t_nsreceive_tilde *x, t_nsource *src, t_sample **outs, int n)
+{
+	t_sample *out[DEFAULT_AUDIO_CHANNELS];
+	int i = 0, done;
 
-  if (x->x_socket != -1)
-    {
-    post("x_socket = %d x_connectsoc %d",x->x_socket,x->x_connectsocket);
+	for (i = 0; i < x->x_noutlets; i++)
+		out[i] = outs[i];
 
-#ifdef PD
-    sys_rmpollfn(x->x_socket);
+	if (!src->s_active)
+		goto bail;
 
-#else
-    clock_unset(x->x_datapoll);
+	src->s_loopcounter++;
 
-#endif
-    CLOSESOCKET(x->x_socket); 
+	/* to start reading after initialisation, check whether there is enough data in buffer */
+	if ((long)src->s_counter * src->s_blocksize < nsreceive_tilde_target(x, src))
+	{
+	  goto idle;
+	}
+	
+	/* check for buffer underflow */
+	if (src->s_framein == src->s_frameout)
+	  {
+	    src->s_underflow++;
+	    nstrace_add(x->x_trace, NSTRACE_UNDERFLOW, (int)(src - x->x_sources), 0, 0);
 
-    x->x_socket = -1;
+	    goto idle;
+	  }
+	src->s_idle = 0;
 
-    } 
-  nsreceive_tilde_createsocket(x, fportno);
-}
+	/* queue balancing */
+	src->s_average[src->s_averagecur] = QUEUESIZE(src);
+	if (++src->s_averagecur >= DEFAULT_AVERAGE_NUMBER)
+		src->s_averagecur = 0;
 
+	if (!src->s_resample)
+	{
+		nsreceive_tilde_pull(x, src, out, n);
+		return;
+	}
+	for (done = 0; done < n; done += NSRESAMPLE_CHUNK)
+	{
+		t_nsresample *r = src->s_resample;
+		t_sample *in[DEFAULT_AUDIO_CHANNELS], *o[DEFAULT_AUDIO_CHANNELS];
+		int m = n - done < NSRESAMPLE_CHUNK ? n - done : NSRESAMPLE_CHUNK;
+		int k = nsresample_need(r, m);
 
+		nsresample_input(r, in);
+		nsreceive_tilde_pull(x, src, in, k);
+		for (i = 0; i < x->x_noutlets; i++)
+			o[i] = out[i] + done;
+		nsresample_run(r, k, o, m);
+	}
+	return;
+
+idle:
+	/* release the slot of a sender that went away */
+	if (++src->s_idle > x->x_idlelimit)
+	{
+		if (x->x_nsources > 1)
+			nslog_event(&x->x_log, NSRECEIVE_LOG_TIMEOUT, (int)(src - x->x_sources));
+		src->s_active = 0;
+	}
+bail:
+	/* set output to zero */
+	while (n--)
+	{
+		for (i = 0; i < x->x_noutlets; i++)
+		{
+			*(out[i]++) = 0.;
+		}
+	}
+}
 
 
+/* play n frames of the shared ring to out[0..x_noutlets-1], staying
+   DEFAULT_SHM_LATENCY blocks behind the writer. the writer never waits
+   for us, so a copy it may have overwritten meanwhile is discarded */
+static void nsreceive_tilde_playshm(t_nsreceive_tilde *x, t_sample **out, int n)
+{
+	t_nsshmring *ring = x->x_shm;
+	unsigned int writepos = NS_LOAD_ACQUIRE(&ring->r_writepos);
+	int lag = DEFAULT_SHM_LATENCY * n;
+	int channels = ring->r_channels;
+	int ahead = (int)(writepos - x->x_shmpos);
+	int i, k;
+
+	if (channels > x->x_noutlets)
+		channels = x->x_noutlets;
+	if (!NS_LOAD_ACQUIRE(&ring->r_writer) || channels <= 0 || n > DEFAULT_SHM_FRAMES / 4)
+	{
+		x->x_shmsync = 0;
+		goto silence;
+	}
+	if (!x->x_shmsync || ahead > DEFAULT_SHM_FRAMES - n || ahead < -lag)
+	{
+		if (x->x_shmsync)
+			x->x_shmoverruns++;
+		x->x_shmpos = writepos - lag;
+		x->x_shmsync = 1;
+		ahead = lag;
+	}
+	if (ahead < (x->x_shmsync == 2 ? lag : n))
+	{
+		/* writer late: silence until it is lag frames ahead again */
+		if (x->x_shmsync == 1)
+			x->x_shmunderflows++;
+		x->x_shmsync = 2;
+		goto silence;
+	}
+	x->x_shmsync = 1;
 
+	for (k = 0; k < n; k++)
+	{
+		const float *frame = ring->r_data + ((x->x_shmpos + k) & (DEFAULT_SHM_FRAMES - 1)) * DEFAULT_SHM_CHANNELS;
+		for (i = 0; i < channels; i++)
+			out[i][k] = frame[i];
+	}
+	for (i = channels; i < x->x_noutlets; i++)
+		memset(out[i], 0, n * sizeof(t_sample));
 
+	/* the data reads must be done before writepos is checked again */
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	writepos = NS_LOAD_ACQUIRE(&ring->r_writepos);
+	if ((int)(writepos - x->x_shmpos) > DEFAULT_SHM_FRAMES - n)
+	{
+		x->x_shmoverruns++;
+		x->x_shmsync = 0;
+		goto silence;
+	}
+	x->x_shmpos += n;
+	return;
 
+silence:
+	for (i = 0; i < x->x_noutlets; i++)
+		memset(out[i], 0, n * sizeof(t_sample));
+}
 
 
 static t_int *nsreceive_tilde_perform(t_int *w)
 {
 	t_nsreceive_tilde *x = (t_nsreceive_tilde*) (w[1]);
 	int n = (int)(w[2]);
-	//t_float *out[DEFAULT_AUDIO_CHANNELS];
-	t_sample *out[DEFAULT_AUDIO_CHANNELS];
+	t_sample **out = (t_sample **)(w + 3);
 	const int offset = 3;
-	const int channels = x->x_frames[x->x_frameout].tag.channels;
-	int i = 0;
+	int i, j, k;
+	NSPERF_START(tperform);
 
-	x->x_loopcounter++;
+	if (x->x_shm)
+	{
+		nsreceive_tilde_playshm(x, out, n);
+		for (i = x->x_noutlets; i < x->x_nsignals; i++)
+			memset(out[i], 0, n * sizeof(t_sample));
+		NSPERF_STOP(x->x_perfperform, tperform);
+		return (w + offset + x->x_nsignals);
+	}
 
-	for (i = 0; i < x->x_noutlets; i++)
+	if (x->x_inbox)
 	{
-	  //out[i] = (t_float *)(w[offset + i]);
-	  out[i] = (t_sample *)(w[offset + i]);
+		NSPERF_START(tinbox);
+		nsreceive_tilde_inboxdrain(x);
+		NSPERF_STOP(x->x_perfinbox, tinbox);
 	}
 
 	if (n != x->x_vecsize)
 	{
+	  nslog_event(&x->x_log, NSRECEIVE_LOG_VECSIZE, n);
 
-
-	  post("nsreceive: convertion de vectsize");
-
-		x->x_vecsize = n;
-		x->x_blocksperrecv = x->x_blocksize / x->x_vecsize;
-		x->x_blockssincerecv = 0;
+		x->x_vecsize = n;	/* playout does not care, it is sample granular */
 	}
 
-	/* to start reading after initialisation, check whether there is enough data in buffer */
-	if (x->x_counter < x->x_maxframes)
+	NSPERF_START(tdecode);
+	if (!x->x_mix)
 	{
-
-	  goto bail;
+		/* one set of outlets per source */
+		for (k = 0; k < x->x_nsources; k++)
+			nsreceive_tilde_playsource(x, &x->x_sources[k], out + k * x->x_noutlets, n);
 	}
-	
-	/* check for buffer underflow */
-	if (x->x_framein == x->x_frameout)
-	  {
-	    x->x_underflow++;
-
-	    goto bail;
-	  }
-	
-
-	/* queue balancing */
-	x->x_average[x->x_averagecur] = QUEUESIZE;
-	if (++x->x_averagecur >= DEFAULT_AVERAGE_NUMBER)
-		x->x_averagecur = 0;
-
-	switch (x->x_frames[x->x_frameout].tag.format)
+	else
 	{
-		case SF_FLOAT:
-		{
+		/* sum all sources into the outlets */
+		t_sample *tmp[DEFAULT_AUDIO_CHANNELS];
 
-		  //t_float* buf = (t_float *)x->x_frames[x->x_frameout].tag.cbuf + BLOCKOFFSET;
-		  t_sample* buf = (t_sample *)x->x_frames[x->x_frameout].tag.cbuf + BLOCKOFFSET;
-
-			if (x->x_frames[x->x_frameout].tag.version == SF_BYTE_NATIVE)
-			{
-				while (n--)
-				{
-					for (i = 0; i < channels; i++)
-					{     
-						*out[i]++ = *buf++;
-					}
-					for (i = channels; i < x->x_noutlets; i++)
-					{     
-						*out[i]++ = 0.;
-					}
-				}
-			}
-			else	/* swap bytes */
-			{
-				while (n--)
-				{
-					for (i = 0; i < channels; i++)
-					{     
-						*out[i]++ = nstream_float(*buf++);
-					}
-					for (i = channels; i < x->x_noutlets; i++)
-					{     
-						*out[i]++ = 0.;
-					}
-				}
-			}
-			break;
-		}
-		case SF_16BIT:     
+		for (i = 0; i < x->x_noutlets; i++)
 		{
-			short* buf = (short *)x->x_frames[x->x_frameout].tag.cbuf + BLOCKOFFSET;
-
-			//if (x->x_frames[x->x_frameout].tag.version == SF_BYTE_SF_BYTE_LE)
-			{
-				while (n--)
-				{
-					for (i = 0; i < channels; i++)
-					{
-
-					  
-#ifdef FIXEDPOINT
-					  *out[i]++ = (t_sample)INVSCALE16(*buf++);
-#else
-					  *out[i]++ = (t_float)(*buf++ * 3.051850e-05);
-#endif
-					  
-					}
-					
-
-					for (i = channels; i < x->x_noutlets; i++)
-					{
-						*out[i]++ = 0.;
-					}
-				}
-			}
-/* 			else /\* swap bytes *\/ */
-/* 			{ */
-/* 				while (n--) */
-/* 				{ */
-/* 					for (i = 0; i < channels; i++) */
-/* 					{ */
-/* 					  *out[i]++ = (t_float)(nstream_short(*buf++) * 3.051850e-05); */
-/* 					} */
-/* 					for (i = channels; i < x->x_noutlets; i++) */
-/* 					{ */
-/* 						*out[i]++ = 0.; */
-/* 					} */
-/* 				} */
-/* 			} */
-			break;
+			tmp[i] = x->x_mixbuf + i * n;
+			memset(out[i], 0, n * sizeof(t_sample));
 		}
-		case SF_8BIT:     
+		for (k = 0; k < x->x_nsources; k++)
 		{
-			char* buf = (char *)x->x_frames[x->x_frameout].tag.cbuf + BLOCKOFFSET;
-
-			while (n--)
+			if (!x->x_sources[k].s_active)
+				continue;
+			nsreceive_tilde_playsource(x, &x->x_sources[k], tmp, n);
+			for (i = 0; i < x->x_noutlets; i++)
 			{
-				for (i = 0; i < channels; i++)
-				{ 
-	 			  
-#ifdef FIXEDPOINT				 
-				  *out[i]++ = (t_sample)INVSCALE8(*buf++) - 1.;
-#else
-				  *out[i]++ = (t_sample)((0.0078125 * (*buf++)) - 1.0);
-#endif	 
-				}
-		    		for (i = channels; i < x->x_noutlets; i++)
-				{
-					*out[i]++ = 0.;
-				}
+				t_sample *restrict o = out[i];
+				const t_sample *restrict t = tmp[i];
+				for (j = 0; j < n; j++)
+					o[j] += t[j];
 			}
-			break;
-		}
-		case SF_MP3:     
-		{
-			post("nsreceive~: mp3 format not supported");
-			
 		}
-		default:
-			post("nsreceive~: unknown format (%d)",x->x_frames[x->x_frameout].tag.format);
-			
-			break;
 	}
+	NSPERF_STOP(x->x_perfdecode, tdecode);
 
-	if (!(x->x_blockssincerecv < x->x_blocksperrecv - 1))
-	{
-		x->x_blockssincerecv = 0;
-		x->x_frameout++;
-		x->x_frameout %= DEFAULT_AUDIO_BUFFER_FRAMES;
-	}
-	else
-	{
-		x->x_blockssincerecv++;
-	}
-
-	return (w + offset + x->x_noutlets);
-
-bail:
-	/* set output to zero */
-	while (n--)
-	{
-		for (i = 0; i < x->x_noutlets; i++)
-		{
-			*(out[i]++) = 0.;
-		}
-	}
-	return (w + offset + x->x_noutlets);
+	NSPERF_STOP(x->x_perfperform, tperform);
+	return (w + offset + x->x_nsignals);
 }
 
 
 
 static void nsreceive_tilde_dsp(t_nsreceive_tilde *x, t_signal **sp)
 {
-	int i;
+	int i, k;
 
 	x->x_myvec[0] = (t_int*)x;
 	x->x_myvec[1] = (t_int*)sp[0]->s_n;
 
 	x->x_samplerate = (long)sp[0]->s_sr;
-	if(x->x_blockduration == 0) x->x_blockduration = (1000000 * x->x_blocksize) / x->x_samplerate ;
+	for (k = 0; k < x->x_nsources; k++)
+	{
+		if(x->x_sources[k].s_blockduration == 0) x->x_sources[k].s_blockduration = (1000000 * x->x_sources[k].s_blocksize) / x->x_samplerate ;
+		nsreceive_tilde_resampler(x, &x->x_sources[k]);
+	}
 	if(x->x_loopduration == 0) x->x_loopduration = (1000000 * 64) / x->x_samplerate ;
+	x->x_idlelimit = (int)((DEFAULT_SOURCE_TIMEOUT * x->x_samplerate) / (1000 * sp[0]->s_n));
 
-
-	post("samplerate %d, blockduration %d",x->x_samplerate,x->x_blockduration );
-	post("samplerate %d, loopduration %d",x->x_samplerate,x->x_loopduration );
-	
-	if (DEFAULT_AUDIO_BUFFER_SIZE % sp[0]->s_n)
+	/* scratch vectors for the mixer */
+	if (x->x_mix && x->x_mixbufsize < sp[0]->s_n * x->x_noutlets)
 	{
-		error("nstream~: signal vector size too large (needs to be even divisor of %d)", DEFAULT_AUDIO_BUFFER_SIZE);
+		x->x_mixbuf = (t_sample *)resizebytes(x->x_mixbuf, x->x_mixbufsize * sizeof(t_sample),
+						      sp[0]->s_n * x->x_noutlets * sizeof(t_sample));
+		x->x_mixbufsize = sp[0]->s_n * x->x_noutlets;
 	}
-	else
-	{
+	
+	/* any vector size, frames are played sample by sample */
 #ifdef PD
-		for (i = 0; i < x->x_noutlets; i++)
-		{
-			x->x_myvec[2 + i] = (t_int*)sp[i + 1]->s_vec;
-		}
-		dsp_addv(nsreceive_tilde_perform, x->x_noutlets + 2, (t_int*)x->x_myvec);
+	for (i = 0; i < x->x_nsignals; i++)
+	{
+		x->x_myvec[2 + i] = (t_int*)sp[i + 1]->s_vec;
+	}
+	dsp_addv(nsreceive_tilde_perform, x->x_nsignals + 2, (t_int*)x->x_myvec);
 #else
-		for (i = 0; i < x->x_noutlets; i++)
-		{
-			x->x_myvec[2 + i] = (t_int*)sp[i]->s_vec;
-		}
-		dsp_addv(nsreceive_tilde_perform, x->x_noutlets + 2, (void **)x->x_myvec);
-#endif	/* PD */
+	for (i = 0; i < x->x_nsignals; i++)
+	{
+		x->x_myvec[2 + i] = (t_int*)sp[i]->s_vec;
 	}
+	dsp_addv(nsreceive_tilde_perform, x->x_nsignals + 2, (void **)x->x_myvec);
+#endif	/* PD */
 }
 
 
-/* send stream info when banged */
-static void nsreceive_tilde_bang(t_nsreceive_tilde *x)
+#define LASTFRAME(src) (((src)->s_framein + DEFAULT_AUDIO_BUFFER_FRAMES - 1) % DEFAULT_AUDIO_BUFFER_FRAMES)
+
+/* send stream info of one source */
+static const double nsreceive_tilde_percents[] = { 50, 90, 99, 99.9 };
+
+
+/* "<s> <p50> <p90> <p99> <p99.9>" with the values multiplied by scale */
+static void nsreceive_tilde_percentiles(t_nsreceive_tilde *x, t_symbol *s, const t_nshist *h, double scale)
+{
+	t_atom list[4];
+	int i;
+
+	if (!h->h_total)
+		return;
+	for (i = 0; i < 4; i++)
+		SETFLOAT(list + i, (t_float)(nshist_percentile(h, nsreceive_tilde_percents[i]) * scale));
+	outlet_anything(x->x_outlet2, s, 4, list);
+}
+
+
+static void nsreceive_tilde_bangsource(t_nsreceive_tilde *x, t_nsource *src)
 {
  	t_atom list[2]; 
  	t_symbol *sf_format; 
  	t_float bitrate; 
  	int i, avg = 0; 
  	for (i = 0; i < DEFAULT_AVERAGE_NUMBER; i++) 
- 		avg += x->x_average[i]; 
+ 		avg += src->s_average[i]; 
 
 	
 
- 	bitrate = (t_float)((SF_SIZEOF(x->x_frames[x->x_frameout].tag.format) * x->x_samplerate * 8 * x->x_frames[x->x_frameout].tag.channels) / 1000.); 
+ 	bitrate = (t_float)((SF_SIZEOF(src->s_frames[src->s_frameout]->tag.format) * SOURCERATE(x, src) * 8 * src->s_frames[src->s_frameout]->tag.channels) / 1000.); 
 
 	
 
- 	switch (x->x_frames[x->x_frameout].tag.format) 
+ 	switch (src->s_frames[src->s_frameout]->tag.format) 
  	{ 
  		case SF_FLOAT: 
  		{ 
@@ -1064,11 +2258,11 @@ static void nsreceive_tilde_bang(t_nsreceive_tilde *x)
  	outlet_anything(x->x_outlet2, ps_format, 1, list); 
 
  	/* channels */ 
- 	SETFLOAT(list, (t_float)x->x_frames[x->x_frameout].tag.channels); 
+ 	SETFLOAT(list, (t_float)src->s_frames[src->s_frameout]->tag.channels); 
  	outlet_anything(x->x_outlet2, ps_channels, 1, list); 
 
  	/* framesize */ 
- 	SETFLOAT(list, (t_float)x->x_frames[x->x_frameout].tag.framesize); 
+ 	SETFLOAT(list, (t_float)src->s_frames[src->s_frameout]->tag.framesize); 
  	outlet_anything(x->x_outlet2, ps_framesize, 1, list); 
 
  	/* bitrate */ 
@@ -1077,15 +2271,15 @@ static void nsreceive_tilde_bang(t_nsreceive_tilde *x)
 
  	/* --- internal info (buffer and network) --- */ 
  	/* overflow */ 
- 	SETFLOAT(list, (t_float)x->x_overflow); 
+ 	SETFLOAT(list, (t_float)src->s_overflow); 
  	outlet_anything(x->x_outlet2, ps_overflow, 1, list); 
 
  	/* underflow */ 
- 	SETFLOAT(list, (t_float)x->x_underflow); 
+ 	SETFLOAT(list, (t_float)src->s_underflow); 
  	outlet_anything(x->x_outlet2, ps_underflow, 1, list); 
 
  	/* queuesize */ 
- 	SETFLOAT(list, (t_float)QUEUESIZE); 
+ 	SETFLOAT(list, (t_float)QUEUESIZE(src)); 
  	outlet_anything(x->x_outlet2, ps_queuesize, 1, list); 
 
  	/* average queuesize */ 
@@ -1093,17 +2287,22 @@ static void nsreceive_tilde_bang(t_nsreceive_tilde *x)
  	outlet_anything(x->x_outlet2, ps_average, 1, list); 
 
 		
- 	SETFLOAT(list, (t_float)x->x_blocksize); 
+ 	SETFLOAT(list, (t_float)src->s_blocksize); 
  	outlet_anything(x->x_outlet2, ps_blocksize, 1, list); 
 
+	/* tails: p50 p90 p99 p99.9 of the time between packets (ms), the
+	   queue depth at playout (frames) and the latency estimate (ms) */
+	nsreceive_tilde_percentiles(x, ps_arrivaltime, &src->s_harrival, 1e-6);
+	nsreceive_tilde_percentiles(x, ps_depth, &src->s_hdepth, 1);
+	nsreceive_tilde_percentiles(x, ps_latency, &src->s_hlatency, 1e-6);
+
 	char buffer[30]; 
  	
 	struct timeval tv; 
- 	time_t curtime; 
+ 	unsigned long long curtime = nsreactor_now();	/* the clock of the packet stamps */
  	gettimeofday(&tv, NULL);  
- 	curtime=tv.tv_sec; 
 	
- 	if((long) curtime != x->x_datebegin  && x->x_datebegin != 0 && x->x_lastdate != 0) 
+ 	if(curtime > src->s_lastdate  && src->s_datebegin != 0 && src->s_lastdate != 0) 
  	  { 
   	  //date  
   	    //strftime(buffer,30,"%m-%d-%Y  %T.",localtime(&curtime));  
@@ -1113,28 +2312,28 @@ static void nsreceive_tilde_bang(t_nsreceive_tilde *x)
 	    // strftime(buffer,30,"%s",localtime(&curtime));    
 	    //post("%ld\n",tv.tv_sec);  
 	    //  	   post("%s%ld\n",buffer,tv.tv_usec);  
-  	    //post("usec %ld\n",tv.tv_usec+ 1000000 * (tv.tv_sec - x->x_datebegin));  
+  	    //post("usec %ld\n",tv.tv_usec+ 1000000 * (tv.tv_sec - src->s_datebegin));  
   	    //post("%s\n",buffer,tv.tv_usec);  
    	    t_symbol *date = gensym(buffer);   
    	    SETSYMBOL(list, (t_symbol *)date);   
    	    outlet_anything(x->x_outlet2, ps_date, 1, list);   
 	  
  	     //average data throughput (without headers) in kbits/s  
-  	    t_float avdatathroughput = (x->x_frames[x->x_framein].tag.framesize * 8 * x->x_counter)   
-  	      / (( curtime - x->x_datebegin) * 1000.) ;  
+  	    t_float avdatathroughput = (src->s_frames[LASTFRAME(src)]->tag.framesize * 8 * src->s_counter)   
+  	      / (( curtime - src->s_datebegin) * 1e-6) ;  
   	    SETFLOAT(list, (t_float) avdatathroughput);  
   	    outlet_anything(x->x_outlet2, ps_avdatathrp, 1, list);  
 
   	    //data throughput (without headers) since last bang in kbits/s  
-  	    t_float datathroughput = (x->x_frames[x->x_framein].tag.framesize * 8 * x->x_lastcounter)   
-  	      / (( curtime - x->x_lastdate) * 1000.) ;  
+  	    t_float datathroughput = (src->s_frames[LASTFRAME(src)]->tag.framesize * 8 * src->s_lastcounter)   
+  	      / (( curtime - src->s_lastdate) * 1e-6) ;  
   	    SETFLOAT(list, (t_float) datathroughput);  
   	    outlet_anything(x->x_outlet2, ps_datathrp, 1, list);  
 	    
   	    //network losses since the begining  
   	    t_float avlosses;  
-  	    if((x->x_counter + x->x_lost) != 0 )  
-  	      avlosses = 100. * x->x_lost / (x->x_counter + x->x_lost);  
+  	    if((src->s_counter + src->s_lost) != 0 )  
+  	      avlosses = 100. * src->s_lost / (src->s_counter + src->s_lost);  
   	    else  
   	      avlosses = 0;  
   	    SETFLOAT(list, (t_float) avlosses);  
@@ -1142,8 +2341,8 @@ static void nsreceive_tilde_bang(t_nsreceive_tilde *x)
 
   	    //network losses since last bang  
   	    t_float losses;  
-  	    if((x->x_lastcounter + x->x_lastlost) != 0 )  
-  	      losses = 100. * x->x_lastlost / (x->x_lastcounter + x->x_lastlost);  
+  	    if((src->s_lastcounter + src->s_lastlost) != 0 )  
+  	      losses = 100. * src->s_lastlost / (src->s_lastcounter + src->s_lastlost);  
   	    else  
   	      losses = 0;  
   	    SETFLOAT(list, (t_float) losses);  
@@ -1153,12 +2352,16 @@ static void nsreceive_tilde_bang(t_nsreceive_tilde *x)
 
 
   	    //max jitter (ms)  
-  	    t_float jitter = (x->x_jittermax - x->x_jittermin) / 1000.;  
+  	    t_float jitter = (src->s_jittermax - src->s_jittermin) / 1000.;  
   	    SETFLOAT(list, (t_float) jitter);  
   	    outlet_anything(x->x_outlet2, ps_jitter, 1, list);  
-  	    //	    post("jittermin %d jittermax %d blockduration %d lastcounter %d lastlost %d",x->x_jittermin,x->x_jittermax,x->x_blockduration,x->x_lastcounter,x->x_lastlost);  
 
-  	    x->x_lastdate=0; //updated at next packet, (jittermin, max and lastusecdate also)  
+  	    //interarrival jitter from the receive timestamps (ms)
+  	    SETFLOAT(list, (t_float)(src->s_ijitter / 1000000.));
+  	    outlet_anything(x->x_outlet2, ps_interarrival, 1, list);
+  	    //	    post("jittermin %d jittermax %d blockduration %d lastcounter %d lastlost %d",src->s_jittermin,src->s_jittermax,x->x_blockduration,src->s_lastcounter,src->s_lastlost);  
+
+  	    src->s_lastdate=0; //updated at next packet, (jittermin, max and lastusecdate also)  
 
  	  } 
 
@@ -1174,12 +2377,12 @@ static void nsreceive_tilde_bang(t_nsreceive_tilde *x)
 
 /* 	/\* channels *\/ */
 /* 	SETSYM(list, ps_channels); */
-/* 	SETLONG(list + 1, (int)x->x_frames[x->x_frameout].tag.channels); */
+/* 	SETLONG(list + 1, (int)src->s_frames[src->s_frameout]->tag.channels); */
 /* 	outlet_list(x->x_outlet2, NULL, 2, list); */
 
 /* 	/\* framesize *\/ */
 /* 	SETSYM(list, ps_framesize); */
-/* 	SETLONG(list + 1, (int)x->x_frames[x->x_frameout].tag.framesize); */
+/* 	SETLONG(list + 1, (int)src->s_frames[src->s_frameout]->tag.framesize); */
 /* 	outlet_list(x->x_outlet2, NULL, 2, list); */
 
 /* 	/\* bitrate *\/ */
@@ -1190,17 +2393,17 @@ static void nsreceive_tilde_bang(t_nsreceive_tilde *x)
 /* 	/\* --- internal info (buffer and network) --- *\/ */
 /* 	/\* overflow *\/ */
 /* 	SETSYM(list, ps_overflow); */
-/* 	SETLONG(list + 1, (int)x->x_overflow); */
+/* 	SETLONG(list + 1, (int)src->s_overflow); */
 /* 	outlet_list(x->x_outlet2, NULL, 2, list); */
 
 /* 	/\* underflow *\/ */
 /* 	SETSYM(list, ps_underflow); */
-/* 	SETLONG(list + 1, (int)x->x_underflow); */
+/* 	SETLONG(list + 1, (int)src->s_underflow); */
 /* 	outlet_list(x->x_outlet2, NULL, 2, list); */
 
 /* 	/\* queuesize *\/ */
 /* 	SETSYM(list, ps_queuesize); */
-/* 	SETLONG(list + 1, (int)QUEUESIZE); */
+/* 	SETLONG(list + 1, (int)QUEUESIZE(src)); */
 /* 	outlet_list(x->x_outlet2, NULL, 2, list); */
 
 /* 	/\* average queuesize *\/ */
@@ -1214,26 +2417,325 @@ static void nsreceive_tilde_bang(t_nsreceive_tilde *x)
 }
 
 
+/* send stream info when banged, prefixed with the source when there are several */
+static void nsreceive_tilde_bang(t_nsreceive_tilde *x)
+{
+	t_atom list[2];
+	int k;
+
+	for (k = 0; k < x->x_nsources; k++)
+	{
+		t_nsource *src = &x->x_sources[k];
+		if (x->x_nsources > 1)
+		{
+			if (!src->s_active)
+				continue;
+#ifdef PD
+			SETFLOAT(list, (t_float)k);
+			SETSYMBOL(list + 1, gensym(inet_ntoa(src->s_from.sin_addr)));
+			outlet_anything(x->x_outlet2, ps_source, 2, list);
+#endif
+		}
+		nsreceive_tilde_bangsource(x, src);
+	}
+}
+
+
+
+/* "bucket <name> <from> <to> <count>" for each non-empty bucket */
+static void nsreceive_tilde_dumphist(t_nsreceive_tilde *x, t_symbol *name, const t_nshist *h, double scale)
+{
+	unsigned long long lo, hi;
+	unsigned int count;
+	t_atom list[4];
+	int i = 0;
+
+	while ((i = nshist_next(h, i, &lo, &hi, &count)) >= 0)
+	{
+		SETSYMBOL(list, name);
+		SETFLOAT(list + 1, (t_float)(lo * scale));
+		SETFLOAT(list + 2, (t_float)(hi * scale));
+		SETFLOAT(list + 3, (t_float)count);
+		outlet_anything(x->x_outlet2, ps_bucket, 4, list);
+	}
+}
+
+
+/* dump the histograms of every source: arrivaltime, depth, latency, or
+   all of them without argument. "histogram clear" starts them over */
+static void nsreceive_tilde_histogram(t_nsreceive_tilde *x, t_symbol *which)
+{
+	t_atom list[2];
+	int k;
+
+	for (k = 0; k < x->x_nsources; k++)
+	{
+		t_nsource *src = &x->x_sources[k];
+		if (which == gensym("clear"))
+		{
+			nshist_clear(&src->s_harrival);
+			nshist_clear(&src->s_hdepth);
+			nshist_clear(&src->s_hlatency);
+			continue;
+		}
+		if (x->x_nsources > 1)
+		{
+			if (!src->s_active)
+				continue;
+			SETFLOAT(list, (t_float)k);
+			SETSYMBOL(list + 1, gensym(inet_ntoa(src->s_from.sin_addr)));
+			outlet_anything(x->x_outlet2, ps_source, 2, list);
+		}
+		if (which == ps_nothing || which == ps_arrivaltime)
+			nsreceive_tilde_dumphist(x, ps_arrivaltime, &src->s_harrival, 1e-6);
+		if (which == ps_nothing || which == ps_depth)
+			nsreceive_tilde_dumphist(x, ps_depth, &src->s_hdepth, 1);
+		if (which == ps_nothing || which == ps_latency)
+			nsreceive_tilde_dumphist(x, ps_latency, &src->s_hlatency, 1e-6);
+	}
+}
+
+
+#ifdef NSTREAM_PERF
+static void nsreceive_tilde_perfpost(const char *name, t_nshist *h, int clear)
+{
+	if (h->h_total)
+		post("nsreceive~: %-8s %8llu calls, mean %.2f max %.2f, p50 %.2f p99 %.2f p99.9 %.2f us",
+		     name, h->h_total, nshist_mean(h) / 1000., h->h_max / 1000.,
+		     nshist_percentile(h, 50) / 1000., nshist_percentile(h, 99) / 1000.,
+		     nshist_percentile(h, 99.9) / 1000.);
+	if (clear)
+		nshist_clear(h);
+}
+#endif
+
+
+/* our counters for the metrics export: one series for the receiver, one per
+   sender slot. runs on the exporter thread and only reads */
+static void nsreceive_tilde_metricsfill(t_nsreceive_tilde *x, t_nsmetricsout *o)
+{
+	unsigned long long now = nsreactor_now();
+	char name[64];
+	int i, k;
+
+	nsmetrics_series(o, "nsreceive", x->x_metrics.m_id);
+	nsmetrics_labelint(o, "port", x->x_metricsport);
+	nsmetrics_labelint(o, "stream", x->x_streamid);
+	nsmetrics_value(o, "sourcedrops_total", x->x_ndrops);
+	for (i = 0; i < x->x_log.l_ncategories; i++)
+	{
+		snprintf(name, sizeof(name), "log_%s_total", x->x_log.l_categories[i].c_name);
+		nsmetrics_value(o, name, x->x_log.l_count[i]);
+	}
+#ifdef NSTREAM_PERF
+	nsmetrics_value(o, "perform_seconds_mean", nshist_mean(&x->x_perfperform) * 1e-9);
+	nsmetrics_value(o, "perform_seconds_p99", nshist_percentile(&x->x_perfperform, 99) * 1e-9);
+	nsmetrics_value(o, "decode_seconds_mean", nshist_mean(&x->x_perfdecode) * 1e-9);
+	nsmetrics_value(o, "decode_seconds_p99", nshist_percentile(&x->x_perfdecode, 99) * 1e-9);
+#endif
+
+	for (k = 0; k < x->x_nsources; k++)
+	{
+		t_nsource *src = &x->x_sources[k];
+		unsigned long long begin = src->s_datebegin;
+		char addr[INET_ADDRSTRLEN] = "";
+
+		nsmetrics_series(o, "nsreceive", x->x_metrics.m_id);
+		nsmetrics_labelint(o, "port", x->x_metricsport);
+		nsmetrics_labelint(o, "stream", x->x_streamid);
+		nsmetrics_labelint(o, "slot", k);
+		if (src->s_active)
+			inet_ntop(AF_INET, &src->s_from.sin_addr, addr, sizeof(addr));
+		nsmetrics_label(o, "source", addr);
+		nsmetrics_value(o, "active", src->s_active);
+		nsmetrics_value(o, "packets_total", src->s_counter);
+		nsmetrics_value(o, "lost_total", src->s_lost);
+		nsmetrics_value(o, "underflows_total", src->s_underflow);
+		nsmetrics_value(o, "overflows_total", src->s_overflow);
+		nsmetrics_value(o, "queue_frames", QUEUESIZE(src));
+		nsmetrics_value(o, "jitter_seconds", src->s_ijitter * 1e-9);
+		/* average payload rate since the stream (re)started */
+		nsmetrics_value(o, "throughput_bits_per_second", begin && now > begin ?
+				8. * src->s_frames[LASTFRAME(src)]->tag.framesize * src->s_counter / ((now - begin) * 1e-9) : 0);
+		nsmetrics_value(o, "arrival_seconds_p99", nshist_percentile(&src->s_harrival, 99) * 1e-9);
+		nsmetrics_value(o, "depth_frames_p99", nshist_percentile(&src->s_hdepth, 99));
+		nsmetrics_value(o, "latency_seconds_p50", nshist_percentile(&src->s_hlatency, 50) * 1e-9);
+		nsmetrics_value(o, "latency_seconds_p99", nshist_percentile(&src->s_hlatency, 99) * 1e-9);
+	}
+}
+
+
+/* export the counters of all nstream~ and nsreceive~ of this Pd to a file,
+   or to whoever connects to unix:<path>; "metrics off" stops it */
+#ifdef PD
+static void nsreceive_tilde_metrics(t_nsreceive_tilde *x, t_symbol *target, t_symbol *format, t_floatarg interval)
+#else
+static void nsreceive_tilde_metrics(t_nsreceive_tilde *x, t_symbol *target, t_symbol *format, long interval)
+#endif
+{
+	int off = (target == gensym("off"));
+	int err = nsmetrics_start(off ? NULL : target->s_name,
+				  format == gensym("json") ? NSMETRICS_JSON : NSMETRICS_PROMETHEUS, (int)interval);
+
+	if (err)
+		error("nsreceive~: metrics %s: %s", target->s_name, strerror(err));
+	else if (off)
+		post("nsreceive~: metrics export off");
+	else
+		post("nsreceive~: metrics export to %s (%s)", target->s_name,
+		     format == gensym("json") ? "json lines" : "prometheus");
+}
+
+
+/* counts of the events the hot paths only log, "log clear" starts over */
+static void nsreceive_tilde_log(t_nsreceive_tilde *x, t_symbol *s)
+{
+	nslog_print(&x->x_log, s == gensym("clear"));
+}
+
+
+/* "trace dump <file>" writes the recent events as Chrome trace JSON,
+   "trace clear" forgets them */
+static void nsreceive_tilde_trace(t_nsreceive_tilde *x, t_symbol *cmd, t_symbol *file)
+{
+	char name[64];
+	int err;
+
+	if (cmd == gensym("clear"))
+	{
+		nstrace_clear(x->x_trace);
+		return;
+	}
+	if (cmd != gensym("dump") || file == ps_nothing)
+	{
+		error("nsreceive~: trace dump <file> | clear");
+		return;
+	}
+	snprintf(name, sizeof(name), "nsreceive~ %d stream %d", x->x_port ? x->x_port->p_portno : 0, x->x_streamid);
+	if ((err = nstrace_dump(x->x_trace, file->s_name, name)))
+		error("nsreceive~: trace dump %s: %s", file->s_name, strerror(err));
+	else
+		post("nsreceive~: trace written to %s", file->s_name);
+}
+
+
+/* cost of perform and its parts, "perf clear" starts over */
+static void nsreceive_tilde_perf(t_nsreceive_tilde *x, t_symbol *s)
+{
+#ifdef NSTREAM_PERF
+	int clear = (s == gensym("clear"));
+
+	nsreceive_tilde_perfpost("perform", &x->x_perfperform, clear);
+	nsreceive_tilde_perfpost("inbox", &x->x_perfinbox, clear);
+	nsreceive_tilde_perfpost("decode", &x->x_perfdecode, clear);
+#else
+	post("nsreceive~: built without NSTREAM_PERF, no timing (make PERF=1)");
+#endif
+}
+
 
 static void nsreceive_tilde_print(t_nsreceive_tilde* x)
 {
-	int i, avg = 0;
-	for (i = 0; i < DEFAULT_AVERAGE_NUMBER; i++)
-		avg += x->x_average[i];
-	post("nsreceive~: last size = %d, avg size = %g, %d underflows, %d overflows", QUEUESIZE, (float)((float)avg / (float)DEFAULT_AVERAGE_NUMBER), x->x_underflow, x->x_overflow);
-	post("nsreceive~: channels = %d, framesize = %d, packets = %d", x->x_frames[x->x_framein].tag.channels, x->x_frames[x->x_framein].tag.framesize, x->x_counter);
+	int i, k;
+	for (k = 0; k < x->x_nsources; k++)
+	{
+		t_nsource *src = &x->x_sources[k];
+		int avg = 0;
+		if (x->x_nsources > 1)
+		{
+			if (!src->s_active)
+				continue;
+			post("nsreceive~: source %d: %s:%d", k, inet_ntoa(src->s_from.sin_addr), ntohs(src->s_from.sin_port));
+		}
+		for (i = 0; i < DEFAULT_AVERAGE_NUMBER; i++)
+			avg += src->s_average[i];
+		post("nsreceive~: last size = %d, avg size = %g, %d underflows, %d overflows", QUEUESIZE(src), (float)((float)avg / (float)DEFAULT_AVERAGE_NUMBER), src->s_underflow, src->s_overflow);
+		post("nsreceive~: channels = %d, framesize = %d, packets = %d", src->s_frames[LASTFRAME(src)]->tag.channels, src->s_frames[LASTFRAME(src)]->tag.framesize, src->s_counter);
+		post("nsreceive~: interarrival jitter %.3f ms", src->s_ijitter / 1000000.);
+	}
+	if (x->x_ndrops)
+		post("nsreceive~: %d packets from extra sources dropped", x->x_ndrops);
+	if (x->x_shm)
+		post("nsreceive~: shared memory %s, writer %s, %d channels, %d underflows, %d overruns",
+		     x->x_mcastaddress->s_name, NS_LOAD_ACQUIRE(&x->x_shm->r_writer) ? "attached" : "gone",
+		     x->x_shm->r_channels, x->x_shmunderflows, x->x_shmoverruns);
+	if (x->x_port)
+	{
+		t_nsreceive_tilde *y;
+		int nreceivers = 0;
+		for (y = x->x_port->p_receivers; y; y = y->x_nextonport)
+			nreceivers++;
+		post("nsreceive~: port %d, stream id %d, %d receivers on port, %d unrouted packets",
+		     x->x_port->p_portno, x->x_streamid, nreceivers, x->x_port->p_unrouted);
+		if (x->x_port->p_grobuf)
+			post("nsreceive~: UDP GRO on");
+		post("nsreceive~: arrival times from %s", x->x_port->p_kernelstamps ? "kernel timestamps" : "the time of reading");
+		if (x->x_port->p_incomplete)
+			post("nsreceive~: %d frames incomplete (datagrams lost)", x->x_port->p_incomplete);
+		if (x->x_port->p_threaded)
+			post("nsreceive~: served by reactor, %d packets dropped in queue, %d short packets",
+			     x->x_inboxdrops, x->x_port->p_short);
+		if (x->x_latcount)
+		{
+			post("nsreceive~: %d packets since last print: wake to deliver avg %.1f max %.1f us, "
+			     "queued for perform avg %.1f max %.1f us", x->x_latcount,
+			     x->x_wakelat / (1000. * x->x_latcount), x->x_wakelatmax / 1000.,
+			     x->x_queuelat / (1000. * x->x_latcount), x->x_queuelatmax / 1000.);
+			x->x_wakelat = x->x_wakelatmax = x->x_queuelat = x->x_queuelatmax = 0;
+			x->x_latcount = 0;
+		}
+	}
+	for (i = 0; i < x->x_ngroups; i++)
+	{
+		char group[16];
+		strncpy(group, inet_ntoa(x->x_groups[i].group), sizeof(group) - 1);
+		group[sizeof(group) - 1] = 0;
+		if (x->x_groups[i].source.s_addr != htonl(INADDR_ANY))
+			post("nsreceive~: member of %s, source %s", group, inet_ntoa(x->x_groups[i].source));
+		else
+			post("nsreceive~: member of %s", group);
+	}
 }
 
 
+/* what new allocates besides the object, shared by free and a failed new */
+static void nsreceive_tilde_freebuffers(t_nsreceive_tilde *x)
+{
+	int i, k;
+
+	t_freebytes(x->x_myvec, sizeof(t_int *) * (x->x_nsignals + 3));
+	for (k = 0; k < x->x_nsources; k++)
+	{
+		for (i = 0; i < DEFAULT_AUDIO_BUFFER_FRAMES; i++)
+			if (x->x_sources[k].s_frames[i])
+				freebytes(x->x_sources[k].s_frames[i], sizeof(t_frame));
+		if (x->x_sources[k].s_resample)
+			nsresample_free(x->x_sources[k].s_resample);
+	}
+	if (x->x_recvframe)
+		freebytes(x->x_recvframe, sizeof(t_frame));
+	if (x->x_inbox)
+	{
+		for (i = 0; i < DEFAULT_INBOX_FRAMES; i++)
+			freebytes(x->x_inbox[i].i_frame, sizeof(t_frame));
+		freebytes(x->x_inbox, DEFAULT_INBOX_FRAMES * sizeof(t_nsinbox));
+	}
+	t_freebytes(x->x_sources, sizeof(t_nsource) * x->x_nsources);
+	if (x->x_trace)
+		nstrace_free(x->x_trace);
+	if (x->x_mixbuf)
+		t_freebytes(x->x_mixbuf, x->x_mixbufsize * sizeof(t_sample));
+}
+
 
 #ifdef PD
-static void *nsreceive_tilde_new(t_floatarg fportno, t_floatarg outlets)
+static void *nsreceive_tilde_new(t_floatarg fportno, t_floatarg outlets, t_floatarg sources, t_floatarg mix)
 #else
-static void *nsreceive_tilde_new(long fportno, long outlets)
+static void *nsreceive_tilde_new(long fportno, long outlets, long sources, long mix)
 #endif
 {
 	t_nsreceive_tilde *x;
-	int i;
+	int i, k;
 
 	if (fportno == 0) fportno = DEFAULT_PORT;
 
@@ -1246,7 +2748,10 @@ static void *nsreceive_tilde_new(long fportno, long outlets)
 	}
 
 	x->x_noutlets = CLIP((int)outlets, 1, DEFAULT_AUDIO_CHANNELS);
-	for (i = 0; i < x->x_noutlets; i++)
+	x->x_nsources = CLIP((int)sources, 1, DEFAULT_MAX_SOURCES);
+	x->x_mix = (mix != 0);
+	x->x_nsignals = x->x_mix ? x->x_noutlets : x->x_noutlets * x->x_nsources;
+	for (i = 0; i < x->x_nsignals; i++)
 		outlet_new(&x->x_obj, &s_signal);
 	//if (!prot)
 	//	x->x_outlet1 = outlet_new(&x->x_obj, &s_anything);	/* outlet for connection state (TCP/IP) */
@@ -1261,66 +2766,70 @@ static void *nsreceive_tilde_new(long fportno, long outlets)
 
 	dsp_setup((t_pxobject *)x, 0);	/* no signal inlets */
 	x->x_noutlets = CLIP((int)outlets, 1, DEFAULT_AUDIO_CHANNELS);
+	x->x_nsources = CLIP((int)sources, 1, DEFAULT_MAX_SOURCES);
+	x->x_mix = (mix != 0);
+	x->x_nsignals = x->x_mix ? x->x_noutlets : x->x_noutlets * x->x_nsources;
 	x->x_outlet2 = listout(x);	/* outlet for info list */
-	if (!prot)
-		x->x_outlet1 = listout(x);	/* outlet for connection state (TCP/IP) */
-	for (i = 0 ; i < x->x_noutlets; i++)
+	for (i = 0 ; i < x->x_nsignals; i++)
 		outlet_new(x, "signal");
 	x->x_connectpoll = clock_new(x, (method)nsreceive_tilde_connectpoll);
 	x->x_datapoll = clock_new(x, (method)nsreceive_tilde_datapoll);
 #endif
 
-	x->x_myvec = (t_int **)t_getbytes(sizeof(t_int *) * (x->x_noutlets + 3));
-	if (!x->x_myvec)
+	x->x_myvec = (t_int **)t_getbytes(sizeof(t_int *) * (x->x_nsignals + 3));
+	x->x_sources = (t_nsource *)t_getbytes(sizeof(t_nsource) * x->x_nsources);
+	if (!x->x_myvec || !x->x_sources)
 	{
 		error("nsreceive~: out of memory");
 		return NULL;
 	}
+	memset(x->x_sources, 0, sizeof(t_nsource) * x->x_nsources);
 
 
 	x->x_mcastaddress = ps_localhost;
+	x->x_mcastif = ps_nothing;
+	x->x_ngroups = 0;
 	x->x_portno = 3000;
 	x->x_connectsocket = -1;
 	x->x_socket = -1;
-	x->x_datebegin=0;
-	x->x_lastdate=0;
-        x->x_lastcounter=0;
-	x->x_loopcounter=0;
-	x->x_counter=0;
-	x->x_framecount=0;
-	x->x_lost=0;
-	x->x_lastlost=0;
 	x->x_nconnections = 0;
 	x->x_ndrops = 0;
-	x->x_underflow = 0;
-	x->x_overflow = 0;
 	x->x_hostname = ps_nothing;
 
-	//for (i = 0; i < DEFAULT_AUDIO_BUFFER_FRAMES; i++)
-	//{
-	  //nic
-	  //x->x_frames[i].data = (char
-	  //*)t_getbytes(DEFAULT_AUDIO_BUFFER_SIZE * x->x_noutlets *
-	  //sizeof(t_float));
-	  //x->x_frames[i].data = (char *)t_getbytes(DEFAULT_CBUF_SIZE);
-	//}
 	x->x_lastmallocblocksize=DEFAULT_CBUF_SIZE;
-	x->x_framein = 0;
-	x->x_frameout = 0;
 	x->x_maxframes = DEFAULT_QUEUE_LENGTH;
 	x->x_vecsize = 64;	/* we'll update this later */
-	x->x_blocksize = DEFAULT_AUDIO_BUFFER_SIZE;	
-	x->x_blockduration = 0;
 	x->x_loopduration = 0;
-	post("blockduration %d",	x->x_blockduration);
-	x->x_blockssincerecv = 0;
-	x->x_blocksperrecv = x->x_blocksize / x->x_vecsize;
-
+	x->x_idlelimit = (DEFAULT_SOURCE_TIMEOUT * 44100) / (1000 * 64);	/* updated in dsp */
+	/* frames move between the rings, x_recvframe and the port, so they are
+	   allocated one by one */
+	x->x_recvframe = (t_frame *)getbytes(sizeof(t_frame));
+	x->x_trace = nstrace_new();
+	nslog_init(&x->x_log, "nsreceive~", nsreceive_tilde_log_categories,
+		   sizeof(nsreceive_tilde_log_categories) / sizeof(t_nslogcategory));
+	nsmetrics_register(&x->x_metrics, (t_nsmetrics_fn)nsreceive_tilde_metricsfill, x);
+	for (k = 0; k < x->x_nsources; k++)
+	{
+		t_nsource *src = &x->x_sources[k];
+		for (i = 0; i < DEFAULT_AUDIO_BUFFER_FRAMES; i++)
+			src->s_frames[i] = (t_frame *)getbytes(sizeof(t_frame));
+		src->s_blocksize = DEFAULT_AUDIO_BUFFER_SIZE;
+		src->s_blockduration = 0;
+		src->s_decimation = 1;
+		nsreceive_tilde_resetsource(x, src);
+	}
 
 
 	if (!nsreceive_tilde_createsocket(x, (int)fportno))
 	{
 		error("nsreceive~: failed to create listening socket");
+		nsmetrics_unregister(&x->x_metrics);
+		nsreceive_tilde_freebuffers(x);
+		nslog_free(&x->x_log);
+#ifndef PD
+		clock_free(x->x_connectpoll);
+		clock_free(x->x_datapoll);
+#endif
 		return (NULL);
 	}
 
@@ -1331,10 +2840,8 @@ static void *nsreceive_tilde_new(long fportno, long outlets)
 
 static void nsreceive_tilde_free(t_nsreceive_tilde *x)
 {
-	int i;
+	nsmetrics_unregister(&x->x_metrics);
 
-	
-	
 	if (x->x_connectsocket != -1)
 	{
 #ifdef PD
@@ -1344,15 +2851,8 @@ static void nsreceive_tilde_free(t_nsreceive_tilde *x)
 #endif
 		CLOSESOCKET(x->x_connectsocket);
 	}
-	if (x->x_socket != -1)
-	{
-#ifdef PD
-		sys_rmpollfn(x->x_socket);
-#else
-		clock_unset(x->x_datapoll);
-#endif
-		CLOSESOCKET(x->x_socket);
-	}
+	nsreceive_tilde_detach(x);
+	nsreceive_tilde_shmclose(x);
 
 #ifndef PD
 	dsp_free((t_pxobject *)x);	/* free the object */
@@ -1362,15 +2862,8 @@ static void nsreceive_tilde_free(t_nsreceive_tilde *x)
 
 
 	/* free memory */
-	t_freebytes(x->x_myvec, sizeof(t_int *) * (x->x_noutlets + 3));
-	for (i = 0; i < DEFAULT_AUDIO_BUFFER_FRAMES; i++)
-	{
-	  // nic t_freebytes(x->x_frames[i].data,
-	  // DEFAULT_AUDIO_BUFFER_SIZE * x->x_noutlets *
-	  // sizeof(t_float));
-	  //t_freebytes(x->x_frames[i].data, x->x_blocksize * x->x_noutlets * sizeof(t_float));
-	  //endnic
-	}
+	nsreceive_tilde_freebuffers(x);
+	nslog_free(&x->x_log);
 }
 
 
@@ -1380,16 +2873,31 @@ void nsreceive_tilde_setup(void)
 {
 	nsreceive_tilde_class = class_new(gensym("nsreceive~"), 
 		(t_newmethod) nsreceive_tilde_new, (t_method) nsreceive_tilde_free,
-		sizeof(t_nsreceive_tilde),  0, A_DEFFLOAT, A_DEFFLOAT, A_NULL);
+		sizeof(t_nsreceive_tilde),  0, A_DEFFLOAT, A_DEFFLOAT, A_DEFFLOAT, A_DEFFLOAT, A_NULL);
 
 	class_addmethod(nsreceive_tilde_class, nullfn, gensym("signal"), 0);
 	class_addbang(nsreceive_tilde_class, (t_method)nsreceive_tilde_bang);
 	class_addmethod(nsreceive_tilde_class, (t_method)nsreceive_tilde_dsp, gensym("dsp"), 0);
 	class_addmethod(nsreceive_tilde_class, (t_method)nsreceive_tilde_print, gensym("print"), 0);
+	class_addmethod(nsreceive_tilde_class, (t_method)nsreceive_tilde_histogram, gensym("histogram"), A_DEFSYM, 0);
+	class_addmethod(nsreceive_tilde_class, (t_method)nsreceive_tilde_perf, gensym("perf"), A_DEFSYM, 0);
+	class_addmethod(nsreceive_tilde_class, (t_method)nsreceive_tilde_trace, gensym("trace"), A_SYMBOL, A_DEFSYM, 0);
+	class_addmethod(nsreceive_tilde_class, (t_method)nsreceive_tilde_log, gensym("log"), A_DEFSYM, 0);
+	class_addmethod(nsreceive_tilde_class, (t_method)nsreceive_tilde_metrics, gensym("metrics"), A_SYMBOL, A_DEFSYM, A_DEFFLOAT, 0);
 	class_addmethod(nsreceive_tilde_class, (t_method)nsreceive_tilde_reset, gensym("reset"), A_DEFFLOAT, 0);
 	class_addmethod(nsreceive_tilde_class, (t_method)nsreceive_tilde_reset, gensym("buffer"), A_DEFFLOAT, 0);
+	class_addmethod(nsreceive_tilde_class, (t_method)nsreceive_tilde_latency, gensym("latency"), A_DEFFLOAT, 0);
 	//multicast catching (one source per adress)
 	class_addmethod(nsreceive_tilde_class, (t_method)nsreceive_tilde_receivefrom, gensym("connect"), A_DEFSYM, A_DEFFLOAT, 0);
+	//additional groups, optionally restricted to one source (IGMPv3)
+	class_addmethod(nsreceive_tilde_class, (t_method)nsreceive_tilde_join, gensym("join"), A_SYMBOL, A_DEFSYM, 0);
+	class_addmethod(nsreceive_tilde_class, (t_method)nsreceive_tilde_leave, gensym("leave"), A_SYMBOL, A_DEFSYM, 0);
+	class_addmethod(nsreceive_tilde_class, (t_method)nsreceive_tilde_interface, gensym("interface"), A_DEFSYM, 0);
+	class_addmethod(nsreceive_tilde_class, (t_method)nsreceive_tilde_streamid, gensym("streamid"), A_FLOAT, 0);
+	class_addmethod(nsreceive_tilde_class, (t_method)nsreceive_tilde_reactor, gensym("reactor"), A_DEFFLOAT, A_DEFSYM, 0);
+	class_addmethod(nsreceive_tilde_class, (t_method)nsreceive_tilde_busypoll, gensym("busypoll"), A_FLOAT, 0);
+	class_addmethod(nsreceive_tilde_class, (t_method)nsreceive_tilde_affinity, gensym("affinity"), A_FLOAT, 0);
+	class_addmethod(nsreceive_tilde_class, (t_method)nsreceive_tilde_priority, gensym("priority"), A_FLOAT, 0);
 	class_sethelpsymbol(nsreceive_tilde_class, gensym("nstream~"));
 
 
@@ -1402,6 +2910,11 @@ void nsreceive_tilde_setup(void)
 	ps_avlosses= gensym("avlosses");
 	ps_losses= gensym("losses");
 	ps_jitter= gensym("jitter");
+	ps_interarrival = gensym("interarrival");
+	ps_arrivaltime = gensym("arrivaltime");
+	ps_depth = gensym("depth");
+	ps_latency = gensym("latency");
+	ps_bucket = gensym("bucket");
 	
 	
 	ps_format = gensym("format");
@@ -1413,6 +2926,7 @@ void nsreceive_tilde_setup(void)
 	ps_queuesize = gensym("queuesize");
 	ps_average = gensym("average");
 	ps_blocksize = gensym("blocksize");
+	ps_source = gensym("source");
 	ps_hostname = gensym("ipaddr");
 	ps_sf_float = gensym("_float_");
 	ps_sf_16bit = gensym("_16bit_");
@@ -1448,14 +2962,28 @@ void main()
 #endif	/* _WINDOWS */
 
 	setup((t_messlist **)&nsreceive_tilde_class, (method)nsreceive_tilde_new, (method)nsreceive_tilde_free, 
-		  (short)sizeof(t_nsreceive_tilde), 0L, A_DEFLONG, A_DEFLONG, A_DEFLONG, 0);
+		  (short)sizeof(t_nsreceive_tilde), 0L, A_DEFLONG, A_DEFLONG, A_DEFLONG, A_DEFLONG, 0);
 	addmess((method)nsreceive_tilde_dsp, "dsp", A_CANT, 0);
 	addmess((method)nsreceive_tilde_assist, "assist", A_CANT, 0);
 	addmess((method)nsreceive_tilde_print, "print", 0);
+	addmess((method)nsreceive_tilde_histogram, "histogram", A_DEFSYM, 0);
+	addmess((method)nsreceive_tilde_perf, "perf", A_DEFSYM, 0);
+	addmess((method)nsreceive_tilde_trace, "trace", A_SYM, A_DEFSYM, 0);
+	addmess((method)nsreceive_tilde_log, "log", A_DEFSYM, 0);
+	addmess((method)nsreceive_tilde_metrics, "metrics", A_SYM, A_DEFSYM, A_DEFLONG, 0);
 	addmess((method)nsreceive_tilde_reset, "reset", A_DEFFLOAT, 0);
 	addmess((method)nsreceive_tilde_reset, "buffer", A_DEFFLOAT, 0);
+	addmess((method)nsreceive_tilde_latency, "latency", A_DEFFLOAT, 0);
 	// multicast catching (one source per adress)
 	addmess((method)nsreceive_tilde_receivefrom, "connect",  A_DEFSYM, A_DEFFLOAT, 0);
+	addmess((method)nsreceive_tilde_join, "join", A_SYM, A_DEFSYM, 0);
+	addmess((method)nsreceive_tilde_leave, "leave", A_SYM, A_DEFSYM, 0);
+	addmess((method)nsreceive_tilde_interface, "interface", A_DEFSYM, 0);
+	addmess((method)nsreceive_tilde_streamid, "streamid", A_LONG, 0);
+	addmess((method)nsreceive_tilde_reactor, "reactor", A_DEFLONG, A_DEFSYM, 0);
+	addmess((method)nsreceive_tilde_busypoll, "busypoll", A_LONG, 0);
+	addmess((method)nsreceive_tilde_affinity, "affinity", A_LONG, 0);
+	addmess((method)nsreceive_tilde_priority, "priority", A_LONG, 0);
 	
 	addbang((method)nsreceive_tilde_bang);
 	dsp_initclass();
@@ -1464,6 +2992,17 @@ void main()
 
 
 	ps_localhost = gensym("localhost");
+	ps_date = gensym("date");
+	ps_avdatathrp = gensym("avdatathrp");
+	ps_datathrp = gensym("datathrp");
+	ps_avlosses= gensym("avlosses");
+	ps_losses= gensym("losses");
+	ps_jitter= gensym("jitter");
+	ps_interarrival = gensym("interarrival");
+	ps_arrivaltime = gensym("arrivaltime");
+	ps_depth = gensym("depth");
+	ps_latency = gensym("latency");
+	ps_bucket = gensym("bucket");
 
 
 	ps_format = gensym("format");
@@ -1474,6 +3013,8 @@ void main()
 	ps_underflow = gensym("underflow");
 	ps_queuesize = gensym("queuesize");
 	ps_average = gensym("average");
+	ps_blocksize = gensym("blocksize");
+	ps_source = gensym("source");
 	ps_hostname = gensym("ipaddr");
 	ps_sf_float = gensym("_float_");
 	ps_sf_16bit = gensym("_16bit_");
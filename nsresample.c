@@ -0,0 +1,207 @@
+/* ------------------------ nsresample ---------------------------------------- */
+/*                                                                              */
+/* Polyphase sample rate conversion between any two rates: senders that run     */
+/* at another sample rate than the receiver, decimated streams.                 */
+/*                                                                              */
+/* This program is free software; you can redistribute it and/or                */
+/* modify it under the terms of the GNU General Public License                  */
+/* as published by the Free Software Foundation; either version 2               */
+/* of the License, or (at your option) any later version.                       */
+/*                                                                              */
+/* See file LICENSE for further informations on licensing terms.                */
+/*                                                                              */
+/* This program is distributed in the hope that it will be useful,              */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of               */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                */
+/* GNU General Public License for more details.                                 */
+/*                                                                              */
+/* ---------------------------------------------------------------------------- */
+
+
+#ifdef PD
+#include "m_pd.h"
+#else
+#include "ext.h"
+#include "z_dsp.h"
+#endif
+
+#include "nstream~.h"
+#include "nsresample.h"
+
+#include <math.h>
+#include <string.h>
+
+#define NSRESAMPLE_BETA 8.              /* kaiser window, about 80 dB stopband */
+#define NSRESAMPLE_LANES 16             /* partial sums of a dot product, r_taps is a multiple */
+
+
+/* modified bessel function of the first kind, order 0 */
+static double nsresample_bessel(double x)
+{
+	double sum = 1., term = 1.;
+	int k;
+
+	for (k = 1; k < 32; k++)
+	{
+		term *= (x / (2. * k)) * (x / (2. * k));
+		sum += term;
+	}
+	return (sum);
+}
+
+
+/* a windowed sinc with its -6 dB point at the output's nyquist, sampled at
+   NSRESAMPLE_PHASES + 1 fractional offsets. each row sums to 1 */
+static void nsresample_design(t_nsresample *r)
+{
+	double cutoff = r->r_outrate < r->r_inrate ? (double)r->r_outrate / r->r_inrate : 1.;
+	double half = r->r_taps / 2.;
+	int p, t;
+
+	for (p = 0; p <= NSRESAMPLE_PHASES; p++)
+	{
+		t_sample *row = r->r_coef + p * r->r_taps;
+		double sum = 0.;
+
+		for (t = 0; t < r->r_taps; t++)
+		{
+			double x = (double)p / NSRESAMPLE_PHASES + half - 1. - t;
+			double w = 1. - (x / half) * (x / half);
+			double h = cutoff * (x == 0. ? 1. : sin(M_PI * cutoff * x) / (M_PI * cutoff * x));
+			h *= nsresample_bessel(NSRESAMPLE_BETA * sqrt(w > 0. ? w : 0.)) / nsresample_bessel(NSRESAMPLE_BETA);
+			row[t] = (t_sample)h;
+			sum += h;
+		}
+		for (t = 0; t < r->r_taps; t++)
+			row[t] = (t_sample)(row[t] / sum);
+	}
+}
+
+
+t_nsresample *nsresample_new(int inrate, int outrate, int channels)
+{
+	t_nsresample *r;
+	int taps, i;
+
+	if (inrate <= 0 || outrate <= 0 || channels <= 0 || channels > DEFAULT_AUDIO_CHANNELS ||
+	    inrate > (long long)outrate * NSRESAMPLE_MAXDOWN || outrate > (long long)inrate * NSRESAMPLE_MAXUP)
+		return (0);
+	if (!(r = (t_nsresample *)getbytes(sizeof(t_nsresample))))
+		return (0);
+
+	/* the filter keeps its length in output samples */
+	taps = inrate > outrate ? (int)(((long long)NSRESAMPLE_TAPS * inrate + outrate - 1) / outrate) : NSRESAMPLE_TAPS;
+	r->r_inrate = inrate;
+	r->r_outrate = outrate;
+	r->r_channels = channels;
+	r->r_taps = (taps + NSRESAMPLE_LANES - 1) / NSRESAMPLE_LANES * NSRESAMPLE_LANES;
+	r->r_step = ((unsigned long long)inrate << 32) / outrate;
+	r->r_pos = 0;
+	r->r_fill = 0;
+	r->r_size = (int)(((long long)NSRESAMPLE_CHUNK * inrate + outrate - 1) / outrate) + r->r_taps + 1;
+	r->r_coef = (t_sample *)getbytes((NSRESAMPLE_PHASES + 1) * r->r_taps * sizeof(t_sample));
+	for (i = 0; i < channels; i++)
+		r->r_buf[i] = (t_sample *)getbytes(r->r_size * sizeof(t_sample));
+	nsresample_design(r);
+	return (r);
+}
+
+
+void nsresample_free(t_nsresample *r)
+{
+	int i;
+
+	freebytes(r->r_coef, (NSRESAMPLE_PHASES + 1) * r->r_taps * sizeof(t_sample));
+	for (i = 0; i < r->r_channels; i++)
+		freebytes(r->r_buf[i], r->r_size * sizeof(t_sample));
+	freebytes(r, sizeof(t_nsresample));
+}
+
+
+void nsresample_reset(t_nsresample *r)
+{
+	r->r_pos = 0;
+	r->r_fill = 0;
+}
+
+
+int nsresample_need(t_nsresample *r, int n)
+{
+	int last = (int)((r->r_pos + (n - 1) * r->r_step) >> 32) + r->r_taps;
+
+	return (last > r->r_fill ? last - r->r_fill : 0);
+}
+
+
+int nsresample_ready(t_nsresample *r, int k)
+{
+	long long last = (long long)(r->r_fill + k - r->r_taps) << 32;
+
+	return (last >= (long long)r->r_pos ? (int)((last - r->r_pos) / r->r_step) + 1 : 0);
+}
+
+
+void nsresample_input(t_nsresample *r, t_sample **in)
+{
+	int i;
+
+	for (i = 0; i < r->r_channels; i++)
+		in[i] = r->r_buf[i] + r->r_fill;
+}
+
+
+/* the partial sums are independent, so the lanes vectorize without
+   reassociating floating point adds */
+static inline t_sample nsresample_dot(const t_sample *h, const t_sample *x, int taps)
+{
+	t_sample acc[NSRESAMPLE_LANES] = { 0 };
+	int t, l;
+
+	for (t = 0; t < taps; t += NSRESAMPLE_LANES)
+		for (l = 0; l < NSRESAMPLE_LANES; l++)
+			acc[l] += h[t + l] * x[t + l];
+	for (l = 0; l < NSRESAMPLE_LANES / 2; l++)
+		acc[l] += acc[l + NSRESAMPLE_LANES / 2];
+	for (l = 0; l < NSRESAMPLE_LANES / 4; l++)
+		acc[l] += acc[l + NSRESAMPLE_LANES / 4];
+	return ((acc[0] + acc[2]) + (acc[1] + acc[3]));
+}
+
+
+void nsresample_run(t_nsresample *r, int k, t_sample **out, int n)
+{
+	t_sample coef[NSRESAMPLE_TAPS * NSRESAMPLE_MAXDOWN];
+	int taps = r->r_taps;
+	int i, j, t, used;
+
+	r->r_fill += k;
+	for (j = 0; j < n; j++, r->r_pos += r->r_step)
+	{
+		int at = (int)(r->r_pos >> 32);
+		unsigned long long frac = (r->r_pos & 0xffffffffULL) * NSRESAMPLE_PHASES;
+		const t_sample *c0 = r->r_coef + (frac >> 32) * taps;
+		const t_sample *c1 = c0 + taps;
+		t_sample f = (t_sample)((frac & 0xffffffffULL) * (1. / 4294967296.));
+		const t_sample *h = c0;
+
+		/* the filter at this fractional offset, between two phases. integer
+		   ratios (decimation) always hit a phase */
+		if (f != 0)
+		{
+			for (t = 0; t < taps; t++)
+				coef[t] = c0[t] + f * (c1[t] - c0[t]);
+			h = coef;
+		}
+		for (i = 0; i < r->r_channels; i++)
+			out[i][j] = nsresample_dot(h, r->r_buf[i] + at, taps);
+	}
+
+	/* keep what the next outputs still need at the start of r_buf */
+	used = (int)(r->r_pos >> 32);
+	if (used > r->r_fill)
+		used = r->r_fill;
+	for (i = 0; i < r->r_channels; i++)
+		memmove(r->r_buf[i], r->r_buf[i] + used, (r->r_fill - used) * sizeof(t_sample));
+	r->r_fill -= used;
+	r->r_pos -= (unsigned long long)used << 32;
+}
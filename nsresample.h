@@ -0,0 +1,66 @@
+/* ------------------------ nsresample ---------------------------------------- */
+/*                                                                              */
+/* Polyphase sample rate conversion between any two rates: senders that run     */
+/* at another sample rate than the receiver, decimated streams.                 */
+/*                                                                              */
+/* This program is free software; you can redistribute it and/or                */
+/* modify it under the terms of the GNU General Public License                  */
+/* as published by the Free Software Foundation; either version 2               */
+/* of the License, or (at your option) any later version.                       */
+/*                                                                              */
+/* See file LICENSE for further informations on licensing terms.                */
+/*                                                                              */
+/* This program is distributed in the hope that it will be useful,              */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of               */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                */
+/* GNU General Public License for more details.                                 */
+/*                                                                              */
+/* ---------------------------------------------------------------------------- */
+
+
+#ifndef NSRESAMPLE_H
+#define NSRESAMPLE_H
+
+#define NSRESAMPLE_TAPS 64              /* filter length per phase, scaled up when decimating */
+#define NSRESAMPLE_PHASES 128           /* filter phases, interpolated in between */
+#define NSRESAMPLE_CHUNK 256            /* max. output samples per nsresample_run */
+#define NSRESAMPLE_MAXDOWN 4            /* max. input rate / output rate */
+#define NSRESAMPLE_MAXUP 16             /* max. output rate / input rate */
+
+typedef struct _nsresample
+{
+	int r_inrate;
+	int r_outrate;
+	int r_channels;
+	int r_taps;                         /* input samples under the filter */
+	unsigned long long r_step;          /* input samples per output sample, 32.32 fixed point */
+	unsigned long long r_pos;           /* where the next output sample is taken in r_buf, 32.32 */
+	int r_fill;                         /* input samples in r_buf */
+	int r_size;                         /* length of r_buf per channel */
+	t_sample *r_coef;                   /* NSRESAMPLE_PHASES + 1 rows of r_taps */
+	t_sample *r_buf[DEFAULT_AUDIO_CHANNELS];
+} t_nsresample;
+
+/* a converter from inrate to outrate for channels, NULL when the ratio is
+   out of range. the output lags the input by about r_taps / 2 samples */
+t_nsresample *nsresample_new(int inrate, int outrate, int channels);
+void nsresample_free(t_nsresample *r);
+
+/* forget the input, start over as if new */
+void nsresample_reset(t_nsresample *r);
+
+/* input samples still missing before n (up to NSRESAMPLE_CHUNK) output
+   samples can be produced, and where to write them */
+int nsresample_need(t_nsresample *r, int n);
+void nsresample_input(t_nsresample *r, t_sample **in);
+
+/* the other way round, when the input drives: output samples ready once
+   k (up to NSRESAMPLE_CHUNK, when decimating) more input samples are in */
+int nsresample_ready(t_nsresample *r, int k);
+
+/* take the k input samples written to nsresample_input (nsresample_need
+   of n, or k of nsresample_ready) and produce n output samples in
+   out[0..r_channels-1] */
+void nsresample_run(t_nsresample *r, int k, t_sample **out, int n);
+
+#endif /* NSRESAMPLE_H */
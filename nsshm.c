@@ -0,0 +1,89 @@
+/* ------------------------ nsshm --------------------------------------------- */
+/*                                                                              */
+/* Shared memory rings for nstream~ and nsreceive~ on the same host: the        */
+/* sender writes interleaved frames, the receiver reads them in its perform.    */
+/*                                                                              */
+/* This program is free software; you can redistribute it and/or                */
+/* modify it under the terms of the GNU General Public License                  */
+/* as published by the Free Software Foundation; either version 2               */
+/* of the License, or (at your option) any later version.                       */
+/*                                                                              */
+/* See file LICENSE for further informations on licensing terms.                */
+/*                                                                              */
+/* This program is distributed in the hope that it will be useful,              */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of               */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                */
+/* GNU General Public License for more details.                                 */
+/*                                                                              */
+/* ---------------------------------------------------------------------------- */
+
+
+#include "nsshm.h"
+
+#include <string.h>
+#include <errno.h>
+
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+
+t_nsshmring *nsshm_open(const char *name)
+{
+	char path[256];
+	void *p;
+	int fd;
+
+	if (!*name || strchr(name, '/') || strlen(name) > 200)
+	{
+		errno = EINVAL;
+		return (NULL);
+	}
+	snprintf(path, sizeof(path), "/nstream-%s", name);
+	if ((fd = shm_open(path, O_CREAT | O_RDWR, 0600)) < 0)
+		return (NULL);
+	/* growing a new object zero fills it, an existing one keeps its size */
+	if (ftruncate(fd, sizeof(t_nsshmring)) < 0)
+	{
+		close(fd);
+		return (NULL);
+	}
+	p = mmap(NULL, sizeof(t_nsshmring), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED)
+		return (NULL);
+	return ((t_nsshmring *)p);
+}
+
+void nsshm_close(t_nsshmring *ring)
+{
+	/* the object is never unlinked: the other side may still use it and
+	   a later open of the same name finds it again */
+	if (ring)
+		munmap(ring, sizeof(t_nsshmring));
+}
+
+#else /* _WIN32 */
+
+t_nsshmring *nsshm_open(const char *name)
+{
+	errno = ENOSYS;
+	return (NULL);
+}
+
+void nsshm_close(t_nsshmring *ring)
+{
+}
+
+#endif /* _WIN32 */
+
+const char *nsshm_name(const char *host)
+{
+	size_t n = strlen(NSSHM_PREFIX);
+
+	if (strncmp(host, NSSHM_PREFIX, n))
+		return (NULL);
+	return (host + n);
+}
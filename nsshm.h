@@ -0,0 +1,49 @@
+/* ------------------------ nsshm --------------------------------------------- */
+/*                                                                              */
+/* Shared memory rings for nstream~ and nsreceive~ on the same host: the        */
+/* sender writes interleaved frames, the receiver reads them in its perform.    */
+/*                                                                              */
+/* This program is free software; you can redistribute it and/or                */
+/* modify it under the terms of the GNU General Public License                  */
+/* as published by the Free Software Foundation; either version 2               */
+/* of the License, or (at your option) any later version.                       */
+/*                                                                              */
+/* See file LICENSE for further informations on licensing terms.                */
+/*                                                                              */
+/* This program is distributed in the hope that it will be useful,              */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of               */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                */
+/* GNU General Public License for more details.                                 */
+/*                                                                              */
+/* ---------------------------------------------------------------------------- */
+
+
+#ifndef NSSHM_H
+#define NSSHM_H
+
+#define DEFAULT_SHM_FRAMES 8192         /* sample frames in one ring, a power of two */
+#define DEFAULT_SHM_CHANNELS 8          /* channels a ring can carry */
+#define DEFAULT_SHM_LATENCY 2           /* DSP blocks the reader stays behind the writer */
+#define NSSHM_PREFIX "shm:"             /* connect shm:<name> selects the ring <name> */
+
+/* lives in the shared mapping. the memory starts zeroed, so a reader that
+   maps it before any writer just sees r_writer 0 */
+typedef struct _nsshmring
+{
+	int r_channels;                     /* set by the writer with each block */
+	int r_samplerate;
+	unsigned int r_writer;              /* a writer is attached */
+	unsigned int r_writepos;            /* frames written so far, published last */
+	char r_pad[48];                     /* keep the data off the header cache line */
+	float r_data[DEFAULT_SHM_FRAMES * DEFAULT_SHM_CHANNELS];
+} t_nsshmring;
+
+/* map the ring called name, creating it if needed. NULL on failure with
+   errno set, or on systems without POSIX shared memory */
+t_nsshmring *nsshm_open(const char *name);
+void nsshm_close(t_nsshmring *ring);
+
+/* the ring name of a "shm:<name>" host argument, NULL for a network host */
+const char *nsshm_name(const char *host);
+
+#endif /* NSSHM_H */
@@ -0,0 +1,150 @@
+/* ------------------------ nstrace ------------------------------------------- */
+/*                                                                              */
+/* Event trace rings for nstream~ and nsreceive~, written out as Chrome         */
+/* trace-event JSON (chrome://tracing, Perfetto) after an incident.             */
+/*                                                                              */
+/* This program is free software; you can redistribute it and/or                */
+/* modify it under the terms of the GNU General Public License                  */
+/* as published by the Free Software Foundation; either version 2               */
+/* of the License, or (at your option) any later version.                       */
+/*                                                                              */
+/* See file LICENSE for further informations on licensing terms.                */
+/*                                                                              */
+/* This program is distributed in the hope that it will be useful,              */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of               */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                */
+/* GNU General Public License for more details.                                 */
+/*                                                                              */
+/* ---------------------------------------------------------------------------- */
+
+
+#include "nstrace.h"
+#include "nsreactor.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+typedef struct _nstracedump
+{
+	FILE *d_file;
+	char d_name[64];
+	unsigned int d_head;
+	t_nstraceevent d_events[NSTRACE_EVENTS];
+} t_nstracedump;
+
+static const char *nstrace_names[] =
+{
+	"recv", "play", "underflow", "overflow", "reset", "format", "senderror", "send", "lost"
+};
+
+static const char *nstrace_args[][2] =
+{
+	{ "seq", "bytes" }, { "seq", "depth" }, { "depth", 0 }, { "seq", 0 }, { 0, 0 },
+	{ "format", "channels" }, { "errno", 0 }, { "seq", "bytes" }, { "seq", "count" }
+};
+
+
+t_nstrace *nstrace_new(void)
+{
+	return ((t_nstrace *)calloc(1, sizeof(t_nstrace)));
+}
+
+
+void nstrace_free(t_nstrace *t)
+{
+	free(t);
+}
+
+
+void nstrace_clear(t_nstrace *t)
+{
+	if (t)
+		t->t_head = 0;
+}
+
+
+void nstrace_add(t_nstrace *t, int type, int track, int a, int b)
+{
+	t_nstraceevent *e;
+
+	if (!t)
+		return;
+	e = &t->t_events[t->t_head & (NSTRACE_EVENTS - 1)];
+	e->e_time = nsreactor_now();
+	e->e_type = type;
+	e->e_track = track;
+	e->e_a = a;
+	e->e_b = b;
+	t->t_head++;
+}
+
+
+static void *nstrace_write(void *zz)
+{
+	t_nstracedump *d = (t_nstracedump *)zz;
+	unsigned int n = d->d_head < NSTRACE_EVENTS ? d->d_head : NSTRACE_EVENTS;
+	unsigned int i;
+	FILE *f = d->d_file;
+
+	fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"%s\"}}", d->d_name);
+	for (i = d->d_head - n; i != d->d_head; i++)
+	{
+		t_nstraceevent *e = &d->d_events[i & (NSTRACE_EVENTS - 1)];
+		const char **args;
+
+		if (e->e_type >= sizeof(nstrace_names) / sizeof(nstrace_names[0]))
+			continue;
+		args = nstrace_args[e->e_type];
+		fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{",
+			nstrace_names[e->e_type], e->e_time / 1000., e->e_track);
+		if (args[0])
+			fprintf(f, "\"%s\":%d", args[0], e->e_a);
+		if (args[1])
+			fprintf(f, ",\"%s\":%d", args[1], e->e_b);
+		fprintf(f, "}}");
+		/* queue depth as a counter track next to the events */
+		if (e->e_type == NSTRACE_PLAY)
+			fprintf(f, ",\n{\"name\":\"queue %d\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"args\":{\"frames\":%d}}",
+				e->e_track, e->e_time / 1000., e->e_b);
+	}
+	fprintf(f, "\n]}\n");
+	fclose(f);
+	free(d);
+	return (0);
+}
+
+
+int nstrace_dump(t_nstrace *t, const char *file, const char *name)
+{
+	t_nstracedump *d;
+	pthread_attr_t attr;
+	pthread_t thread;
+	int err;
+
+	if (!t)
+		return (ENOMEM);
+	if (!(d = (t_nstracedump *)malloc(sizeof(t_nstracedump))))
+		return (ENOMEM);
+	if (!(d->d_file = fopen(file, "w")))
+	{
+		err = errno;
+		free(d);
+		return (err);
+	}
+	snprintf(d->d_name, sizeof(d->d_name), "%s", name);
+	d->d_head = t->t_head;
+	memcpy(d->d_events, t->t_events, sizeof(d->d_events));
+
+	/* formatting a few thousand events is no job for the DSP thread */
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	err = pthread_create(&thread, &attr, nstrace_write, d);
+	pthread_attr_destroy(&attr);
+	if (err)
+		nstrace_write(d);
+	return (0);
+}
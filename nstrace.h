@@ -0,0 +1,65 @@
+/* ------------------------ nstrace ------------------------------------------- */
+/*                                                                              */
+/* Event trace rings for nstream~ and nsreceive~, written out as Chrome         */
+/* trace-event JSON (chrome://tracing, Perfetto) after an incident.             */
+/*                                                                              */
+/* This program is free software; you can redistribute it and/or                */
+/* modify it under the terms of the GNU General Public License                  */
+/* as published by the Free Software Foundation; either version 2               */
+/* of the License, or (at your option) any later version.                       */
+/*                                                                              */
+/* See file LICENSE for further informations on licensing terms.                */
+/*                                                                              */
+/* This program is distributed in the hope that it will be useful,              */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of               */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                */
+/* GNU General Public License for more details.                                 */
+/*                                                                              */
+/* ---------------------------------------------------------------------------- */
+
+
+#ifndef NSTRACE_H
+#define NSTRACE_H
+
+#define NSTRACE_EVENTS 4096             /* events kept per object, a power of two */
+
+/* event types, a and b are type specific */
+#define NSTRACE_RECV 0                  /* packet received: sequence, bytes */
+#define NSTRACE_PLAY 1                  /* frame starts to play: sequence, queue depth */
+#define NSTRACE_UNDERFLOW 2             /* nothing to play: queue depth */
+#define NSTRACE_OVERFLOW 3              /* packet dropped, queue full: sequence */
+#define NSTRACE_RESET 4                 /* buffers reset */
+#define NSTRACE_FORMAT 5                /* stream format changed: format, channels */
+#define NSTRACE_SENDERROR 6             /* send failed: errno */
+#define NSTRACE_SEND 7                  /* packet sent or queued: sequence, bytes */
+#define NSTRACE_LOST 8                  /* gap in the sequence: first missing, count */
+
+typedef struct _nstraceevent
+{
+	unsigned long long e_time;          /* nsreactor_now() */
+	unsigned short e_type;
+	unsigned short e_track;             /* source slot, one timeline each */
+	int e_a;
+	int e_b;
+} t_nstraceevent;
+
+/* one writer: the thread running the object (pd's). it never waits, the
+   oldest events are overwritten */
+typedef struct _nstrace
+{
+	unsigned int t_head;                /* events written so far */
+	t_nstraceevent t_events[NSTRACE_EVENTS];
+} t_nstrace;
+
+t_nstrace *nstrace_new(void);
+void nstrace_free(t_nstrace *t);
+void nstrace_clear(t_nstrace *t);
+
+void nstrace_add(t_nstrace *t, int type, int track, int a, int b);
+
+/* take a copy of the ring and write it to file as Chrome trace-event JSON
+   from a thread of its own. name labels the timeline. returns 0, or an
+   errno value when the file can't be created */
+int nstrace_dump(t_nstrace *t, const char *file, const char *name);
+
+#endif /* NSTRACE_H */
@@ -38,6 +38,14 @@
 #endif
 
 #include "nstream~.h"
+#include "nsreactor.h"
+#include "nsshm.h"
+#include "nshist.h"
+#include "nstrace.h"
+#include "nslog.h"
+#include "nsmetrics.h"
+#include "nskernel.h"
+#include "nsresample.h"
 //#include "float_cast.h"	/* tools for fast conversion from float to int */
 
 
@@ -48,11 +56,14 @@
 #include <sys/types.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stddef.h>
 
 #ifndef _WINDOWS
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <errno.h>
 #include <netinet/in.h>
+#include <netinet/udp.h>
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <netdb.h>
@@ -62,6 +73,7 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <pthread.h>
+#include <sched.h>
 #define SOCKET_ERROR -1
 #endif
 
@@ -131,6 +143,17 @@ static void nstream_tilde_closesocket(int fd)
 
 
 #ifdef PD
+/* what perform reports through x_log instead of posting */
+#define NSTREAM_LOG_VECSIZE 0
+#define NSTREAM_LOG_DROP 1
+
+static const t_nslogcategory nstream_tilde_log_categories[] =
+{
+	{ "vecsize", "resize buffer to pd tick size (%d)", 0 },
+	{ "drop", "reactor fell behind, packet %d dropped", 0 },
+};
+
+
 static t_class *nstream_tilde_class;
 #else
 static void *nstream_tilde_class;
@@ -142,6 +165,30 @@ static t_symbol *ps_queuesize, *ps_average, *ps_sf_float, *ps_sf_16bit, *ps_sf_8
 static t_symbol *ps_sf_mp3, *ps_sf_aac, *ps_sf_unknown, *ps_bitrate, *ps_hostname;
 
 
+#define NSTREAM_CONFIG_NEW 4        /* flag in x_configmiddle: perform has not taken it yet */
+
+/* smallest segment size that cuts the largest frame into no more than the
+   kernel's DEFAULT_MAX_SEGMENTS datagrams */
+#define NSTREAM_MIN_SEGMENT ((int)SF_HEADER_SIZE + ((int)DEFAULT_CBUF_SIZE + DEFAULT_MAX_SEGMENTS - 1) / DEFAULT_MAX_SEGMENTS)
+
+/* what perform streams with, copied from the fields the messages set */
+typedef struct _nsconfig
+{
+	int c_fd;                   /* -1: nothing to send to */
+	t_nsreactor *c_reactor;
+	t_nsshmring *c_shm;
+	int c_segsize;              /* nstream_tilde_segsize() of the socket */
+	int c_connection;           /* x_connection when published */
+	int c_channels;             /* these four apply from the next frame on */
+	int c_format;
+	int c_blocksize;
+	char c_streamid;
+	int c_decimation;           /* from the next frame on, like the four above */
+	int c_silence;              /* leave silent channels out of the frames */
+	t_float c_threshold;        /* silent: no sample of the frame above this */
+} t_nsconfig;
+
+
 typedef struct _nstream_tilde
 {
 #ifdef PD
@@ -164,9 +211,10 @@ typedef struct _nstream_tilde
         //char *x_cbuf;
         int x_cbufsize;
         //int x_lastcbufmallocsize;
-        int x_blocksize;
-	int x_blockspersend;
-	int x_blockssincesend;
+        int x_blocksize;            /* samples per packet, as set */
+	int x_framesize;            /* samples in the frame perform fills */
+	int x_framepos;             /* of which it has */
+	t_nsreactor *x_framereactor;	/* c_reactor when the frame started, which buffer it fills */
 
 	long x_samplerate;          /* samplerate we're running at */
 	int x_vecsize;              /* current DSP signal vector size */
@@ -177,6 +225,58 @@ typedef struct _nstream_tilde
 	int x_count;                /* total number of audio frames */
 	t_int **x_myvec;            /* vector we pass on in the DSP routine */
 
+	int x_mcastttl;             /* multicast time to live (hops) */
+	int x_mcastloop;            /* loop multicast back to the sending host */
+	t_symbol *x_mcastif;        /* outgoing multicast interface, ps_nothing for default route */
+	struct in_addr x_mcastifaddr;	/* its address, resolved by the message, INADDR_ANY for default */
+
+	t_nsreactor *x_reactor;     /* sends are handed to a reactor thread when set */
+	t_tag *x_sendring[DEFAULT_SEND_FRAMES];
+	int x_sendlen[DEFAULT_SEND_FRAMES];
+	int x_sendhead;             /* written by the DSP thread */
+	int x_sendtail;             /* written by the reactor thread */
+	int x_senddrops;            /* packets lost because the reactor fell behind */
+	int x_senderror;            /* set by the reactor thread when send() failed */
+
+	int x_segsize;              /* datagram size for frames split by us (GSO), 0 = whole frames */
+	int x_gso;                  /* the socket segments for us (UDP_SEGMENT) */
+	char x_fraghead[DEFAULT_MAX_SEGMENTS][SF_HEADER_SIZE];	/* headers of the datagrams perform sends */
+
+	t_nsshmring *x_shm;         /* same-host ring after connect shm:<name>, no socket */
+	t_nstrace *x_trace;         /* recent events, "trace dump" writes them out */
+	t_nslog x_log;              /* perform reports, posted once per interval */
+	t_nsmetrics x_metrics;      /* entry in the exported counters */
+	t_nsencode x_encode;        /* interleaves a block for x_tag's format and channels */
+	int x_decimation;           /* every x_decimation-th sample is sent, 1 = all */
+	int x_framedecimation;      /* c_decimation when the frame started */
+	t_nsresample *x_decimators[NSRESAMPLE_MAXDOWN + 1];	/* anti-alias filter per factor, made on first use */
+	t_sample x_decbuf[DEFAULT_AUDIO_CHANNELS][NSRESAMPLE_CHUNK];	/* filtered samples for the frames */
+	int x_silence;              /* as set, see c_silence */
+	t_float x_threshold;
+	int x_framesilence;         /* c_silence when the frame started */
+	t_sample x_peak[DEFAULT_AUDIO_CHANNELS];	/* of each channel in the frame perform fills */
+	int x_suppressed;           /* channels left out of frames so far */
+
+	/* settings for perform, a triple buffer: the messages fill x_configback
+	   and swap it with x_configmiddle, perform swaps that with x_configfront */
+	t_nsconfig x_configs[3];
+	int x_configback;           /* under x_mutex */
+	int x_configmiddle;         /* the latest, NSTREAM_CONFIG_NEW until perform took it */
+	int x_configfront;          /* perform's */
+	int x_inperform;            /* perform runs, set around every tick */
+	int x_connection;           /* counts socket connects, under x_mutex */
+	int x_sending;              /* the connection perform last streamed to */
+	int x_sendfailed;           /* connection perform could not send on */
+	int x_senderrno;            /* why, for nstream_tilde_notify to post */
+	int x_paused;               /* publish no socket while it is reconfigured */
+	char x_streamid;            /* for the next frames, x_tag has perform's */
+
+#ifdef NSTREAM_PERF
+	t_nshist x_perfperform;     /* ns per call of perform */
+	t_nshist x_perfencode;      /* converting a block into the packet */
+	t_nshist x_perfsend;        /* send syscall, or queueing for the reactor */
+#endif
+
 
     pthread_mutex_t   x_mutex;
     pthread_cond_t    x_requestcondition;
@@ -186,22 +286,212 @@ typedef struct _nstream_tilde
 
 
 
+static void nstream_tilde_disconnect(t_nstream_tilde *x);
+
 static void nstream_tilde_notify(t_nstream_tilde *x)
 {
 	pthread_mutex_lock(&x->x_mutex);
+	if (x->x_fd != -1 && NS_LOAD_ACQUIRE(&x->x_sendfailed) == x->x_connection)
+	{
+		/* perform could not send, it leaves posting and closing to us */
+		pthread_mutex_unlock(&x->x_mutex);
+		errno = x->x_senderrno;
+		nstream_tilde_sockerror("send data");
+		nstream_tilde_disconnect(x);
+		return;
+	}
 	x->x_childthread = 0;
 	outlet_float(x->x_outlet, x->x_connectstate);
 	pthread_mutex_unlock(&x->x_mutex);
 }
 
 
+#ifndef _WINDOWS
+/* lay a frame out as datagrams of at most segsize bytes, each starting with
+   a copy of the header: iov gets header, data, header, data ... the kernel
+   cuts the buffer at segsize (UDP_SEGMENT) or we send the pairs one by one.
+   a frame that fits one datagram is sent whole. returns the iov count */
+static int nstream_tilde_fragment(t_tag *tag, int datalength, int segsize,
+				  char (*heads)[SF_HEADER_SIZE], struct iovec *iov)
+{
+	int chunk = segsize - (int)SF_HEADER_SIZE;
+	int nfrag = chunk > 0 ? (datalength + chunk - 1) / chunk : 0;
+	short fragments;
+	int k, offset;
+
+	if (nfrag <= 1 || nfrag > DEFAULT_MAX_SEGMENTS)
+	{
+		iov[0].iov_base = (char *)tag;
+		iov[0].iov_len = datalength + SF_HEADER_SIZE;
+		return (1);
+	}
+	fragments = (SF_BYTE_NATIVE == SF_BYTE_BE) ? toles(nfrag) : nfrag;
+	for (k = 0; k < nfrag; k++)
+	{
+		offset = k * chunk;
+		memcpy(heads[k], tag, SF_HEADER_SIZE);
+		memcpy(heads[k] + offsetof(t_tag, fragments), &fragments, sizeof(short));
+		iov[2 * k].iov_base = heads[k];
+		iov[2 * k].iov_len = SF_HEADER_SIZE;
+		iov[2 * k + 1].iov_base = tag->cbuf + offset;
+		iov[2 * k + 1].iov_len = (datalength - offset < chunk) ? datalength - offset : chunk;
+		if (SF_BYTE_NATIVE == SF_BYTE_BE)
+			offset = tolel(offset);
+		memcpy(heads[k] + offsetof(t_tag, fragoffset), &offset, sizeof(int));
+	}
+	return (2 * nfrag);
+}
+#endif
+
+
+/* the datagram size we split frames at: the GSO segment size, or 8k chunks
+   on OS X which fails on large sends. 0 sends whole frames */
+static int nstream_tilde_segsize(t_nstream_tilde *x)
+{
+#ifdef __APPLE__
+	return (DEFAULT_UDP_PACKT_SIZE);
+#else
+	return (x->x_gso ? x->x_segsize : 0);
+#endif
+}
+
+
+/* send a frame from perform, returns what send() returned */
+static int nstream_tilde_sendframe(t_nstream_tilde *x, t_nsconfig *c, t_tag *tag, int datalength)
+{
+#ifdef _WINDOWS
+	return (send(c->c_fd, (char *)tag, datalength + SF_HEADER_SIZE, SEND_FLAGS));
+#else
+	struct iovec iov[2 * DEFAULT_MAX_SEGMENTS];
+	struct msghdr msg;
+	int n = nstream_tilde_fragment(tag, datalength, c->c_segsize, x->x_fraghead, iov);
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+#ifdef __APPLE__
+	/* one datagram per header/data pair */
+	{
+		int k, ret = 0;
+		for (k = 0; k < n; k += 2)
+		{
+			msg.msg_iov = iov + k;
+			msg.msg_iovlen = (n == 1) ? 1 : 2;
+			if ((ret = sendmsg(c->c_fd, &msg, SEND_FLAGS)) <= 0)
+				break;
+		}
+		return (ret);
+	}
+#else
+	/* one syscall, the kernel cuts it into n/2 datagrams */
+	msg.msg_iovlen = n;
+	return (sendmsg(c->c_fd, &msg, SEND_FLAGS));
+#endif
+#endif /* _WINDOWS */
+}
+
+
+/* reactor thread: send what perform queued, never call pd from here */
+static void nstream_tilde_flush(t_nstream_tilde *x)
+{
+	int tail = x->x_sendtail;
+	int head = NS_LOAD_ACQUIRE(&x->x_sendhead);
+	char heads[DEFAULT_MAX_SEGMENTS][SF_HEADER_SIZE];
+	struct iovec iov[2 * DEFAULT_MAX_SEGMENTS];
+
+	while (tail != head)
+	{
+		int n = nstream_tilde_fragment(x->x_sendring[tail], x->x_sendlen[tail] - SF_HEADER_SIZE,
+					       x->x_gso ? x->x_segsize : 0, heads, iov);
+		/* out of io_uring send buffers: we get flushed again once one is free */
+		if (nsreactor_send(x->x_reactor, x->x_fd, iov, n, x, &x->x_senderror) < 0)
+			break;
+		tail = (tail + 1) % DEFAULT_SEND_FRAMES;
+		NS_STORE_RELEASE(&x->x_sendtail, tail);
+	}
+}
+
+
+/* let the kernel split our frames into x_segsize datagrams (Linux 4.18) */
+static void nstream_tilde_setgso(t_nstream_tilde *x, int sockfd)
+{
+	x->x_gso = 0;
+#ifdef UDP_SEGMENT
+	if (x->x_protocol == SOCK_DGRAM && x->x_segsize > 0)
+	{
+		int segsize = x->x_segsize;
+		x->x_gso = setsockopt(sockfd, SOL_UDP, UDP_SEGMENT, &segsize, sizeof(segsize)) == 0;
+	}
+	else
+	{
+		int off = 0;
+		setsockopt(sockfd, SOL_UDP, UDP_SEGMENT, &off, sizeof(off));
+	}
+#endif
+}
+
+
+/* hand the settings to perform, with x_mutex held: fill the back slot and
+   swap it in, perform takes it at its next tick. with wait we return once
+   perform no longer uses the previous settings, so the socket, ring or
+   reactor they name can go */
+static void nstream_tilde_publish(t_nstream_tilde *x, int wait)
+{
+	t_nsconfig *c = &x->x_configs[x->x_configback];
+
+	c->c_fd = x->x_paused ? -1 : x->x_fd;
+	c->c_reactor = x->x_paused ? 0 : x->x_reactor;
+	c->c_shm = x->x_shm;
+	c->c_segsize = nstream_tilde_segsize(x);
+	c->c_connection = x->x_connection;
+	c->c_channels = x->x_channels;
+	c->c_format = x->x_format;
+	c->c_blocksize = x->x_blocksize;
+	c->c_streamid = x->x_streamid;
+	c->c_decimation = x->x_decimation;
+	c->c_silence = x->x_silence;
+	c->c_threshold = x->x_threshold;
+	x->x_configback = NS_EXCHANGE(&x->x_configmiddle, x->x_configback | NSTREAM_CONFIG_NEW) & ~NSTREAM_CONFIG_NEW;
+
+	/* perform sets x_inperform before it looks for new settings: if it
+	   does not run now, its next tick starts with ours */
+	while (wait && (NS_LOAD_SEQ(&x->x_configmiddle) & NSTREAM_CONFIG_NEW) && NS_LOAD_SEQ(&x->x_inperform))
+		sched_yield();
+}
+
+
 static void nstream_tilde_disconnect(t_nstream_tilde *x)
 {
+	t_nsreactor *reactor;
+	t_nsshmring *shm;
+	int fd;
+
 	pthread_mutex_lock(&x->x_mutex);
-	if (x->x_fd != -1)
+	reactor = x->x_reactor;
+	shm = x->x_shm;
+	fd = x->x_fd;
+	x->x_reactor = 0;
+	x->x_shm = 0;
+	x->x_fd = -1;
+	if (reactor || shm || fd != -1)
+		nstream_tilde_publish(x, 1);
+	if (reactor)
+	{
+		/* returns once the reactor thread is done with the socket */
+		nsreactor_detach(reactor, -1, x);
+		if (x->x_senddrops)
+			post("nstream~: reactor fell behind, %d packets dropped", x->x_senddrops);
+		x->x_senddrops = 0;
+	}
+	if (shm)
+	{
+		NS_STORE_RELEASE(&shm->r_writer, 0);
+		nsshm_close(shm);
+		x->x_connectstate = 0;
+		outlet_float(x->x_outlet, 0);
+	}
+	if (fd != -1)
 	{
-		nstream_tilde_closesocket(x->x_fd);
-		x->x_fd = -1;
+		nstream_tilde_closesocket(fd);
 		x->x_connectstate = 0;
 		outlet_float(x->x_outlet, 0);
 	}
@@ -209,6 +499,32 @@ static void nstream_tilde_disconnect(t_nstream_tilde *x)
 }
 
 
+/* apply multicast options to a socket sending to a multicast group.
+   called with x_mutex held or before the socket is published */
+static void nstream_tilde_setmcastoptions(t_nstream_tilde *x, int sockfd)
+{
+	/* u_char is what Darwin expects, linux accepts both int and u_char */
+	unsigned char ttl = (unsigned char)x->x_mcastttl;
+	unsigned char loop = (unsigned char)(x->x_mcastloop != 0);
+	struct in_addr ifaddr = x->x_mcastifaddr;
+
+	if (setsockopt(sockfd, IPPROTO_IP, IP_MULTICAST_TTL, (const char*)&ttl, sizeof(ttl)) < 0)
+		nstream_tilde_sockerror("setsockopt(IP_MULTICAST_TTL)");
+
+	if (setsockopt(sockfd, IPPROTO_IP, IP_MULTICAST_LOOP, (const char*)&loop, sizeof(loop)) < 0)
+		nstream_tilde_sockerror("setsockopt(IP_MULTICAST_LOOP)");
+
+	if (setsockopt(sockfd, IPPROTO_IP, IP_MULTICAST_IF, (const char*)&ifaddr, sizeof(ifaddr)) < 0)
+		nstream_tilde_sockerror("setsockopt(IP_MULTICAST_IF)");
+}
+
+
+static int nstream_tilde_ismulticast(struct in_addr *addr)
+{
+	return IN_MULTICAST(ntohl(addr->s_addr));
+}
+
+
 static void *nstream_tilde_doconnect(void *zz)
 {
 	t_nstream_tilde *x = (t_nstream_tilde *)zz;
@@ -257,6 +573,14 @@ static void *nstream_tilde_doconnect(void *zz)
 
     memcpy((char *)&server.sin_addr, (char *)hp->h_addr, hp->h_length);
 
+	/* multicast: one socket reaches every receiver that joined the group */
+	if (nstream_tilde_ismulticast(&server.sin_addr))
+	{
+		pthread_mutex_lock(&x->x_mutex);
+		nstream_tilde_setmcastoptions(x, sockfd);
+		pthread_mutex_unlock(&x->x_mutex);
+	}
+
     /* assign client port number */
     server.sin_port = htons((unsigned short)portno);
 
@@ -272,8 +596,17 @@ static void *nstream_tilde_doconnect(void *zz)
     post("nstream~: connected host %s on port %d", hostname->s_name, portno);
 
 	pthread_mutex_lock(&x->x_mutex);
+	nstream_tilde_setgso(x, sockfd);
     x->x_fd = sockfd;
 	x->x_connectstate = 1;
+	nstrace_add(x->x_trace, NSTRACE_RESET, 0, 0, 0);
+	if (x->x_sendring[0] && nsreactor_getthreads())
+	{
+		x->x_sendhead = x->x_sendtail = 0;
+		x->x_senderror = 0;
+		x->x_reactor = nsreactor_attach(-1, (t_nsreactor_fn)nstream_tilde_flush, 0, x);
+	}
+	nstream_tilde_publish(x, 0);
 	clock_delay(x->x_clock, 0);
 	pthread_mutex_unlock(&x->x_mutex);
 	return (0);
@@ -287,6 +620,8 @@ static void nstream_tilde_connect(t_nstream_tilde *x, t_symbol *host, t_floatarg
 static void nstream_tilde_connect(t_nstream_tilde *x, t_symbol *host, long fportno)
 #endif
 {
+	const char *name;
+
 	pthread_mutex_lock(&x->x_mutex);
     if (x->x_childthread != 0)
     {
@@ -294,13 +629,33 @@ static void nstream_tilde_connect(t_nstream_tilde *x, t_symbol *host, long fport
          post("nstream~: already trying to connect");
          return;
     }
-    if (x->x_fd != -1)
+    if (x->x_fd != -1 || x->x_shm)
     {
 		 pthread_mutex_unlock(&x->x_mutex);
          post("nstream~: already connected");
          return;
     }
 
+	/* same host: shm:<name> maps a ring the receivers read directly */
+	if ((name = nsshm_name(host->s_name)))
+	{
+		if (!(x->x_shm = nsshm_open(name)))
+		{
+			pthread_mutex_unlock(&x->x_mutex);
+			nstream_tilde_sockerror("shm_open");
+			return;
+		}
+		if (NS_LOAD_ACQUIRE(&x->x_shm->r_writer))
+			post("nstream~: warning: %s already has a writer", host->s_name);
+		NS_STORE_RELEASE(&x->x_shm->r_writer, 1);
+		x->x_hostname = host;
+		x->x_connectstate = 1;
+		nstream_tilde_publish(x, 0);
+		pthread_mutex_unlock(&x->x_mutex);
+		outlet_float(x->x_outlet, 1);
+		return;
+	}
+
 	if (host != ps_nothing)
 		x->x_hostname = host;
 	else
@@ -310,7 +665,15 @@ static void nstream_tilde_connect(t_nstream_tilde *x, t_symbol *host, long fport
 		x->x_portno = DEFAULT_PORT;
     else
 		x->x_portno = (int)fportno;
-    x->x_count = 0;
+	x->x_connection++;	/* perform starts counting packets again */
+
+	/* the send ring is only needed when a reactor thread does the sending */
+	if (nsreactor_getthreads() && !x->x_sendring[0])
+	{
+		int i;
+		for (i = 0; i < DEFAULT_SEND_FRAMES; i++)
+			x->x_sendring[i] = (t_tag *)getbytes(sizeof(t_tag));
+	}
 
 	/* start child thread to connect */
     pthread_create(&x->x_childthread, 0, nstream_tilde_doconnect, x);
@@ -320,115 +683,101 @@ static void nstream_tilde_connect(t_nstream_tilde *x, t_symbol *host, long fport
 
 
 
-static t_int *nstream_tilde_perform(t_int *w)
+/* samples per frame: blocksize, or what fits the frame buffer in this format */
+static int nstream_tilde_framesize(int blocksize, int format, int channels)
 {
-    t_nstream_tilde* x = (t_nstream_tilde*) (w[1]);
-    int n = (int)(w[2]);
-    //t_float *in[DEFAULT_AUDIO_CHANNELS];
-    t_sample *in[DEFAULT_AUDIO_CHANNELS];
-	const int offset = 3;
-	char* nicbp= NULL;
-
-	int i; 
-	int  datalength = x->x_blocksize * SF_SIZEOF(x->x_tag.format) * x->x_tag.channels;
-    int sent = 0;
-
-	pthread_mutex_lock(&x->x_mutex);
+	int max = channels > 0 ? (int)(DEFAULT_CBUF_SIZE / (SF_SIZEOF(format) * channels)) : blocksize;
 
-	for (i = 0; i < x->x_ninlets; i++)
-	  //in[i] = (t_float *)(w[offset + i]);
-	  in[i] = (t_sample *)(w[offset + i]);
+	return (blocksize < max ? blocksize : max);
+}
 
-	if (n != x->x_vecsize)	/* resize buffer */
-	{
-	  post("resize buffer to pd tick size");
-
-	  x->x_vecsize = n;
-	  x->x_blockspersend = x->x_blocksize / x->x_vecsize;
-	  x->x_blockssincesend = 0;
-	  datalength = x->x_blocksize * SF_SIZEOF(x->x_tag.format) * x->x_tag.channels;
-	}
-	
-	int packetlength=datalength + sizeof(t_tag) - DEFAULT_CBUF_SIZE;
 
+/* the block goes into the frame sample by sample: a frame can take
+   several blocks or part of one, a block can fill several frames */
+static void nstream_tilde_frames(t_nstream_tilde *x, t_nsconfig *c, t_sample **in, int n)
+{
+	t_sample *src[DEFAULT_AUDIO_CHANNELS];
+	t_tag *tag;
+	int i, k, done, channels;
+	int datalength, packetlength;
+	unsigned int mask;
 
-    /* format the buffer */
-    switch (x->x_tag.format)
+	for (done = 0; done < n; done += k)
 	{
+		k = x->x_framesize - x->x_framepos;
+		if (k > n - done)
+			k = n - done;
 
-		case SF_FLOAT:
+		/* with a reactor we encode straight into the next free ring slot.
+		   the choice holds for the whole frame, like channels and format */
+		if (!x->x_framepos)
 		{
-		  //t_float* fbuf = (t_float *)x->x_cbuf +
-		  //(x->x_blockssincesend * x->x_vecsize *
-		  //x->x_tag.channels);
-		  //t_float* fbuf = (t_float *)x->x_tag.cbuf + (x->x_blockssincesend * x->x_vecsize * x->x_tag.channels);
-		  t_sample* fbuf = (t_sample *)x->x_tag.cbuf + (x->x_blockssincesend * x->x_vecsize * x->x_tag.channels);
-
-			while (n--)			       
-			    for (i = 0; i < x->x_tag.channels; i++)
-			      {
-				*fbuf++ = *(in[i]++);
-			      }
-			break;
+			x->x_framereactor = c->c_reactor;
+			/* silence is judged on whole frames, from the next one on */
+			x->x_framesilence = c->c_silence;
+			memset(x->x_peak, 0, sizeof(x->x_peak));
 		}
-		case SF_16BIT:
-		{
-			short* cibuf = (short *)x->x_tag.cbuf + (x->x_blockssincesend * x->x_vecsize * x->x_tag.channels);
-			while (n--) 
-			  {
+		tag = x->x_framereactor ? x->x_sendring[x->x_sendhead] : &x->x_tag;
 
-			  
+		NSPERF_START(tencode);
+		/* format the buffer, the kernel was picked for format and channels */
+		if (x->x_encode)
+		{
+			for (i = 0; i < x->x_tag.channels; i++)
+				src[i] = in[i] + done;
+			x->x_encode(tag->cbuf + x->x_framepos * x->x_tag.channels * SF_SIZEOF(x->x_tag.format),
+				    src, x->x_tag.channels, k);
+		}
+		if (x->x_framesilence)
+			for (i = 0; i < x->x_tag.channels; i++)
+			{
+				t_sample peak = nskernel_peak(in[i] + done, k);
+				if (peak > x->x_peak[i])
+					x->x_peak[i] = peak;
+			}
+		NSPERF_STOP(x->x_perfencode, tencode);
 
-				for (i = 0; i < x->x_tag.channels; i++)
-				  {
+		x->x_framepos += k;
+		if (x->x_framepos < x->x_framesize)
+			continue;
 
-#ifdef FIXEDPOINT	    
-				    *cibuf++ = (short)SCALE16( *(in[i]++)) ;
-#else
-				    if(SF_BYTE_NATIVE == SF_BYTE_BE)
-				      //*cibuf++ = toles((short)lrint(32767.0 * *(in[i]++)));
-				     *cibuf++ =  (short)lrint(32767.0 * *(in[i]++));
-				    else 
-				    *cibuf++ =  (short)lrint(32767.0 * *(in[i]++));
-#endif
-				  }
-				
-			  }
-			
-			break;
-		}
-	     	case SF_8BIT:
+		/* time to send the buffer, without the channels that stayed silent */
+		channels = x->x_tag.channels;
+		mask = 0;
+		if (x->x_framesilence)
 		{
-			char*  cbuf = (char*)x->x_tag.cbuf + (x->x_blockssincesend * x->x_vecsize * x->x_tag.channels);
-			while (n--) 
-			  for (i = 0; i < x->x_tag.channels; i++)
-			    {
-#ifdef FIXEDPOINT
-			      *cbuf++= (unsigned char)SCALE8((t_sample)(1. + *(in[i]++)));
-#else
-			      *cbuf++ = (unsigned char)(128. * (1.0 + *(in[i]++)));
-#endif
-			    }
-			break;
+			for (i = 0; i < x->x_tag.channels; i++)
+				if (x->x_peak[i] > c->c_threshold)
+					mask |= 1u << i;
+			/* at least one channel, a frame without any tells nothing */
+			if (!mask)
+				mask = 1;
+			channels = nskernel_compact(tag->cbuf, SF_SIZEOF(x->x_tag.format), x->x_tag.channels,
+						    mask, x->x_framesize);
+			x->x_suppressed += x->x_tag.channels - channels;
+			if (channels == x->x_tag.channels)
+				mask = 0;
 		}
-		default:
-			 break;
-    }
-
-	if (!(x->x_blockssincesend < x->x_blockspersend - 1))	/* time to send the buffer */
-	{
-		x->x_blockssincesend = 0;
+		datalength = x->x_framesize * SF_SIZEOF(x->x_tag.format) * channels;
+		packetlength = datalength + sizeof(t_tag) - DEFAULT_CBUF_SIZE;
 		x->x_count++;	/* count data packet we're going to send */
 
-		if (x->x_fd != -1)
+		/* after a failed send the clock disconnects, until then we drop.
+		   so does a frame begun in the other buffer, before a reactor came
+		   or went. another reactor thread sends from the same ring */
+		if (c->c_fd != -1 && x->x_sendfailed != c->c_connection && !x->x_framereactor == !c->c_reactor)
 		{
 
 			/* fill in the header tag */
 			if(SF_BYTE_NATIVE == SF_BYTE_BE)	
-			  //x->x_tag.framesize =  tolel(datalength);
-			  x->x_tag.framesize =  toles(datalength);
+			  x->x_tag.framesize =  tolel(datalength);
 			else
 			  x->x_tag.framesize = datalength;
+			x->x_tag.fragments = (SF_BYTE_NATIVE == SF_BYTE_BE) ? toles(1) : 1;
+			x->x_tag.fragoffset = 0;
+			x->x_tag.samplerate = (SF_BYTE_NATIVE == SF_BYTE_BE) ? tolel(x->x_samplerate) : x->x_samplerate;
+			x->x_tag.decimation = (SF_BYTE_NATIVE == SF_BYTE_BE) ? tolel(x->x_framedecimation) : x->x_framedecimation;
+			x->x_tag.channelmask = (SF_BYTE_NATIVE == SF_BYTE_BE) ? tolel(mask) : mask;
 			  
 			if(SF_BYTE_NATIVE == SF_BYTE_BE)
 			  //x->x_tag.count = tolel(x->x_count);
@@ -437,74 +786,171 @@ static t_int *nstream_tilde_perform(t_int *w)
 			  x->x_tag.count = x->x_count;
 
 
-			/* UDP: max. packet size is 64k (incl. headers) so we have to split */
-			
-#ifdef __APPLE__
-			  /* WARING: due to a 'bug' (maybe Apple would call it a feature?) in OS X
-			     send calls with data packets larger than 16k fail with error number 40!
-			     Thus we have to split the data packets into several packets that are 
-			     16k in size. The other side will reassemble them again. */
-			  
-			  int size = DEFAULT_UDP_PACKT_SIZE;
-			  if (packetlength < size)
-			    {	/* maybe data fits into one packet? */
-			      size = packetlength;
-			    }
-			  nicbp=(char*)&x->x_tag;
-			  /* send the buffer */
-			  for (sent = 0; sent < packetlength;)
-			    {
-			      int ret = 0;
-			      //ret = send(x->x_fd, bp,
-			      //size, SEND_FLAGS);
-			      ret = send(x->x_fd,nicbp , size, SEND_FLAGS);
-			      if (ret <= 0)
+			NSPERF_START(tsend);
+			if (c->c_reactor)
+			{
+				int next = (x->x_sendhead + 1) % DEFAULT_SEND_FRAMES;
+				if (next == NS_LOAD_ACQUIRE(&x->x_sendtail))
 				{
-				  nstream_tilde_sockerror("send data");
-				  pthread_mutex_unlock(&x->x_mutex);
-				  nstream_tilde_disconnect(x);
-				  return (w + offset + x->x_ninlets);
+					x->x_senddrops++;	/* ring full, the slot gets overwritten */
+					nstrace_add(x->x_trace, NSTRACE_OVERFLOW, 0, x->x_count, 0);
+					nslog_event(&x->x_log, NSTREAM_LOG_DROP, x->x_count);
 				}
-			      else
+				else
 				{
-				  nicbp += ret;
-				  sent += ret;
-				  if ((packetlength - sent) < size)
-				    size = packetlength - sent;
+					memcpy(tag, &x->x_tag, sizeof(t_tag) - DEFAULT_CBUF_SIZE);
+					x->x_sendlen[x->x_sendhead] = packetlength;
+					nstrace_add(x->x_trace, NSTRACE_SEND, 0, x->x_count, packetlength);
+					NS_STORE_RELEASE(&x->x_sendhead, next);
+					nsreactor_wakeup(c->c_reactor);
 				}
-			    }
-#else
-			  /* send the buffer, the OS might segment it into smaller packets */
-			  int ret = send(x->x_fd, (char*)&x->x_tag , packetlength, SEND_FLAGS);
-			  if (ret <= 0)
-			    {
-			      nstream_tilde_sockerror("send data");
-			      pthread_mutex_unlock(&x->x_mutex);
-			      nstream_tilde_disconnect(x);
-			      return (w + offset + x->x_ninlets);
-			    }
-#endif
-			
+				NSPERF_STOP(x->x_perfsend, tsend);
+			}
+			/* UDP: max. packet size is 64k (incl. headers), large frames go
+			   out as several datagrams the other side reassembles */
+			else if (nstream_tilde_sendframe(x, c, tag, datalength) <= 0)
+			{
+				/* no post or disconnect from here, nstream_tilde_notify does both */
+				x->x_senderrno = errno;
+				nstrace_add(x->x_trace, NSTRACE_SENDERROR, 0, errno, 0);
+				NS_STORE_RELEASE(&x->x_sendfailed, c->c_connection);
+				clock_delay(x->x_clock, 0);
+			}
+			else
+			{
+				NSPERF_STOP(x->x_perfsend, tsend);
+				nstrace_add(x->x_trace, NSTRACE_SEND, 0, x->x_count, datalength + SF_HEADER_SIZE);
+			}
 		}
-		
-		
-		/* check whether user has updated any parameters */
-		if (x->x_tag.channels != x->x_channels)
+
+		/* settings from the messages apply from the next frame on */
+		if (x->x_tag.channels != c->c_channels || x->x_tag.format != c->c_format)
 		  {
 		    
-		    x->x_tag.channels = x->x_channels;
+		    x->x_tag.channels = c->c_channels;
+		    x->x_tag.format = c->c_format;
+		    x->x_encode = nskernel_encode(x->x_tag.format, x->x_tag.channels);
+		    nstrace_add(x->x_trace, NSTRACE_FORMAT, 0, c->c_format, c->c_channels);
 		  }
-		if (x->x_tag.format != x->x_format)
-		  {
-		    
-		    x->x_tag.format = x->x_format;
+		x->x_tag.streamid = c->c_streamid;
+		x->x_framesize = nstream_tilde_framesize(c->c_blocksize, x->x_tag.format, x->x_tag.channels);
+		x->x_framepos = 0;
+	}
+}
+
+
+static t_int *nstream_tilde_perform(t_int *w)
+{
+    t_nstream_tilde* x = (t_nstream_tilde*) (w[1]);
+    int n = (int)(w[2]);
+    //t_float *in[DEFAULT_AUDIO_CHANNELS];
+    t_sample *in[DEFAULT_AUDIO_CHANNELS];
+	const int offset = 3;
+	t_sample *src[DEFAULT_AUDIO_CHANNELS];
+	t_nsconfig *c;
+
+	int i, k, m, done; 
+	NSPERF_START(tperform);
+
+	/* take new settings if the messages published some, never wait for them */
+	NS_STORE_SEQ(&x->x_inperform, 1);
+	if (NS_LOAD_SEQ(&x->x_configmiddle) & NSTREAM_CONFIG_NEW)
+		x->x_configfront = NS_EXCHANGE(&x->x_configmiddle, x->x_configfront) & ~NSTREAM_CONFIG_NEW;
+	c = &x->x_configs[x->x_configfront];
+	if (c->c_connection != x->x_sending)
+	{
+		x->x_sending = c->c_connection;
+		x->x_count = 0;
+	}
+
+	if (x->x_senderror && x->x_sendfailed != c->c_connection)
+	{
+		x->x_senderrno = x->x_senderror;
+		x->x_senderror = 0;
+		nstrace_add(x->x_trace, NSTRACE_SENDERROR, 0, x->x_senderrno, 0);
+		NS_STORE_RELEASE(&x->x_sendfailed, c->c_connection);
+		clock_delay(x->x_clock, 0);
+	}
+
+	for (i = 0; i < x->x_ninlets; i++)
+	  //in[i] = (t_float *)(w[offset + i]);
+	  in[i] = (t_sample *)(w[offset + i]);
+
+	if (c->c_shm)
+	{
+		/* interleave straight into the shared ring, always float and one
+		   block of latency. the receiver polls r_writepos, no syscall */
+		t_nsshmring *ring = c->c_shm;
+		unsigned int pos = ring->r_writepos;
+		int channels = c->c_channels < x->x_ninlets ? c->c_channels : x->x_ninlets;
+		NSPERF_START(tencode);
+
+		for (k = 0; k < n; k++)
+		{
+			float *frame = ring->r_data + ((pos + k) & (DEFAULT_SHM_FRAMES - 1)) * DEFAULT_SHM_CHANNELS;
+			for (i = 0; i < channels; i++)
+				frame[i] = in[i][k];
 		}
+		ring->r_channels = channels;
+		ring->r_samplerate = x->x_samplerate;
+		NS_STORE_RELEASE(&ring->r_writepos, pos + n);
+		NSPERF_STOP(x->x_perfencode, tencode);
+		goto done;
 	}
-	else
+
+	if (n != x->x_vecsize)
 	{
-		x->x_blockssincesend++;
+	  nslog_event(&x->x_log, NSTREAM_LOG_VECSIZE, n);
+	  x->x_vecsize = n;
 	}
-	pthread_mutex_unlock(&x->x_mutex);
+
+	for (done = 0; done < n; done += k)
+	{
+		t_nsresample *r;
+
+		/* the factor holds for a whole frame, a new one starts from the
+		   next with its filter empty */
+		if (!x->x_framepos && x->x_framedecimation != c->c_decimation)
+		{
+			x->x_framedecimation = c->c_decimation;
+			if (x->x_decimators[x->x_framedecimation])
+				nsresample_reset(x->x_decimators[x->x_framedecimation]);
+		}
+		if (!(r = x->x_decimators[x->x_framedecimation]))
+		{
+			/* up to the end of the frame, to look at the factor again */
+			k = x->x_framesize - x->x_framepos;
+			if (k > n - done)
+				k = n - done;
+			for (i = 0; i < x->x_ninlets; i++)
+				src[i] = in[i] + done;
+			nstream_tilde_frames(x, c, src, k);
+			continue;
+		}
+
+		/* through the anti-alias filter, as much input as completes the
+		   frame. the frames get what comes out */
+		m = x->x_framesize - x->x_framepos;
+		k = nsresample_need(r, m < NSRESAMPLE_CHUNK ? m : NSRESAMPLE_CHUNK);
+		if (k > n - done)
+			k = n - done;
+		if (k > NSRESAMPLE_CHUNK)
+			k = NSRESAMPLE_CHUNK;
+		NSPERF_START(tdecimate);
+		nsresample_input(r, src);
+		for (i = 0; i < x->x_ninlets; i++)
+		{
+			memcpy(src[i], in[i] + done, k * sizeof(t_sample));
+			src[i] = x->x_decbuf[i];
+		}
+		m = nsresample_ready(r, k);
+		nsresample_run(r, k, src, m);
+		NSPERF_STOP(x->x_perfencode, tdecimate);
+		nstream_tilde_frames(x, c, src, m);
+	}
+done:
+	NS_STORE_RELEASE(&x->x_inperform, 0);
+	NSPERF_STOP(x->x_perfperform, tperform);
     return (w + offset + x->x_ninlets);
 }
 
@@ -528,18 +974,12 @@ static void nstream_tilde_dsp(t_nstream_tilde *x, t_signal **sp)
 
 	pthread_mutex_unlock(&x->x_mutex);
 
-	if (DEFAULT_AUDIO_BUFFER_SIZE % sp[0]->s_n)
-	{
-		error("nstream~: signal vector size too large (needs to be even divisor of %d)", DEFAULT_AUDIO_BUFFER_SIZE);
-	}
-	else
-	{
+	/* any vector size, perform cuts packets of x_blocksize out of the blocks */
 #ifdef PD
-		dsp_addv(nstream_tilde_perform, x->x_ninlets + 2, (t_int*)x->x_myvec);
+	dsp_addv(nstream_tilde_perform, x->x_ninlets + 2, (t_int*)x->x_myvec);
 #else
-		dsp_addv(nstream_tilde_perform, x->x_ninlets + 2, (void**)x->x_myvec);
+	dsp_addv(nstream_tilde_perform, x->x_ninlets + 2, (void**)x->x_myvec);
 #endif
-	}
 }
 
 
@@ -553,6 +993,7 @@ static void nstream_tilde_channels(t_nstream_tilde *x, long channels)
 	if (channels >= 0 && channels <= DEFAULT_AUDIO_CHANNELS)
 	{
 		x->x_channels = (int)channels;
+		nstream_tilde_publish(x, 0);
 		post("nstream~: channels set to %d", (int)channels);
 	}
 	pthread_mutex_unlock(&x->x_mutex);
@@ -569,16 +1010,16 @@ static void nstream_tilde_buffersize(t_nstream_tilde *x, long bufsize)
 { 
 	pthread_mutex_lock(&x->x_mutex);
 
-	if(!( (int)bufsize % x->x_vecsize) && ((int)bufsize * sizeof(t_float) * x->x_ninlets <= DEFAULT_CBUF_SIZE) )
+	/* any number of samples, the packets need not line up with DSP blocks */
+	if ((int)bufsize >= 1 && ((int)bufsize * sizeof(t_float) * x->x_ninlets <= DEFAULT_CBUF_SIZE) )
 	  {
 
 
 
  
 	    		    
-	    x->x_blocksize = (int)bufsize;
-	    x->x_blockspersend = x->x_blocksize / x->x_vecsize;
-	    x->x_blockssincesend = 0 ;
+	    x->x_blocksize = (int)bufsize;	/* perform switches after its current frame */
+	    nstream_tilde_publish(x, 0);
 
 	    x->x_cbufsize = x->x_blocksize * sizeof(t_float) * x->x_ninlets;
 
@@ -597,7 +1038,8 @@ static void nstream_tilde_buffersize(t_nstream_tilde *x, long bufsize)
 	  }
 	else
 	  {
-	    error("nstream~: buffer size(%d) needs to be divisor of %d) and lesser than %d", (int)bufsize , x->x_vecsize,DEFAULT_CBUF_SIZE  );
+	    error("nstream~: buffer size (%d) needs to be between 1 and %d", (int)bufsize,
+		  (int)(DEFAULT_CBUF_SIZE / (sizeof(t_float) * x->x_ninlets)));
 	  }
 	pthread_mutex_unlock(&x->x_mutex);
 }
@@ -611,30 +1053,75 @@ static void nstream_tilde_format(t_nstream_tilde *x, t_symbol* form, long bitrat
 #endif
 {
 	pthread_mutex_lock(&x->x_mutex);
-	if (!strncmp(form->s_name,"float", 5) && x->x_tag.format != SF_FLOAT)
+	if (!strncmp(form->s_name,"float", 5) && x->x_format != SF_FLOAT)
 	{
 		x->x_format = (int)SF_FLOAT;
 	}
-	else if (!strncmp(form->s_name,"16bit", 5) && x->x_tag.format != SF_16BIT)
+	else if (!strncmp(form->s_name,"16bit", 5) && x->x_format != SF_16BIT)
 	{
 		x->x_format = (int)SF_16BIT;
 	}
-	else if (!strncmp(form->s_name,"8bit", 4) && x->x_tag.format != SF_8BIT)
+	else if (!strncmp(form->s_name,"8bit", 4) && x->x_format != SF_8BIT)
 	{
 		x->x_format = (int)SF_8BIT;
 	}
-	else if (!strncmp(form->s_name,"mp3", 3) && x->x_tag.format != SF_MP3)
+	else if (!strncmp(form->s_name,"mp3", 3) && x->x_format != SF_MP3)
 	{
 		error("nstream~: not compiled with mp3 support");
 		pthread_mutex_unlock(&x->x_mutex);
 		return;
 	}
+	nstream_tilde_publish(x, 0);
 	
 	post("nstream~: format set to %s", form->s_name);
 	pthread_mutex_unlock(&x->x_mutex);
 }
 
 
+/* send every factor-th sample for narrowband channels, nsreceive~
+   interpolates back. perform switches at the next frame. the filters
+   stay until the object goes, so perform never holds a freed one */
+#ifdef PD
+static void nstream_tilde_decimate(t_nstream_tilde *x, t_floatarg factor)
+#else
+static void nstream_tilde_decimate(t_nstream_tilde *x, long factor)
+#endif
+{
+	if ((int)factor < 1 || (int)factor > NSRESAMPLE_MAXDOWN)
+	{
+		error("nstream~: decimation must be between 1 and %d", NSRESAMPLE_MAXDOWN);
+		return;
+	}
+	pthread_mutex_lock(&x->x_mutex);
+	x->x_decimation = (int)factor;
+	if (x->x_decimation > 1 && !x->x_decimators[x->x_decimation])
+		x->x_decimators[x->x_decimation] = nsresample_new(x->x_decimation, 1, x->x_ninlets);
+	nstream_tilde_publish(x, 0);
+	pthread_mutex_unlock(&x->x_mutex);
+	post("nstream~: decimation set to %d", x->x_decimation);
+}
+
+
+/* leave channels out of a frame while none of their samples is above
+   threshold (0: digital silence only), nsreceive~ plays zeros for them */
+#ifdef PD
+static void nstream_tilde_silence(t_nstream_tilde *x, t_floatarg on, t_floatarg threshold)
+#else
+static void nstream_tilde_silence(t_nstream_tilde *x, long on, double threshold)
+#endif
+{
+	pthread_mutex_lock(&x->x_mutex);
+	x->x_silence = on != 0;
+	x->x_threshold = threshold > 0 ? (t_float)threshold : 0;
+	nstream_tilde_publish(x, 0);
+	pthread_mutex_unlock(&x->x_mutex);
+	if (x->x_silence)
+		post("nstream~: silent channels left out (threshold %g)", x->x_threshold);
+	else
+		post("nstream~: all channels sent");
+}
+
+
 /* set hostname to send to */
 static void nstream_tilde_host(t_nstream_tilde *x, t_symbol* host)
 {
@@ -655,6 +1142,313 @@ static void nstream_tilde_host(t_nstream_tilde *x, t_symbol* host)
 
 
 
+/* re-apply multicast options on a live connection */
+static void nstream_tilde_updatemcast(t_nstream_tilde *x)
+{
+	struct sockaddr_in peer;
+	socklen_t peerlen = sizeof(peer);
+
+	if (x->x_fd == -1)
+		return;
+	if (getpeername(x->x_fd, (struct sockaddr *)&peer, &peerlen) < 0)
+		return;
+	if (nstream_tilde_ismulticast(&peer.sin_addr))
+		nstream_tilde_setmcastoptions(x, x->x_fd);
+}
+
+
+/* hand sends to n shared I/O threads (epoll, or uring for io_uring) */
+#ifdef PD
+static void nstream_tilde_reactor(t_nstream_tilde *x, t_floatarg n, t_symbol *backend)
+#else
+static void nstream_tilde_reactor(t_nstream_tilde *x, long n, t_symbol *backend)
+#endif
+{
+	int threads = nsreactor_setthreads((int)n, backend == gensym("uring") ? NSREACTOR_URING : NSREACTOR_EPOLL);
+
+	if (threads)
+		post("nstream~: %d reactor threads (%s), used from the next connect", threads,
+		     nsreactor_getbackend() == NSREACTOR_URING ? "io_uring" : "epoll");
+	else if (n > 0)
+		error("nstream~: reactor not available on this system");
+	else
+		post("nstream~: reactor off, used from the next connect");
+}
+
+
+/* pin the reactor threads to cpu, cpu + 1, ..., -1 unpins them */
+#ifdef PD
+static void nstream_tilde_affinity(t_nstream_tilde *x, t_floatarg cpu)
+#else
+static void nstream_tilde_affinity(t_nstream_tilde *x, long cpu)
+#endif
+{
+	int err = nsreactor_setaffinity((int)cpu);
+
+	if (err)
+		error("nstream~: affinity: %s", strerror(err));
+	else if (cpu >= 0)
+		post("nstream~: reactor threads pinned from cpu %d", (int)cpu);
+	else
+		post("nstream~: reactor threads not pinned");
+}
+
+
+/* SCHED_FIFO priority of the reactor threads, 0 for normal scheduling */
+#ifdef PD
+static void nstream_tilde_priority(t_nstream_tilde *x, t_floatarg priority)
+#else
+static void nstream_tilde_priority(t_nstream_tilde *x, long priority)
+#endif
+{
+	int err = nsreactor_setpriority((int)priority);
+
+	if (err)
+		error("nstream~: priority: %s%s", strerror(err),
+		      err == EPERM ? " (needs CAP_SYS_NICE or an rtprio limit)" : "");
+	else if (priority > 0)
+		post("nstream~: reactor threads run SCHED_FIFO %d", (int)priority);
+	else
+		post("nstream~: reactor threads run normal scheduling");
+}
+
+
+#ifdef NSTREAM_PERF
+static void nstream_tilde_perfpost(const char *name, t_nshist *h, int clear)
+{
+	if (h->h_total)
+		post("nstream~: %-8s %8llu calls, mean %.2f max %.2f, p50 %.2f p99 %.2f p99.9 %.2f us",
+		     name, h->h_total, nshist_mean(h) / 1000., h->h_max / 1000.,
+		     nshist_percentile(h, 50) / 1000., nshist_percentile(h, 99) / 1000.,
+		     nshist_percentile(h, 99.9) / 1000.);
+	if (clear)
+		nshist_clear(h);
+}
+#endif
+
+
+/* our counters for the metrics export. runs on the exporter thread and
+   reads them without the mutex, so perform never waits for it */
+static void nstream_tilde_metricsfill(t_nstream_tilde *x, t_nsmetricsout *o)
+{
+	char name[64];
+	int i;
+
+	nsmetrics_series(o, "nstream", x->x_metrics.m_id);
+	nsmetrics_label(o, "host", x->x_hostname->s_name);
+	nsmetrics_labelint(o, "port", x->x_portno);
+	nsmetrics_value(o, "connected", x->x_connectstate);
+	nsmetrics_value(o, "packets_total", x->x_count);
+	nsmetrics_value(o, "drops_total", x->x_senddrops);
+	nsmetrics_value(o, "channels", x->x_channels);
+	nsmetrics_value(o, "format", x->x_format);
+	nsmetrics_value(o, "samplerate", x->x_samplerate);
+	nsmetrics_value(o, "decimation", x->x_decimation);
+	nsmetrics_value(o, "suppressed_total", x->x_suppressed);
+	nsmetrics_value(o, "blocksize", x->x_blocksize);
+	for (i = 0; i < x->x_log.l_ncategories; i++)
+	{
+		snprintf(name, sizeof(name), "log_%s_total", x->x_log.l_categories[i].c_name);
+		nsmetrics_value(o, name, x->x_log.l_count[i]);
+	}
+#ifdef NSTREAM_PERF
+	nsmetrics_value(o, "perform_seconds_mean", nshist_mean(&x->x_perfperform) * 1e-9);
+	nsmetrics_value(o, "perform_seconds_p99", nshist_percentile(&x->x_perfperform, 99) * 1e-9);
+	nsmetrics_value(o, "encode_seconds_mean", nshist_mean(&x->x_perfencode) * 1e-9);
+	nsmetrics_value(o, "encode_seconds_p99", nshist_percentile(&x->x_perfencode, 99) * 1e-9);
+#endif
+}
+
+
+/* export the counters of all nstream~ and nsreceive~ of this Pd to a file,
+   or to whoever connects to unix:<path>; "metrics off" stops it */
+#ifdef PD
+static void nstream_tilde_metrics(t_nstream_tilde *x, t_symbol *target, t_symbol *format, t_floatarg interval)
+#else
+static void nstream_tilde_metrics(t_nstream_tilde *x, t_symbol *target, t_symbol *format, long interval)
+#endif
+{
+	int off = (target == gensym("off"));
+	int err = nsmetrics_start(off ? NULL : target->s_name,
+				  format == gensym("json") ? NSMETRICS_JSON : NSMETRICS_PROMETHEUS, (int)interval);
+
+	if (err)
+		error("nstream~: metrics %s: %s", target->s_name, strerror(err));
+	else if (off)
+		post("nstream~: metrics export off");
+	else
+		post("nstream~: metrics export to %s (%s)", target->s_name,
+		     format == gensym("json") ? "json lines" : "prometheus");
+}
+
+
+/* counts of the events perform only logs, "log clear" starts over */
+static void nstream_tilde_log(t_nstream_tilde *x, t_symbol *s)
+{
+	nslog_print(&x->x_log, s == gensym("clear"));
+}
+
+
+/* "trace dump <file>" writes the recent events as Chrome trace JSON,
+   "trace clear" forgets them */
+static void nstream_tilde_trace(t_nstream_tilde *x, t_symbol *cmd, t_symbol *file)
+{
+	int err = 0;
+
+	if (cmd != gensym("clear") && (cmd != gensym("dump") || file == ps_nothing))
+	{
+		error("nstream~: trace dump <file> | clear");
+		return;
+	}
+	if (cmd == gensym("clear"))
+		nstrace_clear(x->x_trace);
+	else
+		err = nstrace_dump(x->x_trace, file->s_name, "nstream~");
+	if (err)
+		error("nstream~: trace dump %s: %s", file->s_name, strerror(err));
+	else if (cmd == gensym("dump"))
+		post("nstream~: trace written to %s", file->s_name);
+}
+
+
+/* cost of perform and its parts, "perf clear" starts over */
+static void nstream_tilde_perf(t_nstream_tilde *x, t_symbol *s)
+{
+#ifdef NSTREAM_PERF
+	int clear = (s == gensym("clear"));
+
+	nstream_tilde_perfpost("perform", &x->x_perfperform, clear);
+	nstream_tilde_perfpost("encode", &x->x_perfencode, clear);
+	nstream_tilde_perfpost("send", &x->x_perfsend, clear);
+#else
+	post("nstream~: built without NSTREAM_PERF, no timing (make PERF=1)");
+#endif
+}
+
+
+/* datagram size for large frames, sent with one syscall via UDP GSO.
+   should fit the path MTU minus 28 bytes of IP/UDP header, 0 sends whole
+   frames and leaves the splitting to IP fragmentation */
+#ifdef PD
+static void nstream_tilde_segment(t_nstream_tilde *x, t_floatarg size)
+#else
+static void nstream_tilde_segment(t_nstream_tilde *x, long size)
+#endif
+{
+	int segsize = (int)size;
+
+	if (segsize && (segsize < NSTREAM_MIN_SEGMENT || segsize > 65507))
+	{
+		error("nstream~: segment size must be between %d and 65507 bytes", NSTREAM_MIN_SEGMENT);
+		return;
+	}
+	pthread_mutex_lock(&x->x_mutex);
+	if (x->x_fd != -1)
+	{
+		/* neither perform nor the reactor may send while the socket changes
+		   how it cuts frames: pause the one, detach from the other. frames
+		   still queued are cut when sent, so at the new size */
+		x->x_paused = 1;
+		nstream_tilde_publish(x, 1);
+		if (x->x_reactor)
+			nsreactor_detach(x->x_reactor, -1, x);
+		x->x_segsize = segsize;
+		nstream_tilde_setgso(x, x->x_fd);
+		if (x->x_reactor)
+			x->x_reactor = nsreactor_attach(-1, (t_nsreactor_fn)nstream_tilde_flush, 0, x);
+		x->x_paused = 0;
+	}
+	else
+		x->x_segsize = segsize;
+	nstream_tilde_publish(x, 0);
+	pthread_mutex_unlock(&x->x_mutex);
+	if (!segsize)
+		post("nstream~: sending whole frames");
+	else if (x->x_fd == -1 || x->x_gso)
+		post("nstream~: segment size set to %d bytes", segsize);
+	else
+		post("nstream~: no UDP GSO on this socket, sending whole frames");
+}
+
+
+/* tag our packets, receivers sharing a port only play their own stream id */
+#ifdef PD
+static void nstream_tilde_streamid(t_nstream_tilde *x, t_floatarg id)
+#else
+static void nstream_tilde_streamid(t_nstream_tilde *x, long id)
+#endif
+{
+	pthread_mutex_lock(&x->x_mutex);
+	x->x_streamid = (char)CLIP((int)id, 0, 255);
+	nstream_tilde_publish(x, 0);
+	post("nstream~: stream id set to %d", (unsigned char)x->x_streamid);
+	pthread_mutex_unlock(&x->x_mutex);
+}
+
+
+/* set multicast time to live, 1 keeps packets on the local subnet */
+#ifdef PD
+static void nstream_tilde_ttl(t_nstream_tilde *x, t_floatarg ttl)
+#else
+static void nstream_tilde_ttl(t_nstream_tilde *x, long ttl)
+#endif
+{
+	pthread_mutex_lock(&x->x_mutex);
+	x->x_mcastttl = CLIP((int)ttl, 0, 255);
+	nstream_tilde_updatemcast(x);
+	post("nstream~: multicast ttl set to %d", x->x_mcastttl);
+	pthread_mutex_unlock(&x->x_mutex);
+}
+
+
+/* enable/disable local delivery of our own multicast packets */
+#ifdef PD
+static void nstream_tilde_loopback(t_nstream_tilde *x, t_floatarg loop)
+#else
+static void nstream_tilde_loopback(t_nstream_tilde *x, long loop)
+#endif
+{
+	pthread_mutex_lock(&x->x_mutex);
+	x->x_mcastloop = (loop != 0);
+	nstream_tilde_updatemcast(x);
+	post("nstream~: multicast loopback %s", x->x_mcastloop ? "on" : "off");
+	pthread_mutex_unlock(&x->x_mutex);
+}
+
+
+/* select the outgoing interface for multicast by its address,
+   no argument goes back to the default route. the name is resolved
+   before we take x_mutex, perform's settings handshake takes it too */
+static void nstream_tilde_interface(t_nstream_tilde *x, t_symbol *ifaddr)
+{
+	struct in_addr addr;
+
+	addr.s_addr = htonl(INADDR_ANY);
+	if (ifaddr != ps_nothing)
+	{
+		struct hostent *hp = gethostbyname(ifaddr->s_name);
+		if (hp == 0)
+		{
+			post("nstream~: bad multicast interface %s, using default route", ifaddr->s_name);
+			ifaddr = ps_nothing;
+		}
+		else
+			memcpy((char *)&addr, (char *)hp->h_addr, sizeof(addr));
+	}
+
+	pthread_mutex_lock(&x->x_mutex);
+	x->x_mcastif = ifaddr;
+	x->x_mcastifaddr = addr;
+	nstream_tilde_updatemcast(x);
+	if (ifaddr != ps_nothing)
+		post("nstream~: multicast interface set to %s", ifaddr->s_name);
+	else
+		post("nstream~: multicast interface set to default route");
+	pthread_mutex_unlock(&x->x_mutex);
+}
+
+
+
 #ifdef PD
 static void nstream_tilde_float(t_nstream_tilde* x, t_floatarg arg)
 #else
@@ -675,7 +1469,7 @@ static void nstream_tilde_bang(t_nstream_tilde *x)
 	t_symbol *sf_format;
 	t_float bitrate;
 
-	bitrate = (t_float)((SF_SIZEOF(x->x_tag.format) * x->x_samplerate * 8 * x->x_tag.channels) / 1000.);
+	bitrate = (t_float)((SF_SIZEOF(x->x_tag.format) * x->x_samplerate * 8 * x->x_tag.channels) / (1000. * x->x_decimation));
 
 	switch (x->x_tag.format)
 	{
@@ -813,6 +1607,10 @@ static void *nstream_tilde_new(long inlets)
 	x->x_connectstate = 0;
 	x->x_childthread = 0;
 	x->x_fd = -1;
+	x->x_mcastttl = DEFAULT_MCAST_TTL;
+	x->x_mcastloop = DEFAULT_MCAST_LOOP;
+	x->x_mcastif = ps_nothing;
+	x->x_mcastifaddr.s_addr = htonl(INADDR_ANY);
 	
 
 	    x->x_protocol = SOCK_DGRAM;
@@ -822,7 +1620,10 @@ static void *nstream_tilde_new(long inlets)
 
 	x->x_tag.format = x->x_format = SF_FLOAT;
 	x->x_tag.channels = x->x_channels = x->x_ninlets;
+	x->x_encode = nskernel_encode(x->x_tag.format, x->x_tag.channels);
 	x->x_tag.version = SF_BYTE_NATIVE;	/* native endianness */
+	x->x_decimation = x->x_framedecimation = 1;
+	x->x_segsize = DEFAULT_UDP_SEGMENT;
 	//post("ORDER = %d",x->x_tag.version);
 
 
@@ -830,9 +1631,16 @@ static void *nstream_tilde_new(long inlets)
 	x->x_bitrate = 0;		/* not specified, use default */
 
 	x->x_blocksize = DEFAULT_AUDIO_BUFFER_SIZE;
-	x->x_blockspersend = x->x_blocksize / x->x_vecsize;
-	x->x_blockssincesend = 0;
+	x->x_framesize = nstream_tilde_framesize(x->x_blocksize, x->x_tag.format, x->x_tag.channels);
+	x->x_framepos = 0;
 	x->x_cbufsize = x->x_blocksize * sizeof(t_float) * x->x_ninlets;
+	x->x_trace = nstrace_new();
+	x->x_configmiddle = 1;
+	x->x_configback = 2;
+	nstream_tilde_publish(x, 0);
+	nslog_init(&x->x_log, "nstream~", nstream_tilde_log_categories,
+		   sizeof(nstream_tilde_log_categories) / sizeof(t_nslogcategory));
+	nsmetrics_register(&x->x_metrics, (t_nsmetrics_fn)nstream_tilde_metricsfill, x);
 
 #ifdef UNIX
 	/* we don't want to get signaled in case send() fails */
@@ -846,7 +1654,15 @@ static void *nstream_tilde_new(long inlets)
 
 static void nstream_tilde_free(t_nstream_tilde* x)
 {
+	int i;
+
+	nsmetrics_unregister(&x->x_metrics);
 	nstream_tilde_disconnect(x);
+	if (x->x_sendring[0])
+	{
+		for (i = 0; i < DEFAULT_SEND_FRAMES; i++)
+			freebytes(x->x_sendring[i], sizeof(t_tag));
+	}
 
 #ifndef PD
 	dsp_free((t_pxobject *)x);	/* free the object */
@@ -855,6 +1671,11 @@ static void nstream_tilde_free(t_nstream_tilde* x)
 	/* free the memory */
 
 	if (x->x_myvec)t_freebytes(x->x_myvec, sizeof(t_int) * (x->x_ninlets + 3));
+	for (i = 0; i <= NSRESAMPLE_MAXDOWN; i++)
+		if (x->x_decimators[i])
+			nsresample_free(x->x_decimators[i]);
+	nstrace_free(x->x_trace);
+	nslog_free(&x->x_log);
 
 #ifdef USE_FAAC
 	if (x->x_faacbuf)t_freebytes(x->x_faacbuf, sizeof(char *) * (1.25 * DEFAULT_AUDIO_BUFFER_SIZE + 7200));
@@ -887,9 +1708,23 @@ void nstream_tilde_setup(void)
 
 
     class_addmethod(nstream_tilde_class, (t_method)nstream_tilde_format, gensym("format"), A_SYMBOL, A_DEFFLOAT, 0);
+    class_addmethod(nstream_tilde_class, (t_method)nstream_tilde_decimate, gensym("decimate"), A_FLOAT, 0);
+    class_addmethod(nstream_tilde_class, (t_method)nstream_tilde_silence, gensym("silence"), A_FLOAT, A_DEFFLOAT, 0);
     
 
     class_addmethod(nstream_tilde_class, (t_method)nstream_tilde_host, gensym("host"), A_DEFSYM, 0);
+    class_addmethod(nstream_tilde_class, (t_method)nstream_tilde_streamid, gensym("streamid"), A_FLOAT, 0);
+    class_addmethod(nstream_tilde_class, (t_method)nstream_tilde_reactor, gensym("reactor"), A_DEFFLOAT, A_DEFSYM, 0);
+    class_addmethod(nstream_tilde_class, (t_method)nstream_tilde_affinity, gensym("affinity"), A_FLOAT, 0);
+    class_addmethod(nstream_tilde_class, (t_method)nstream_tilde_priority, gensym("priority"), A_FLOAT, 0);
+    class_addmethod(nstream_tilde_class, (t_method)nstream_tilde_perf, gensym("perf"), A_DEFSYM, 0);
+    class_addmethod(nstream_tilde_class, (t_method)nstream_tilde_trace, gensym("trace"), A_SYMBOL, A_DEFSYM, 0);
+    class_addmethod(nstream_tilde_class, (t_method)nstream_tilde_log, gensym("log"), A_DEFSYM, 0);
+    class_addmethod(nstream_tilde_class, (t_method)nstream_tilde_metrics, gensym("metrics"), A_SYMBOL, A_DEFSYM, A_DEFFLOAT, 0);
+    class_addmethod(nstream_tilde_class, (t_method)nstream_tilde_segment, gensym("segment"), A_FLOAT, 0);
+    class_addmethod(nstream_tilde_class, (t_method)nstream_tilde_ttl, gensym("ttl"), A_FLOAT, 0);
+    class_addmethod(nstream_tilde_class, (t_method)nstream_tilde_loopback, gensym("loopback"), A_FLOAT, 0);
+    class_addmethod(nstream_tilde_class, (t_method)nstream_tilde_interface, gensym("interface"), A_DEFSYM, 0);
 	class_sethelpsymbol(nstream_tilde_class, gensym("nstream~"));
 
 
@@ -951,8 +1786,22 @@ void main()
 	addmess((method)nstream_tilde_connect, "connect", A_DEFSYM, A_DEFLONG, 0);
 	addmess((method)nstream_tilde_disconnect, "disconnect", 0);
 	addmess((method)nstream_tilde_format, "format", A_SYM, A_DEFLONG, 0);
+	addmess((method)nstream_tilde_decimate, "decimate", A_LONG, 0);
+	addmess((method)nstream_tilde_silence, "silence", A_LONG, A_DEFFLOAT, 0);
 	addmess((method)nstream_tilde_channels, "channels", A_LONG, 0);
 	addmess((method)nstream_tilde_host, "host", A_DEFSYM, 0);
+	addmess((method)nstream_tilde_streamid, "streamid", A_LONG, 0);
+	addmess((method)nstream_tilde_reactor, "reactor", A_DEFLONG, A_DEFSYM, 0);
+	addmess((method)nstream_tilde_affinity, "affinity", A_LONG, 0);
+	addmess((method)nstream_tilde_priority, "priority", A_LONG, 0);
+	addmess((method)nstream_tilde_perf, "perf", A_DEFSYM, 0);
+	addmess((method)nstream_tilde_trace, "trace", A_SYM, A_DEFSYM, 0);
+	addmess((method)nstream_tilde_log, "log", A_DEFSYM, 0);
+	addmess((method)nstream_tilde_metrics, "metrics", A_SYM, A_DEFSYM, A_DEFLONG, 0);
+	addmess((method)nstream_tilde_segment, "segment", A_LONG, 0);
+	addmess((method)nstream_tilde_ttl, "ttl", A_LONG, 0);
+	addmess((method)nstream_tilde_loopback, "loopback", A_LONG, 0);
+	addmess((method)nstream_tilde_interface, "interface", A_DEFSYM, 0);
 	addmess((method)nstream_tilde_assist, "assist", A_CANT, 0);
 	addbang((method)nstream_tilde_bang);
 	dsp_initclass();
@@ -37,6 +37,11 @@
 #define DEFAULT_CBUF_SIZE DEFAULT_AUDIO_BUFFER_SIZE * DEFAULT_AUDIO_CHANNELS * sizeof(t_sample)
 #define DEFAULT_UDP_PACKT_SIZE 8192		/* number of bytes we send in one UDP datagram (OS X only) */
 #define DEFAULT_PORT 8000               /* default network port number */
+#define DEFAULT_MCAST_TTL 1             /* multicast hops, 1 stays on the local subnet */
+#define DEFAULT_MCAST_LOOP 1            /* deliver multicast to receivers on the sending host */
+#define DEFAULT_SEND_FRAMES 4           /* packets queued for a reactor thread (nstream~) */
+#define DEFAULT_UDP_SEGMENT 1472        /* datagram size for UDP GSO, fits a 1500 byte MTU */
+#define DEFAULT_MAX_SEGMENTS 64         /* kernel limit of segments per GSO send */
 
 #ifdef _WINDOWS
 #ifndef HAVE_INT32_T
@@ -149,10 +154,18 @@ typedef struct _tag {      /* size (bytes) */
   //       long count;           /*    4         */
    short count;           /*    2         */
   char channels;        /*    1         */
+  char streamid;        /*    1         routes the stream to receivers sharing a port */
+  short fragments;      /*    2         datagrams the frame was split into, 1 = whole frame */
   // long framesize;       /*    2         */
-  short framesize;       /*    4         */
+  int framesize;        /*    4         */
+  int fragoffset;       /*    4         where the data of this datagram goes in cbuf */
+  int samplerate;       /*    4         of the sender, the receiver converts to its own */
+  int decimation;       /*    4         the frame holds every decimation-th sample, 1 = all */
+  unsigned int channelmask; /* 4       channels the frame carries, bit i for channel i, 0 = all */
   char cbuf[DEFAULT_CBUF_SIZE];
 } t_tag;                   
+
+#define SF_HEADER_SIZE (sizeof(t_tag) - DEFAULT_CBUF_SIZE)
                            
 
 